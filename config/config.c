@@ -162,6 +162,8 @@ Settings config = {
     .window_thumbnail          = FALSE,
     .drun_use_desktop_cache    = FALSE,
     .drun_reload_desktop_cache = FALSE,
+    .trigram_index             = FALSE,
+    .normalize_match           = FALSE,
     /** Benchmarks */
     .benchmark_ui              = FALSE
 };
@@ -42,6 +42,14 @@
  */
 int dmenu_switcher_dialog ( void );
 
+/**
+ * Filter the input without user interface (-dump) and print the matching rows.
+ * The input is read in blocks that are matched in parallel while reading, no display is needed.
+ *
+ * @returns the exit code.
+ */
+int dmenu_dump ( void );
+
 /**
  * Print dmenu mode commandline options to stdout, for use in help menu.
  */
@@ -45,6 +45,27 @@
  */
 PangoAttrList *helper_token_match_get_pango_attr ( RofiHighlightColorStyle th, rofi_int_matcher **tokens, const char *input, PangoAttrList *retv );
 
+/**
+ * @param tokens Array of regexes used for matching
+ * @param input The input string to find the matches on
+ * @param num_spans Set to the number of spans found.
+ *
+ * Find the parts of the input string the tokens match, as highlighted by helper_token_match_get_pango_attr().
+ *
+ * @returns a newly allocated array of num_spans (start, end) byte offset pairs, free with g_free().
+ */
+int *helper_token_match_get_spans ( rofi_int_matcher **tokens, const char *input, unsigned int *num_spans );
+
+/**
+ * @param th The RofiHighlightColorStyle
+ * @param spans The (start, end) pairs, as returned by helper_token_match_get_spans().
+ * @param num_spans The number of spans.
+ * @param retv The Attribute list to update with the spans
+ *
+ * Add the pango attributes highlighting the spans.
+ */
+void helper_token_match_spans_pango_attr ( RofiHighlightColorStyle th, const int *spans, unsigned int num_spans, PangoAttrList *retv );
+
 /**
  * @param pfd Pango font description to validate.
  * @param font The name of the font to check.
@@ -29,6 +29,7 @@
 #define ROFI_HELPER_H
 #include <cairo.h>
 #include "rofi-types.h"
+#include "rofi-match-store.h"
 G_BEGIN_DECLS
 
 /**
@@ -63,6 +64,26 @@ int helper_parse_setup ( char * string, char ***output, int *length, ... );
  */
 rofi_int_matcher **helper_tokenize ( const char *input, int case_sensitive );
 
+/**
+ * @param tokens The tokens to order, can be NULL.
+ * @param hit_rates The measured fraction of rows each token matches, reordered with the tokens. NULL to use the estimated hit_rate of the tokens.
+ *
+ * Order the tokens so the tokens that are cheap and reject the most rows are evaluated first.
+ * Inverted tokens are always put last. All tokens have to match, so the order does not change the result.
+ * The tokens are shared, so a measured hit rate is kept by the caller and not stored in the token.
+ */
+void helper_tokenize_sort ( rofi_int_matcher **tokens, double *hit_rates );
+
+/**
+ * @param token The token.
+ *
+ * Get the regex of a token. Plain tokens are matched without the regex engine, their regex is only compiled
+ * on the first call, e.g. by a plugin that matches with it. Fuzzy and glob tokens have no regex.
+ *
+ * @returns the regex of the token, NULL for fuzzy and glob tokens.
+ */
+GRegex *helper_token_get_regex ( rofi_int_matcher *token );
+
 /**
  * @param tokens Array of regex objects
  *
@@ -70,6 +91,11 @@ rofi_int_matcher **helper_tokenize ( const char *input, int case_sensitive );
  */
 void helper_tokenize_free ( rofi_int_matcher ** tokens );
 
+/**
+ * Drop the compiled tokens helper_tokenize() keeps for reuse.
+ */
+void helper_tokenize_cache_clear ( void );
+
 /**
  * @param key The key to search for
  * @param val Pointer to the string to set to the key value (if found)
@@ -137,6 +163,83 @@ int find_arg ( const char * const key );
  * @returns TRUE when matches, FALSE otherwise
  */
 int helper_token_match ( rofi_int_matcher * const *tokens, const char *input );
+
+/**
+ * @param tokens  List of (input) tokens to match.
+ * @param input   The entry to match against.
+ * @param store   The match store holding the prepared input, or NULL.
+ * @param slot    The slot in store for input.
+ *
+ * Tokenized match, like helper_token_match(), case insensitive literal tokens are matched
+ * against the prepared input from the store. Rows that lack a character of such a token are rejected
+ * on the bloom of the prepared input, before matching.
+ *
+ * @returns TRUE when matches, FALSE otherwise
+ */
+int helper_token_match_store ( rofi_int_matcher * const *tokens, const char *input, RofiMatchStore *store, unsigned int slot );
+
+/**
+ * @param tokens  List of (input) tokens to match.
+ * @param input   The entry to match against, does not have to be nul terminated.
+ * @param len     The length of input in bytes.
+ * @param store   The match store holding the prepared input, or NULL.
+ * @param slot    The slot in store for input.
+ *
+ * Like helper_token_match_store(), for entries that are not nul terminated, e.g. rows in a mapped file.
+ *
+ * @returns TRUE when matches, FALSE otherwise
+ */
+int helper_token_match_len ( rofi_int_matcher * const *tokens, const char *input, size_t len, RofiMatchStore *store, unsigned int slot );
+
+/**
+ * Get, and reset, the number of rows helper_token_match_store() rejected in the calling thread
+ * because they lack a character of a token (see rofi_match_bloom()). Used for the timing output.
+ *
+ * @returns the number of rejected rows.
+ */
+unsigned int helper_token_match_take_bloom_rejects ( void );
+
+/** Separates the fields in RofiMatchFields, a plain token without it can not match across fields. */
+#define ROFI_MATCH_FIELD_SEPARATOR    '\x1f'
+
+/**
+ * The fields of an entry joined in one string, so a plain token is matched against all fields in one scan.
+ */
+typedef struct
+{
+    /** The fields, each followed by ROFI_MATCH_FIELD_SEPARATOR. */
+    char         *text;
+    /** Length of text in bytes. */
+    size_t       len;
+    /** Number of fields. */
+    unsigned int num_fields;
+    /** Start of each field in text, followed by len. */
+    unsigned int *offsets;
+} RofiMatchFields;
+
+/**
+ * @param fields The fields to join, NULL fields are skipped.
+ * @param num_fields The number of fields.
+ *
+ * Join the fields an entry is matched on.
+ *
+ * @returns a newly allocated RofiMatchFields, free with g_free().
+ */
+RofiMatchFields *helper_match_fields_new ( const char * const *fields, unsigned int num_fields );
+
+/**
+ * @param tokens  List of (input) tokens to match.
+ * @param fields  The fields of the entry to match against, or NULL if it has none.
+ * @param store   The match store holding the prepared fields->text, or NULL.
+ * @param slot    The slot in store for fields->text.
+ *
+ * Tokenized match against multiple fields. A token matches if it matches in any of the fields,
+ * an inverted token if it matches in none of them.
+ * Plain tokens are searched for in all fields at once, other tokens are matched per field.
+ *
+ * @returns TRUE when matches, FALSE otherwise
+ */
+int helper_token_match_fields ( rofi_int_matcher * const *tokens, const RofiMatchFields *fields, RofiMatchStore *store, unsigned int slot );
 /**
  * @param cmd The command to execute.
  *
@@ -167,6 +270,14 @@ void remove_pid_file ( int fd );
  */
 int config_sanity_check ( void );
 
+/**
+ * Validate the part of the configuration that is used without a display, e.g. the matching and sorting method.
+ * Errors are printed as warnings instead of shown in a dialog.
+ *
+ * @returns TRUE if the configuration is invalid.
+ */
+int config_sanity_check_headless ( void );
+
 /**
  * @param arg string to parse.
  *
@@ -205,6 +316,52 @@ char *rofi_expand_path ( const char *input );
  */
 unsigned int levenshtein ( const char *needle, const glong needlelen, const char *haystack, const glong haystacklen );
 
+/**
+ * @param needle The codepoints to find match weight off
+ * @param needlelen The number of codepoints in needle
+ * @param haystack The codepoints to match against
+ * @param haystacklen The number of codepoints in haystack
+ *
+ * Levenshtein distance calculation on decoded strings, e.g. from a RofiMatchString.
+ *
+ * @returns the levenshtein distance between needle and haystack
+ */
+unsigned int levenshtein_ucs ( const gunichar *needle, const glong needlelen, const gunichar *haystack, const glong haystacklen );
+
+/**
+ * Pattern prepared for repeated levenshtein distance calculations.
+ */
+typedef struct _RofiLevenshteinPattern RofiLevenshteinPattern;
+
+/**
+ * @param needle The codepoints to find match weight off
+ * @param needlelen The number of codepoints in needle
+ *
+ * Precompute the bit-parallel match vectors of needle, once for all the rows it is compared against.
+ * Case sensitivity is taken from the configuration at the time of the call.
+ *
+ * @returns a newly allocated pattern, free with levenshtein_pattern_free.
+ */
+RofiLevenshteinPattern *levenshtein_pattern_new ( const gunichar *needle, const glong needlelen );
+
+/**
+ * @param pat The pattern to free, can be NULL.
+ *
+ * Free a pattern created with levenshtein_pattern_new.
+ */
+void levenshtein_pattern_free ( RofiLevenshteinPattern *pat );
+
+/**
+ * @param pat The prepared needle.
+ * @param haystack The codepoints to match against
+ * @param haystacklen The number of codepoints in haystack
+ *
+ * Bit-parallel (Myers/Hyyrö) levenshtein distance calculation, safe to call from multiple threads.
+ *
+ * @returns the levenshtein distance between the needle of pat and haystack
+ */
+unsigned int levenshtein_pattern_distance ( const RofiLevenshteinPattern *pat, const gunichar *haystack, const glong haystacklen );
+
 /**
  * @param data the unvalidated character array holding possible UTF-8 data
  * @param length the length of the data array
@@ -245,6 +402,65 @@ gchar *rofi_escape_markup ( gchar *text );
  * @returns the sorting weight.
  */
 int rofi_scorer_fuzzy_evaluate ( const char *pattern, glong plen, const char *str, glong slen );
+
+/**
+ * @param pattern   The user input codepoints to match against.
+ * @param plen      Number of codepoints in pattern.
+ * @param str       The input codepoints to match against pattern.
+ * @param slen      Number of codepoints in str.
+ *
+ * FZF like fuzzy sorting algorithm on decoded strings, e.g. from a RofiMatchString.
+ *
+ * @returns the sorting weight.
+ */
+int rofi_scorer_fuzzy_evaluate_ucs ( const gunichar *pattern, glong plen, const gunichar *str, glong slen );
+
+/**
+ * Pattern prepared for repeated fuzzy scoring.
+ */
+typedef struct _RofiFuzzyPattern RofiFuzzyPattern;
+
+/**
+ * @param pattern   The user input codepoints to match against.
+ * @param plen      Number of codepoints in pattern.
+ *
+ * Precompute the (case folded) pattern characters and their weights, once for all the rows they are scored against.
+ * Case sensitivity is taken from the configuration at the time of the call.
+ *
+ * @returns a newly allocated pattern, free with rofi_scorer_fuzzy_pattern_free.
+ */
+RofiFuzzyPattern *rofi_scorer_fuzzy_pattern_new ( const gunichar *pattern, glong plen );
+
+/**
+ * @param pat The pattern to free, can be NULL.
+ *
+ * Free a pattern created with rofi_scorer_fuzzy_pattern_new.
+ */
+void rofi_scorer_fuzzy_pattern_free ( RofiFuzzyPattern *pat );
+
+/**
+ * @param pat       The prepared user input to match against.
+ * @param str       The input codepoints to match against pattern.
+ * @param slen      Number of codepoints in str.
+ *
+ * FZF like fuzzy sorting algorithm, for input of any length.
+ * Safe to call from multiple threads, it does not allocate memory after the first calls in a thread.
+ *
+ * @returns the sorting weight.
+ */
+int rofi_scorer_fuzzy_pattern_evaluate ( const RofiFuzzyPattern *pat, const gunichar *str, glong slen );
+
+/**
+ * @param pat       The prepared user input to match against.
+ * @param str       The input codepoints to match against pattern.
+ * @param slen      Number of codepoints in str.
+ *
+ * Cheap check, without scoring, if all characters of the pattern occur in str in order.
+ * Rows that fail it are ranked below the rows that pass it.
+ *
+ * @returns TRUE if pattern is a subsequence of str.
+ */
+gboolean rofi_scorer_fuzzy_pattern_is_subsequence ( const RofiFuzzyPattern *pat, const gunichar *str, glong slen );
 /*@}*/
 
 /**
@@ -337,6 +553,17 @@ void parse_ranges ( char *input, rofi_range_pair **list, unsigned int *length );
  */
 void rofi_output_formatted_line ( const char *format, const char *string, int selected_line, const char *filter );
 
+/**
+ * @param str The string to append to.
+ * @param format The output format, see rofi_output_formatted_line().
+ * @param string The selected entry.
+ * @param selected_line The selected line index.
+ * @param filter The entered filter.
+ *
+ * Append the line, formatted like rofi_output_formatted_line() outputs it (including the newline), to str.
+ */
+void rofi_append_formatted_line ( GString *str, const char *format, const char *string, int selected_line, const char *filter );
+
 /**
  * @param string The string with elements to be replaced
  * @param ...    Set of {key}, value that will be replaced, terminated by  a NULL
@@ -31,7 +31,7 @@
 G_BEGIN_DECLS
 
 /** ABI version to check if loaded plugin is compatible. */
-#define ABI_VERSION    0x00000006
+#define ABI_VERSION    0x00000007
 
 /**
  * @param data Pointer to #Mode object.
@@ -73,6 +73,28 @@ typedef cairo_surface_t * ( *_mode_get_icon )( const Mode *sw, unsigned int sele
  */
 typedef char * ( *_mode_get_completion )( const Mode *sw, unsigned int selected_line );
 
+/**
+ * @param sw The #Mode pointer
+ * @param selected_line The selected line
+ * @param length The length of the returned string in bytes, -1 if not known [out]
+ *
+ * Obtains the string used for sorting without copying it, it should be the same as the completion string.
+ *
+ * @return the (borrowed) sort key valid until the entries change, or NULL to use the completion string
+ */
+typedef const char * ( *_mode_get_sort_key )( const Mode *sw, unsigned int selected_line, gssize *length );
+
+/**
+ * @param sw The #Mode pointer
+ * @param selected_line The selected line
+ *
+ * Obtains all the text the entry is matched on, e.g. the different fields joined with newlines.
+ * Every plain token that matches the entry should be a (case insensitive) substring of it.
+ *
+ * @return the newly allocated text, or NULL if the entry can not match any token
+ */
+typedef char * ( *_mode_get_match_text )( const Mode *sw, unsigned int selected_line );
+
 /**
  * @param tokens  List of (input) tokens to match.
  * @param input   The entry to match against.
@@ -195,6 +217,14 @@ struct rofi_mode
 
     /** Module */
     GModule    *module;
+
+    /**
+     * Added at the end, so the older members keep their place.
+     */
+    /** Get the (borrowed) key to sort the entry on. */
+    _mode_get_sort_key   _get_sort_key;
+    /** Get the text the entry is matched on. */
+    _mode_get_match_text _get_match_text;
 };
 G_END_DECLS
 #endif // ROFI_MODE_PRIVATE_H
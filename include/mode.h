@@ -144,6 +144,35 @@ cairo_surface_t * mode_get_icon ( const Mode *mode, unsigned int selected_line,
  */
 char * mode_get_completion ( const Mode *mode, unsigned int selected_line );
 
+/**
+ * @param mode The mode to query
+ * @param selected_line The entry to query
+ * @param length Set to the length of the returned string in bytes, -1 if not known.
+ *
+ * Return the string to sort the entry on, the same as mode_get_completion() but without a copy.
+ *
+ * @returns the borrowed string, NULL if the mode cannot provide it without a copy.
+ */
+const char * mode_get_sort_key ( const Mode *mode, unsigned int selected_line, gssize *length );
+
+/**
+ * @param mode The mode to query
+ *
+ * @returns TRUE if the mode provides the text its entries are matched on.
+ */
+gboolean mode_has_match_text ( const Mode *mode );
+
+/**
+ * @param mode The mode to query
+ * @param selected_line The entry to query
+ *
+ * Return all the text the entry is matched on, every plain token that matches the entry is a
+ * (case insensitive) substring of it. Used to index the entries.
+ *
+ * @returns the newly allocated text, NULL if the entry can not match or the mode does not provide it.
+ */
+char * mode_get_match_text ( const Mode *mode, unsigned int selected_line );
+
 /**
  * @param mode The mode to query
  * @param menu_retv The menu return value.
@@ -0,0 +1,157 @@
+#ifndef ROFI_MATCH_STORE_H
+#define ROFI_MATCH_STORE_H
+
+#include <glib.h>
+
+/**
+ * @defgroup MATCHSTORE MatchStore
+ * @ingroup HELPERS
+ *
+ * Store of the strings the matchers and scorers work on, prepared once per entry.
+ * Case folding, normalizing and decoding the entries is then not redone for every row on every key press.
+ *
+ * A mode creates a store with one slot per string it matches against, the slots are filled lazily on first use.
+ * All stores together are bounded in memory, when the limit is hit slots are no longer filled and
+ * the users fall back to working on the original string.
+ * @{
+ */
+
+/** Maximum memory (in bytes) used by all match stores together. */
+#define ROFI_MATCH_STORE_MAX_SIZE    ( 128 * 1024 * 1024 )
+
+/**
+ * A prepared string.
+ */
+typedef struct
+{
+    /** The NFC normalized, case folded, text. With normalize-match without diacritics. */
+    const char     *folded;
+    /** Length of folded in bytes. */
+    size_t         folded_len;
+    /** The codepoints of the text as is (not normalized or case folded), for the sort scorers. NULL if not stored. */
+    const gunichar *ucs;
+    /** Number of codepoints in ucs. */
+    glong          ucs_len;
+    /** Bloom of the bytes in folded, see rofi_match_bloom(). */
+    guint64        bloom;
+} RofiMatchString;
+
+/**
+ * Opaque store of RofiMatchString.
+ */
+typedef struct _RofiMatchStore RofiMatchStore;
+
+/**
+ * @param c The character to fold.
+ *
+ * Simple (one to one) case folding of a character, used for all case insensitive matching and scoring.
+ *
+ * @returns the folded character.
+ */
+static inline gunichar rofi_match_fold_char ( gunichar c )
+{
+    if ( c < 0x80 ) {
+        return ( c >= 'A' && c <= 'Z' ) ? ( c + ( 'a' - 'A' ) ) : c;
+    }
+    return g_unichar_tolower ( g_unichar_toupper ( c ) );
+}
+
+/**
+ * @param text The (UTF-8) text to fold.
+ * @param len The length of text in bytes, or -1 if nul terminated.
+ * @param folded_len Set to the length of the returned string in bytes.
+ * @param offsets If not NULL, set to a newly allocated array mapping each byte (and the end) of the returned string to the
+ * byte offset in text it originates from.
+ *
+ * NFC normalizes and case folds text. With normalize-match the diacritics are removed as well.
+ *
+ * @returns a newly allocated folded string.
+ */
+char *rofi_match_fold ( const char *text, gssize len, size_t *folded_len, unsigned int **offsets );
+
+/**
+ * @param text The (folded) text.
+ * @param len The length of text in bytes.
+ *
+ * Bloom of the bytes in text, one bit per letter and digit, the other bytes share the remaining bits.
+ * A string can only contain text (in any order) if its bloom has all the bits of the bloom of text set,
+ * so rows that lack a character of a token are rejected with a single AND.
+ *
+ * @returns the bloom of text.
+ */
+guint64 rofi_match_bloom ( const char *text, size_t len );
+
+/**
+ * @param text The (UTF-8) text to prepare.
+ * @param codepoints If the codepoints should be stored.
+ *
+ * Prepare a single string, e.g. the pattern to score with, outside of a store.
+ *
+ * @returns a newly allocated RofiMatchString, free with rofi_match_string_free.
+ */
+RofiMatchString *rofi_match_string_new ( const char *text, gboolean codepoints );
+
+/**
+ * @param ms The RofiMatchString to free, can be NULL.
+ *
+ * Free a string created with rofi_match_string_new.
+ */
+void rofi_match_string_free ( RofiMatchString *ms );
+
+/**
+ * @param num_slots The number of slots.
+ * @param codepoints If the codepoints should be stored.
+ *
+ * Create a new store.
+ *
+ * @returns a newly allocated store, free with rofi_match_store_free.
+ */
+RofiMatchStore *rofi_match_store_new ( unsigned int num_slots, gboolean codepoints );
+
+/**
+ * @param store The store to free, can be NULL.
+ *
+ * Free the store and all the prepared strings in it.
+ */
+void rofi_match_store_free ( RofiMatchStore *store );
+
+/**
+ * @param store The store.
+ *
+ * Drop all prepared strings, e.g. because the entries changed.
+ * Should not be called while a filter pass is running.
+ */
+void rofi_match_store_clear ( RofiMatchStore *store );
+
+/**
+ * @param store The store.
+ * @param num_slots The new minimum number of slots.
+ *
+ * Grow the store, already prepared strings are kept.
+ * Should not be called while a filter pass is running.
+ */
+void rofi_match_store_resize ( RofiMatchStore *store, unsigned int num_slots );
+
+/**
+ * @param store The store.
+ * @param slot The slot to get.
+ *
+ * @returns the prepared string in slot, NULL if it is not prepared (yet).
+ */
+const RofiMatchString *rofi_match_store_peek ( RofiMatchStore *store, unsigned int slot );
+
+/**
+ * @param store The store.
+ * @param slot The slot to get.
+ * @param text The text for the slot, used when the slot is not prepared yet.
+ * @param len The length of text in bytes, or -1 if nul terminated.
+ *
+ * Get the prepared string in slot, preparing it from text on first use.
+ * This is thread safe, different threads can get (the same) slots at the same time.
+ *
+ * @returns the prepared string in slot, NULL if slot is out of range or the memory limit is reached.
+ */
+const RofiMatchString *rofi_match_store_get ( RofiMatchStore *store, unsigned int slot, const char *text, gssize len );
+
+/** @} */
+#endif // ROFI_MATCH_STORE_H
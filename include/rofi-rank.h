@@ -0,0 +1,85 @@
+#ifndef ROFI_RANK_H
+#define ROFI_RANK_H
+
+#include <glib.h>
+
+/**
+ * @defgroup RANK Rank
+ * @ingroup HELPERS
+ *
+ * Lazy ranking of the filtered rows on their distance.
+ *
+ * Only the first rows of the line_map are sorted, the rest is kept in a min-heap and moved into the line_map
+ * when they are requested. The order is identical to a stable sort on distance, ties keep the (unfiltered) index order.
+ * @{
+ */
+
+/**
+ * State of the lazy ranking of a line_map.
+ */
+typedef struct
+{
+    /** Min-heap with the (distance, index) keys of the rows not ranked yet. */
+    guint64      *keys;
+    /** Allocated size of keys. */
+    unsigned int keys_size;
+    /** Number of keys in the heap. */
+    unsigned int heap_size;
+    /** Number of rows at the start of the line_map that are ranked. */
+    unsigned int sorted;
+} RofiRank;
+
+/**
+ * @param rank The ranking.
+ * @param line_map The (unfiltered) indexes of the filtered rows.
+ * @param distance The distance of each (unfiltered) row.
+ * @param num The number of rows in line_map.
+ *
+ * Rank the rows in the line_map on their distance. Only the first rows are sorted,
+ * the rest is kept in a heap and sorted when they are requested.
+ */
+void rofi_rank_init ( RofiRank *rank, unsigned int *line_map, const int *distance, unsigned int num );
+
+/**
+ * @param rank The ranking.
+ * @param num The number of rows in the line_map.
+ *
+ * Mark the line_map as fully ranked, e.g. because it is not sorted.
+ */
+void rofi_rank_clear ( RofiRank *rank, unsigned int num );
+
+/**
+ * @param rank The ranking.
+ * @param line_map The (unfiltered) indexes of the filtered rows.
+ * @param distance The distance of each (unfiltered) row.
+ * @param num The number of rows in the line_map, including the new rows.
+ * @param rows The matching rows to add, their distance is set.
+ * @param n The number of rows.
+ *
+ * Merge rows into the ranking. The ranked rows that come after the best new row go back into the heap,
+ * with the new rows, and are ranked again when they are requested.
+ */
+void rofi_rank_append ( RofiRank *rank, unsigned int *line_map, const int *distance, unsigned int num, const unsigned int *rows, unsigned int n );
+
+/**
+ * @param rank The ranking.
+ * @param line_map The (unfiltered) indexes of the filtered rows.
+ * @param num The number of rows in the line_map.
+ * @param position The position in the filtered list.
+ *
+ * Get the row at position, ranking more rows when needed. Rows are ranked in batches that grow
+ * geometrically.
+ *
+ * @returns the (unfiltered) index of the row at position.
+ */
+unsigned int rofi_rank_line_map ( RofiRank *rank, unsigned int *line_map, unsigned int num, unsigned int position );
+
+/**
+ * @param rank The ranking.
+ *
+ * Free the keys of the ranking.
+ */
+void rofi_rank_free ( RofiRank *rank );
+
+/** @} */
+#endif // ROFI_RANK_H
@@ -0,0 +1,77 @@
+#ifndef ROFI_TRIGRAM_INDEX_H
+#define ROFI_TRIGRAM_INDEX_H
+
+#include <glib.h>
+#include "mode.h"
+
+/**
+ * @defgroup TRIGRAMINDEX TrigramIndex
+ * @ingroup HELPERS
+ *
+ * Inverted index of the (case folded) trigrams in the entries of a long, static, list.
+ *
+ * A plain token can only match an entry that contains all the trigrams of the token, so intersecting
+ * the lists of entries per trigram gives a (small) set of candidates. Only those have to be matched
+ * with mode_token_match(), that decides the actual result.
+ *
+ * The entries are split in shards of consecutive rows, each shard is built by its own worker.
+ * The rows in each list are stored as variable length encoded deltas.
+ * @{
+ */
+
+/** Maximum memory (in bytes) used by a single index. When hit, building the index is abandoned. */
+#define ROFI_TRIGRAM_INDEX_MAX_SIZE    ( 256 * 1024 * 1024 )
+
+/**
+ * Opaque trigram index.
+ */
+typedef struct _RofiTrigramIndex RofiTrigramIndex;
+
+/**
+ * @param sw The mode to index, it should provide mode_get_match_text().
+ * @param num_rows The number of rows to index.
+ * @param num_shards The number of shards (and workers) to build the index with.
+ *
+ * Create a new index and start building it on the thread pool, or build it right away if there is no thread pool.
+ * The rows of the mode should not change until the index is freed.
+ *
+ * @returns a newly allocated index, free with rofi_trigram_index_free.
+ */
+RofiTrigramIndex *rofi_trigram_index_new ( const Mode *sw, unsigned int num_rows, unsigned int num_shards );
+
+/**
+ * @param index The index to free, can be NULL.
+ *
+ * Stop building the index, if it is still being built, and free it.
+ */
+void rofi_trigram_index_free ( RofiTrigramIndex *index );
+
+/**
+ * @param index The index.
+ *
+ * @returns TRUE if the index is completely built and can be queried.
+ */
+gboolean rofi_trigram_index_ready ( RofiTrigramIndex *index );
+
+/**
+ * @param index The index.
+ *
+ * @returns the memory used by the index in bytes.
+ */
+size_t rofi_trigram_index_get_size ( RofiTrigramIndex *index );
+
+/**
+ * @param index The (ready) index.
+ * @param tokens The tokens to get the candidates for.
+ * @param num_rows The current number of rows, rows beyond the indexed rows are always candidates.
+ * @param rows Filled with the candidates in ascending order, should hold num_rows rows.
+ *
+ * Get the rows that can match tokens. Only plain, not inverted, tokens of at least 3 characters narrow down
+ * the candidates, the other tokens are ignored.
+ *
+ * @returns the number of candidates, or -1 if no token can use the index and all rows are candidates.
+ */
+int rofi_trigram_index_query ( RofiTrigramIndex *index, rofi_int_matcher **tokens, unsigned int num_rows, unsigned int *rows );
+
+/** @} */
+#endif // ROFI_TRIGRAM_INDEX_H
@@ -259,13 +259,51 @@ typedef struct rofi_range_pair
     int stop;
 } rofi_range_pair;
 
+/** In the pattern of a glob token: matches any sequence of characters, except a newline. */
+#define ROFI_GLOB_ANY    ( (gunichar) -1 )
+/** In the pattern of a glob token: matches a single character that is not white space. */
+#define ROFI_GLOB_ONE    ( (gunichar) -2 )
+
 /**
  * Internal structure for matching.
  */
 typedef struct rofi_int_matcher_t
 {
-    GRegex   *regex;
+    /**
+     * The compiled regex, NULL for fuzzy and glob tokens. For plain tokens it is only compiled on first use,
+     * so get it with helper_token_get_regex(). Not named regex, so code that reads it directly fails to build
+     * instead of matching with NULL.
+     */
+    GRegex   *lazy_regex;
     gboolean invert;
+    /** The (unescaped) token when it is matched as plain substring, NULL otherwise. */
+    char     *literal;
+    /** Length of literal in bytes. */
+    size_t   literal_len;
+    /** If the token is matched case sensitive. */
+    gboolean case_sensitive;
+    /** If the token is matched without diacritics (normalize-match), it is then also case insensitive. */
+    gboolean normalize;
+    /** The characters of a fuzzy or glob token (NFC normalized and case folded if not case sensitive), NULL otherwise. */
+    gunichar *pattern;
+    /** Number of characters in pattern. */
+    glong    pattern_len;
+    /** If pattern is a glob, with ROFI_GLOB_ANY and ROFI_GLOB_ONE as wildcards. Otherwise it matches as a subsequence (fuzzy). */
+    gboolean glob;
+    /** If literal only contains ASCII characters. */
+    gboolean literal_ascii;
+    /** The NFC normalized, case folded, literal for case insensitive matching, NULL otherwise. */
+    char     *folded;
+    /** Length of folded in bytes. */
+    size_t   folded_len;
+    /** Bloom of the characters the folded text of a matching row contains, see rofi_match_bloom(). 0 if not known. */
+    guint64  bloom;
+    /** Estimated cost of matching the token against a row, relative to a plain ASCII token. */
+    double   cost;
+    /** Fraction of the rows the token (including invert) matches, estimated from its text. Set once, the token is shared. */
+    double   hit_rate;
+    /** Number of references, the token is shared between token lists by helper_tokenize(). */
+    int      refcount;
 } rofi_int_matcher;
 
 /**
@@ -197,6 +197,11 @@ typedef struct
     gboolean       drun_use_desktop_cache;
     gboolean       drun_reload_desktop_cache;
 
+    /** Index long lists to speed up matching. */
+    gboolean       trigram_index;
+    /** Match without diacritics, e.g. 'e' matches 'é'. */
+    gboolean       normalize_match;
+
     /** Benchmark */
     gboolean       benchmark_ui;
 } Settings;
@@ -36,12 +36,19 @@
 #include "keyb.h"
 #include "xcb.h"
 #include "theme.h"
+#include "settings.h"
+#include "rofi-match-store.h"
+#include "rofi-trigram-index.h"
+#include "rofi-rank.h"
 
 /**
  * @ingroup ViewHandle
  *
  * @{
  */
+/** A filter pass over the rows of a view. */
+typedef struct _RofiFilterJob   RofiFilterJob;
+
 // State of the menu.
 
 struct RofiViewState
@@ -73,8 +80,12 @@ struct RofiViewState
     int              *distance;
     /** Array with the translation between the filtered and unfiltered list. */
     unsigned int     *line_map;
+    /** Prepared completion strings used for sorting, one slot per element. */
+    RofiMatchStore   *sort_store;
     /** number of (unfiltered) elements to show. */
     unsigned int     num_lines;
+    /** Allocated size of line_map and distance, they grow geometric when rows are appended. */
+    unsigned int     lines_size;
 
     /** number of (filtered) elements to show. */
     unsigned int     filtered_lines;
@@ -113,6 +124,8 @@ struct RofiViewState
     int              mouse_seen;
     /** Flag indicating if view needs to be reloaded. */
     int              reload;
+    /** Flag indicating rows were appended, only those need to be filtered. */
+    int              append;
     /** The function to be called when finalizing this view */
     void             ( *finalize )( struct RofiViewState *state );
 
@@ -138,6 +151,55 @@ struct RofiViewState
 
     /** Regexs used for matching */
     rofi_int_matcher **tokens;
+
+    /** The previous filter pass, used to narrow down the next one. */
+    struct
+    {
+        /** User input the pass was run with. */
+        char           *input;
+        /** Preprocessed pattern the pass was run with. */
+        char           *pattern;
+        /** Matching method used. */
+        MatchingMethod method;
+        /** Case sensitivity used. */
+        unsigned int   case_sensitive;
+        /** Tokenize setting used. */
+        unsigned int   tokenize;
+        /** If the resulting line_map was sorted. */
+        unsigned int   sorted;
+        /** Number of (unfiltered) elements the pass ran over. */
+        unsigned int   num_lines;
+    }                last_filter;
+
+    /** Cache of previous filter results, most recently used first. */
+    GQueue           filter_cache;
+    /** Memory used by the entries in filter_cache. */
+    size_t           filter_cache_size;
+    /** Number of filter_cache hits. */
+    unsigned int     filter_cache_hits;
+    /** Number of filter_cache misses. */
+    unsigned int     filter_cache_misses;
+
+    /** Lazy ranking of the filtered rows, only the part of the line_map that is looked at gets sorted. */
+    RofiRank         rank;
+
+    /** The filter pass running in the background, NULL if none. */
+    RofiFilterJob    *filter_job;
+    /** Incremented for every filter pass, a pass running in the background is only shown if it is still current. */
+    guint            filter_generation;
+    /** Index of the rows, built in the background for long lists, NULL if none. */
+    RofiTrigramIndex *trigram_index;
+
+    /** Match spans of the drawn rows, so redrawing them does not match them again. */
+    struct
+    {
+        /** The spans per (unfiltered) row index, created on first use. */
+        GHashTable *rows;
+        /** Incremented when the tokens change, spans of an older generation are stale. */
+        guint      generation;
+        /** Incremented for every row drawn, rows with the oldest stamps are off screen. */
+        guint      stamp;
+    }                highlight;
 };
 /** @} */
 #endif
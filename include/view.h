@@ -235,6 +235,24 @@ void rofi_view_hide ( void );
  */
 void rofi_view_reload ( void  );
 
+/**
+ * Indicate rows were appended to the current view, the rows it already has did not change.
+ * Only the new rows are filtered and merged into the result.
+ *
+ * The reloading happens 'lazy', multiple calls might be handled at once.
+ * When rofi_view_reload() is called as well, the view is reloaded completely.
+ */
+void rofi_view_reload_append ( void );
+
+/**
+ * @param state The handle to the view, can be NULL.
+ *
+ * Stop the filter pass running in the background for the view, and wait till it stopped. The index of the rows is dropped.
+ * This has to be called before a mode changes (e.g. moves) rows it already handed to the view,
+ * the rows are filtered again afterwards.
+ */
+void rofi_view_filter_sync ( RofiViewState *state );
+
 /**
  * @param state The handle to the view
  * @param mode The new mode to display
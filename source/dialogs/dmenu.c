@@ -41,6 +41,8 @@
 #include <gio/gunixinputstream.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <signal.h>
 #include <fcntl.h>
 #include "rofi.h"
 #include "settings.h"
@@ -50,6 +52,7 @@
 #include "xrmoptions.h"
 #include "view.h"
 #include "rofi-icon-fetcher.h"
+#include "timings.h"
 
 #include "dialogs/dmenuscriptshared.h"
 
@@ -57,6 +60,22 @@ static int dmenu_mode_init ( Mode *sw );
 static int dmenu_token_match ( const Mode *sw, rofi_int_matcher **tokens, unsigned int index );
 static cairo_surface_t *dmenu_get_icon ( const Mode *sw, unsigned int selected_line, int height );
 static char *dmenu_get_message ( const Mode *sw );
+static char *dmenu_get_match_text ( const Mode *sw, unsigned int index );
+
+/** Size of the blocks the input is read in. */
+#define DMENU_READ_BLOCK_SIZE    ( 256 * 1024 )
+/**
+ * Size of a string arena, a longer row gets an arena of its own.
+ * The pages of an arena only become resident when written, so the unused tail of the last arena costs no memory.
+ * Smaller arenas save no memory and are slightly slower to fill.
+ */
+#define DMENU_ARENA_SIZE         ( 4 * 1024 * 1024 )
+/** Minimum size of the chunks a mapped input is indexed in, smaller inputs use less workers. */
+#define DMENU_MAP_MIN_CHUNK      ( 4 * 1024 * 1024 )
+/** Maximum size of the chunks a mapped input is indexed in, the rows store 32-bit offsets in their chunk. */
+#define DMENU_MAP_MAX_CHUNK      ( 1024 * 1024 * 1024 )
+/** Arena of a plain row whose entry has invalid markup, it never matches. */
+#define DMENU_ARENA_NONE         G_MAXUINT32
 
 static inline unsigned int bitget ( uint32_t *array, unsigned int index )
 {
@@ -72,6 +91,19 @@ static inline void bittoggle ( uint32_t *array, unsigned int index )
     *v ^= 1 << bit;
 }
 
+/**
+ * A row, its (nul terminated) text is stored in one of the arenas.
+ */
+typedef struct
+{
+    /** The arena the text is stored in. */
+    uint32_t arena;
+    /** Offset of the text in the arena. */
+    uint32_t offset;
+    /** Length of the text in bytes. */
+    uint32_t length;
+} DmenuRow;
+
 typedef struct
 {
     /** Settings */
@@ -89,9 +121,26 @@ typedef struct
     unsigned int           num_selected_list;
     unsigned int           do_markup;
     // List with entries.
-    DmenuScriptEntry       *cmd_list;
+    DmenuRow               *cmd_list;
     unsigned int           cmd_list_real_length;
     unsigned int           cmd_list_length;
+    // With markup, the entries without the markup that are matched on, only allocated with -markup-rows.
+    DmenuRow               *plain;
+    // Icon, meta and nonselectable per entry, only allocated once an entry has one.
+    DmenuScriptEntry       *extras;
+    // Append only arenas the text of the entries is stored in.
+    char                   **arenas;
+    unsigned int           num_arenas;
+    unsigned int           arenas_real_length;
+    gsize                  arena_size;
+    gsize                  arena_used;
+    // The mapped input, when it is a regular file. The arenas then point into it.
+    char                   *map;
+    gsize                  map_size;
+    // Bit per entry of a mapped input, set if its text is invalid UTF-8. NULL if all rows are valid.
+    uint32_t               *map_invalid;
+    // Prepared match strings, two (entry and meta) per entry.
+    RofiMatchStore         *match_store;
     unsigned int           only_selected;
     unsigned int           selected_count;
 
@@ -102,7 +151,10 @@ typedef struct
     GCancellable           *cancel;
     gulong                 cancel_source;
     GInputStream           *input_stream;
-    GDataInputStream       *data_input_stream;
+    // Buffer the input is read in, it keeps the incomplete last row between reads.
+    char                   *read_buf;
+    gsize                  read_buf_size;
+    gsize                  read_len;
 } DmenuModePrivateData;
 
 static void async_close_callback ( GObject *source_object, GAsyncResult *res, G_GNUC_UNUSED gpointer user_data )
@@ -111,69 +163,315 @@ static void async_close_callback ( GObject *source_object, GAsyncResult *res, G_
     g_debug ( "Closing data stream." );
 }
 
+/**
+ * @param pd The dmenu mode.
+ * @param row The row to store the text for.
+ * @param size The size of the text, including the terminator.
+ *
+ * Reserve room for the text of row in the last arena, or in a new arena when it does not fit.
+ *
+ * @returns the location to copy the text to.
+ */
+static char *dmenu_arena_alloc ( DmenuModePrivateData *pd, DmenuRow *row, gsize size )
+{
+    if ( pd->num_arenas == 0 || ( pd->arena_used + size ) > pd->arena_size ) {
+        if ( pd->num_arenas == pd->arenas_real_length ) {
+            // The arenas move, they can not be filtered at the same time.
+            rofi_view_filter_sync ( rofi_view_get_active () );
+            pd->arenas_real_length = MAX ( pd->arenas_real_length * 2, 16 );
+            pd->arenas             = g_renew ( char *, pd->arenas, pd->arenas_real_length );
+        }
+        pd->arena_size             = MAX ( size, DMENU_ARENA_SIZE );
+        pd->arenas[pd->num_arenas] = g_malloc ( pd->arena_size );
+        pd->num_arenas++;
+        pd->arena_used = 0;
+    }
+    row->arena      = pd->num_arenas - 1;
+    row->offset     = pd->arena_used;
+    pd->arena_used += size;
+    return pd->arenas[row->arena] + row->offset;
+}
+
+/**
+ * @param pd The dmenu mode.
+ * @param index The entry.
+ *
+ * The text is only nul terminated when the input is not mapped, its length is in the row.
+ *
+ * @returns the text of entry index.
+ */
+static inline char *dmenu_get_entry ( const DmenuModePrivateData *pd, unsigned int index )
+{
+    return pd->arenas[pd->cmd_list[index].arena] + pd->cmd_list[index].offset;
+}
+
+/**
+ * @param pd The dmenu mode.
+ * @param index The entry.
+ *
+ * Rows read from a stream are fixed up while reading, rows in a mapped input are checked while indexing.
+ *
+ * @returns TRUE if the text of entry index is valid UTF-8.
+ */
+static inline gboolean dmenu_entry_is_valid ( const DmenuModePrivateData *pd, unsigned int index )
+{
+    return pd->map_invalid == NULL || !bitget ( pd->map_invalid, index );
+}
+
+/**
+ * @param pd The dmenu mode.
+ * @param index The entry.
+ *
+ * @returns a newly allocated, nul terminated and valid UTF-8, copy of the text of entry index.
+ */
+static char *dmenu_dup_entry ( DmenuModePrivateData *pd, unsigned int index )
+{
+    char *str = g_strndup ( dmenu_get_entry ( pd, index ), pd->cmd_list[index].length );
+    if ( !dmenu_entry_is_valid ( pd, index ) ) {
+        char *utfstr = rofi_force_utf8 ( str, pd->cmd_list[index].length );
+        g_free ( str );
+        str = utfstr;
+    }
+    return str;
+}
+
+/**
+ * @param pd The dmenu mode.
+ * @param index The entry.
+ *
+ * @returns the icon, meta and nonselectable of entry index, NULL if no entry has any.
+ */
+static inline DmenuScriptEntry *dmenu_get_extras ( const DmenuModePrivateData *pd, unsigned int index )
+{
+    return pd->extras != NULL ? &( pd->extras[index] ) : NULL;
+}
+
+/**
+ * @param pd The dmenu mode.
+ * @param index The entry.
+ *
+ * @returns TRUE if entry index can not be selected.
+ */
+static inline gboolean dmenu_is_nonselectable ( const DmenuModePrivateData *pd, unsigned int index )
+{
+    DmenuScriptEntry *extras = dmenu_get_extras ( pd, index );
+    return extras != NULL && extras->nonselectable;
+}
+
+/**
+ * @param pd The dmenu mode.
+ * @param index The entry.
+ * @param buffer The extras after the text of the entry.
+ * @param length The length of buffer.
+ *
+ * Parse the extras of entry index, the side table is allocated when the first entry has any.
+ */
+static void dmenu_add_extras ( DmenuModePrivateData *pd, unsigned int index, char *buffer, size_t length )
+{
+    DmenuScriptEntry extras = { NULL, NULL, 0, NULL, FALSE };
+    dmenuscript_parse_entry_extras ( NULL, &extras, buffer, length );
+    if ( extras.icon_name != NULL || extras.meta != NULL || extras.nonselectable ) {
+        if ( pd->extras == NULL ) {
+            rofi_view_filter_sync ( rofi_view_get_active () );
+            pd->extras = g_malloc0_n ( pd->cmd_list_real_length, sizeof ( DmenuScriptEntry ) );
+        }
+        pd->extras[index] = extras;
+    }
+}
+
+/**
+ * @param pd The dmenu mode.
+ * @param index The entry, its text should be stored already.
+ *
+ * Strip the markup from entry index once, so matching does not have to parse it for every row on every key press.
+ * Entries without markup share their text with the plain row.
+ * Highlighting works on the text of the rendered layout, that has the markup stripped already, so no mapping
+ * back to the positions in the markup is needed.
+ */
+static void dmenu_add_plain ( DmenuModePrivateData *pd, unsigned int index )
+{
+    const char *entry = dmenu_get_entry ( pd, index );
+    gsize      length = pd->cmd_list[index].length;
+    DmenuRow   *plain = &( pd->plain[index] );
+    char       *esc   = NULL;
+    if ( memchr ( entry, '<', length ) == NULL && memchr ( entry, '&', length ) == NULL ) {
+        *plain = pd->cmd_list[index];
+    }
+    else if ( pango_parse_markup ( entry, length, 0, NULL, &esc, NULL, NULL ) ) {
+        plain->length = strlen ( esc );
+        memcpy ( dmenu_arena_alloc ( pd, plain, plain->length + 1 ), esc, plain->length + 1 );
+        g_free ( esc );
+    }
+    else {
+        plain->arena  = DMENU_ARENA_NONE;
+        plain->offset = 0;
+        plain->length = 0;
+    }
+}
+
+/**
+ * @param pd The dmenu mode.
+ * @param index The entry.
+ * @param length Set to the length of the returned text in bytes.
+ *
+ * With markup, the text without the markup, otherwise the text of the entry.
+ * The text is only nul terminated when the input is not mapped.
+ *
+ * @returns the text to match entry index on, NULL if its markup is invalid.
+ */
+static const char *dmenu_get_match_entry ( DmenuModePrivateData *pd, unsigned int index, size_t *length )
+{
+    if ( pd->plain == NULL ) {
+        *length = pd->cmd_list[index].length;
+        return dmenu_get_entry ( pd, index );
+    }
+    const DmenuRow *plain = &( pd->plain[index] );
+    if ( plain->arena == DMENU_ARENA_NONE ) {
+        return NULL;
+    }
+    *length = plain->length;
+    return pd->arenas[plain->arena] + plain->offset;
+}
+
 static void read_add ( DmenuModePrivateData * pd, char *data, gsize len )
 {
     gsize data_len = len;
-    if ( ( pd->cmd_list_length + 2 ) > pd->cmd_list_real_length ) {
+    if ( ( pd->cmd_list_length + 1 ) > pd->cmd_list_real_length ) {
+        // The rows move, they can not be filtered at the same time.
+        rofi_view_filter_sync ( rofi_view_get_active () );
+        unsigned int old_length = pd->cmd_list_real_length;
         pd->cmd_list_real_length = MAX ( pd->cmd_list_real_length * 2, 512 );
-        pd->cmd_list             = g_realloc ( pd->cmd_list, ( pd->cmd_list_real_length ) * sizeof ( DmenuScriptEntry ) );
+        pd->cmd_list             = g_renew ( DmenuRow, pd->cmd_list, pd->cmd_list_real_length );
+        if ( pd->do_markup ) {
+            pd->plain = g_renew ( DmenuRow, pd->plain, pd->cmd_list_real_length );
+        }
+        if ( pd->extras != NULL ) {
+            pd->extras = g_renew ( DmenuScriptEntry, pd->extras, pd->cmd_list_real_length );
+            memset ( pd->extras + old_length, 0, ( pd->cmd_list_real_length - old_length ) * sizeof ( DmenuScriptEntry ) );
+        }
+        rofi_match_store_resize ( pd->match_store, pd->cmd_list_real_length * 2 );
     }
-    // Init.
-    pd->cmd_list[pd->cmd_list_length].icon_fetch_uid = 0;
-    pd->cmd_list[pd->cmd_list_length].icon_name      = NULL;
-    pd->cmd_list[pd->cmd_list_length].meta           = NULL;
     char *end = strchr ( data, '\0' );
-    if ( end != NULL ) {
-        data_len = end - data;
-        dmenuscript_parse_entry_extras ( NULL, &( pd->cmd_list[pd->cmd_list_length] ), end + 1, len - data_len );
+    data_len = end - data;
+    if ( data_len < len ) {
+        dmenu_add_extras ( pd, pd->cmd_list_length, end + 1, len - data_len );
+    }
+    DmenuRow *row = &( pd->cmd_list[pd->cmd_list_length] );
+    if ( g_utf8_validate ( data, data_len, NULL ) ) {
+        memcpy ( dmenu_arena_alloc ( pd, row, data_len + 1 ), data, data_len + 1 );
+    }
+    else {
+        char *utfstr = rofi_force_utf8 ( data, data_len );
+        data_len = strlen ( utfstr );
+        memcpy ( dmenu_arena_alloc ( pd, row, data_len + 1 ), utfstr, data_len + 1 );
+        g_free ( utfstr );
+    }
+    row->length = data_len;
+    if ( pd->do_markup ) {
+        dmenu_add_plain ( pd, pd->cmd_list_length );
     }
-    char *utfstr = rofi_force_utf8 ( data, data_len );
-    pd->cmd_list[pd->cmd_list_length].entry     = utfstr;
-    pd->cmd_list[pd->cmd_list_length + 1].entry = NULL;
 
     pd->cmd_list_length++;
 }
+/**
+ * @param pd The dmenu mode.
+ * @param eof If the end of the input is reached, the last row is then complete as well.
+ *
+ * Add the complete rows in the read buffer, the incomplete last row is kept for the next read.
+ *
+ * @returns the number of rows added.
+ */
+static unsigned int dmenu_read_split ( DmenuModePrivateData *pd, gboolean eof )
+{
+    unsigned int n    = 0;
+    char         *row = pd->read_buf;
+    char         *end = pd->read_buf + pd->read_len;
+    char         *sep = NULL;
+    while ( ( sep = memchr ( row, pd->separator, end - row ) ) != NULL ) {
+        *sep = '\0';
+        read_add ( pd, row, sep - row );
+        row = sep + 1;
+        n++;
+    }
+    if ( eof && row < end ) {
+        // There is always room for the terminator.
+        *end = '\0';
+        read_add ( pd, row, end - row );
+        row = end;
+        n++;
+    }
+    pd->read_len = end - row;
+    memmove ( pd->read_buf, row, pd->read_len );
+    return n;
+}
+
+/**
+ * @param pd The dmenu mode.
+ *
+ * Make room in the read buffer for the next block, one byte is kept free to terminate the last row.
+ *
+ * @returns the number of bytes to read.
+ */
+static gsize dmenu_read_reserve ( DmenuModePrivateData *pd )
+{
+    if ( pd->read_buf == NULL ) {
+        pd->read_buf_size = DMENU_READ_BLOCK_SIZE;
+        pd->read_buf      = g_malloc ( pd->read_buf_size );
+    }
+    else if ( ( pd->read_len + 1 ) == pd->read_buf_size ) {
+        // A single row that does not fit.
+        pd->read_buf_size *= 2;
+        pd->read_buf       = g_realloc ( pd->read_buf, pd->read_buf_size );
+    }
+    return pd->read_buf_size - pd->read_len - 1;
+}
+
+/**
+ * @param pd The dmenu mode.
+ *
+ * Done reading, close the input.
+ */
+static void dmenu_read_done ( DmenuModePrivateData *pd )
+{
+    g_free ( pd->read_buf );
+    pd->read_buf      = NULL;
+    pd->read_buf_size = 0;
+    pd->read_len      = 0;
+    g_input_stream_close_async ( pd->input_stream, G_PRIORITY_LOW, pd->cancel, async_close_callback, pd );
+}
+
 static void async_read_callback ( GObject *source_object, GAsyncResult *res, gpointer user_data )
 {
-    GDataInputStream     *stream = (GDataInputStream *) source_object;
-    DmenuModePrivateData *pd     = (DmenuModePrivateData *) user_data;
-    gsize                len;
-    char                 *data = g_data_input_stream_read_upto_finish ( stream, res, &len, NULL );
-    if ( data != NULL ) {
-        // Absorb separator, already in buffer so should not block.
-        g_data_input_stream_read_byte ( stream, NULL, NULL );
-        read_add ( pd, data, len );
-        g_free ( data );
-        rofi_view_reload ();
-
-        g_data_input_stream_read_upto_async ( pd->data_input_stream, &( pd->separator ), 1, G_PRIORITY_LOW, pd->cancel,
-                                              async_read_callback, pd );
+    GError *error = NULL;
+    gssize n      = g_input_stream_read_finish ( G_INPUT_STREAM ( source_object ), res, &error );
+    if ( g_error_matches ( error, G_IO_ERROR, G_IO_ERROR_CANCELLED ) ) {
+        // The mode is destroyed, do not touch it.
+        g_error_free ( error );
         return;
     }
-    else {
-        GError *error = NULL;
-        // Absorb separator, already in buffer so should not block.
-        // If error == NULL end of stream..
-        g_data_input_stream_read_byte ( stream, NULL, &error );
-        if (  error == NULL ) {
-            // Add empty line.
-            read_add ( pd, "", 0 );
-            rofi_view_reload ();
-
-            g_data_input_stream_read_upto_async ( pd->data_input_stream, &( pd->separator ), 1, G_PRIORITY_LOW, pd->cancel,
-                                                  async_read_callback, pd );
-            return;
-        }
-        else {
-            g_error_free ( error );
+    DmenuModePrivateData *pd = (DmenuModePrivateData *) user_data;
+    if ( n > 0 ) {
+        pd->read_len += n;
+        // One reload per block, the view coalesces them further and only filters the new rows.
+        if ( dmenu_read_split ( pd, FALSE ) > 0 ) {
+            rofi_view_reload_append ();
         }
+        gsize size = dmenu_read_reserve ( pd );
+        g_input_stream_read_async ( pd->input_stream, pd->read_buf + pd->read_len, size, G_PRIORITY_LOW, pd->cancel,
+                                    async_read_callback, pd );
+        return;
+    }
+    if ( error != NULL ) {
+        g_warning ( "Failed to read input: %s", error->message );
+        g_error_free ( error );
     }
-    if ( !g_cancellable_is_cancelled ( pd->cancel ) ) {
-        // Hack, don't use get active.
-        g_debug ( "Clearing overlay" );
-        rofi_view_set_overlay ( rofi_view_get_active (), NULL );
-        g_input_stream_close_async ( G_INPUT_STREAM ( stream ), G_PRIORITY_LOW, pd->cancel, async_close_callback, pd );
+    if ( dmenu_read_split ( pd, TRUE ) > 0 ) {
+        rofi_view_reload_append ();
     }
+    // Hack, don't use get active.
+    g_debug ( "Clearing overlay" );
+    rofi_view_set_overlay ( rofi_view_get_active (), NULL );
+    dmenu_read_done ( pd );
 }
 
 static void async_read_cancel ( G_GNUC_UNUSED GCancellable *cancel, G_GNUC_UNUSED gpointer data )
@@ -181,38 +479,363 @@ static void async_read_cancel ( G_GNUC_UNUSED GCancellable *cancel, G_GNUC_UNUSE
     g_debug ( "Cancelled the async read." );
 }
 
-static int get_dmenu_async ( DmenuModePrivateData *pd, int sync_pre_read )
+/**
+ * @param pd The dmenu mode.
+ *
+ * Read a block from the input, blocking, and add the complete rows in it.
+ *
+ * @returns FALSE when the end of the input is reached, all rows are then added.
+ */
+static gboolean dmenu_read_block ( DmenuModePrivateData *pd )
 {
-    while ( sync_pre_read-- ) {
-        gsize len   = 0;
-        char  *data = g_data_input_stream_read_upto ( pd->data_input_stream, &( pd->separator ), 1, &len, NULL, NULL );
-        if ( data == NULL ) {
-            g_input_stream_close_async ( G_INPUT_STREAM ( pd->input_stream ), G_PRIORITY_LOW, pd->cancel, async_close_callback, pd );
+    GError *error = NULL;
+    gsize  size   = dmenu_read_reserve ( pd );
+    gssize n      = g_input_stream_read ( pd->input_stream, pd->read_buf + pd->read_len, size, NULL, &error );
+    if ( n <= 0 ) {
+        if ( error != NULL ) {
+            g_warning ( "Failed to read input: %s", error->message );
+            g_error_free ( error );
+        }
+        dmenu_read_split ( pd, TRUE );
+        return FALSE;
+    }
+    pd->read_len += n;
+    dmenu_read_split ( pd, FALSE );
+    return TRUE;
+}
+
+static int get_dmenu_async ( DmenuModePrivateData *pd, unsigned int sync_pre_read )
+{
+    while ( pd->cmd_list_length < sync_pre_read ) {
+        if ( !dmenu_read_block ( pd ) ) {
+            dmenu_read_done ( pd );
             return FALSE;
         }
-        g_data_input_stream_read_byte ( pd->data_input_stream, NULL, NULL );
-        read_add ( pd, data, len );
-        g_free ( data );
     }
-    g_data_input_stream_read_upto_async ( pd->data_input_stream, &( pd->separator ), 1, G_PRIORITY_LOW, pd->cancel,
-                                          async_read_callback, pd );
+    gsize size = dmenu_read_reserve ( pd );
+    g_input_stream_read_async ( pd->input_stream, pd->read_buf + pd->read_len, size, G_PRIORITY_LOW, pd->cancel,
+                                async_read_callback, pd );
     return TRUE;
 }
 static void get_dmenu_sync ( DmenuModePrivateData *pd )
 {
-    while  ( TRUE ) {
-        gsize len   = 0;
-        char  *data = g_data_input_stream_read_upto ( pd->data_input_stream, &( pd->separator ), 1, &len, NULL, NULL );
-        if ( data == NULL ) {
-            break;
+    while ( dmenu_read_block ( pd ) ) {
+        ;
+    }
+    dmenu_read_done ( pd );
+}
+
+/**
+ * Thread state for workers indexing a chunk of a mapped input.
+ */
+typedef struct
+{
+    /** Generic thread state. */
+    thread_state st;
+
+    /** Condition. */
+    GCond        *cond;
+    /** Lock for condition. */
+    GMutex       *mutex;
+    /** Count that is protected by lock. */
+    unsigned int *acount;
+
+    /** The separator of the rows. */
+    char         separator;
+    /** The chunk, it starts at a row. */
+    const char   *start;
+    /** Length of the chunk in bytes. */
+    gsize        len;
+    /** The arena the rows in this chunk refer to. */
+    unsigned int arena;
+    /** The rows in the chunk. */
+    DmenuRow     *rows;
+    /** Number of rows. */
+    unsigned int num_rows;
+    /** Rows with extras, pairs of the row and its length including the extras. NULL if there are none. */
+    GArray       *extras;
+    /** Rows with invalid UTF-8. NULL if there are none. */
+    GArray       *invalid;
+} DmenuIndexChunk;
+
+/**
+ * @param ts The DmenuIndexChunk.
+ * @param user_data Unused.
+ *
+ * Find the rows in a chunk of the mapped input. Only the offsets are stored, the text is not copied.
+ * The text is checked to be valid UTF-8 here, so the rows are only read (and not written) after indexing.
+ */
+static void dmenu_index_chunk ( thread_state *ts, G_GNUC_UNUSED gpointer user_data )
+{
+    DmenuIndexChunk *t    = (DmenuIndexChunk *) ts;
+    unsigned int    size  = 0;
+    const char      *row  = t->start;
+    const char      *end  = t->start + t->len;
+    while ( row < end ) {
+        const char *sep = memchr ( row, t->separator, end - row );
+        gsize      len  = ( ( sep != NULL ) ? sep : end ) - row;
+        if ( t->num_rows == size ) {
+            size    = MAX ( size * 2, 1024 );
+            t->rows = g_renew ( DmenuRow, t->rows, size );
+        }
+        DmenuRow   *r  = &( t->rows[t->num_rows] );
+        const char *nul = memchr ( row, '\0', len );
+        r->arena  = t->arena;
+        r->offset = row - t->start;
+        r->length = len;
+        if ( nul != NULL ) {
+            // The text ends at the nul, the extras after it are parsed when all chunks are done.
+            unsigned int pair[2] = { t->num_rows, len };
+            if ( t->extras == NULL ) {
+                t->extras = g_array_new ( FALSE, FALSE, sizeof ( unsigned int ) );
+            }
+            g_array_append_vals ( t->extras, pair, 2 );
+            r->length = nul - row;
+        }
+        if ( !g_utf8_validate ( row, r->length, NULL ) ) {
+            if ( t->invalid == NULL ) {
+                t->invalid = g_array_new ( FALSE, FALSE, sizeof ( unsigned int ) );
+            }
+            g_array_append_val ( t->invalid, t->num_rows );
+        }
+        t->num_rows++;
+        row += len + 1;
+    }
+    if ( t->acount != NULL ) {
+        g_mutex_lock ( t->mutex );
+        ( *( t->acount ) )--;
+        g_cond_signal ( t->cond );
+        g_mutex_unlock ( t->mutex );
+    }
+}
+
+/** The mapped input, for the SIGBUS handler. */
+static char             *dmenu_map_start = NULL;
+/** Size of the mapped input. */
+static gsize            dmenu_map_size = 0;
+/** Page size, sysconf() can not be called from the signal handler. */
+static gsize            dmenu_map_page = 0;
+/** The SIGBUS action before the input was mapped. */
+static struct sigaction dmenu_map_old_sigbus;
+
+/**
+ * @param sig The signal.
+ * @param info Where the fault happened.
+ * @param context The context of the fault.
+ *
+ * Reading a page of the mapped input past the end of the file raises SIGBUS, this happens when the file is truncated
+ * while it is shown. The page it happened in, and all the pages after it, are then replaced by zero filled ones and
+ * the read is retried. Those pages are past the end of the file, so nothing that could still be read changes under the
+ * workers; the rows in them read as nul bytes and so as empty.
+ * Faults outside the mapping are passed on to the previous action.
+ */
+static void dmenu_map_sigbus ( int sig, siginfo_t *info, void *context )
+{
+    char *addr  = (char *) info->si_addr;
+    char *start = dmenu_map_start;
+    if ( start != NULL && addr >= start && addr < ( start + dmenu_map_size ) ) {
+        char *page = start + ( ( addr - start ) / dmenu_map_page ) * dmenu_map_page;
+        if ( mmap ( page, start + dmenu_map_size - page, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0 ) != MAP_FAILED ) {
+            return;
+        }
+    }
+    if ( dmenu_map_old_sigbus.sa_flags & SA_SIGINFO ) {
+        dmenu_map_old_sigbus.sa_sigaction ( sig, info, context );
+    }
+    else if ( dmenu_map_old_sigbus.sa_handler != SIG_DFL && dmenu_map_old_sigbus.sa_handler != SIG_IGN ) {
+        dmenu_map_old_sigbus.sa_handler ( sig );
+    }
+    else {
+        // Restore the default action, returning retries the read and it then terminates as it would have.
+        sigaction ( SIGBUS, &dmenu_map_old_sigbus, NULL );
+    }
+}
+
+/**
+ * @param map The mapped input.
+ * @param size Size of the mapping.
+ *
+ * Catch the faults on reading the mapping past the end of a truncated file, see dmenu_map_sigbus().
+ *
+ * @returns TRUE if the handler is installed.
+ */
+static gboolean dmenu_map_protect ( char *map, gsize size )
+{
+    struct sigaction sa;
+    memset ( &sa, 0, sizeof ( sa ) );
+    sa.sa_sigaction = dmenu_map_sigbus;
+    sa.sa_flags     = SA_SIGINFO | SA_NODEFER;
+    sigemptyset ( &( sa.sa_mask ) );
+    dmenu_map_page  = sysconf ( _SC_PAGESIZE );
+    dmenu_map_size  = size;
+    dmenu_map_start = map;
+    if ( sigaction ( SIGBUS, &sa, &dmenu_map_old_sigbus ) != 0 ) {
+        dmenu_map_start = NULL;
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/**
+ * @param map The mapped input.
+ * @param size Size of the mapping.
+ *
+ * Restore the SIGBUS action and unmap the input.
+ */
+static void dmenu_map_release ( char *map, gsize size )
+{
+    sigaction ( SIGBUS, &dmenu_map_old_sigbus, NULL );
+    dmenu_map_start = NULL;
+    munmap ( map, size );
+}
+
+/**
+ * @param pd The dmenu mode.
+ *
+ * If the input is a regular file, map it instead of reading it. The rows are found, and checked to be valid UTF-8,
+ * by workers that each index a chunk of the file. The text is used directly from the mapping (and so shared with
+ * the page cache).
+ * With markup the input is read, the rows are then stripped of their markup while reading.
+ *
+ * @returns TRUE if the input is mapped and all rows are added.
+ */
+static gboolean dmenu_read_mmap ( DmenuModePrivateData *pd )
+{
+    if ( pd->do_markup ) {
+        return FALSE;
+    }
+    int         fd = g_unix_input_stream_get_fd ( G_UNIX_INPUT_STREAM ( pd->input_stream ) );
+    struct stat sb;
+    if ( fstat ( fd, &sb ) != 0 || !S_ISREG ( sb.st_mode ) || sb.st_size == 0 ) {
+        return FALSE;
+    }
+    // Part of the file can be consumed already, e.g. by a shell builtin.
+    off_t pos = lseek ( fd, 0, SEEK_CUR );
+    if ( pos < 0 || pos >= sb.st_size ) {
+        return FALSE;
+    }
+    char *map = mmap ( NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+    if ( map == MAP_FAILED ) {
+        g_debug ( "Failed to map input: %s", g_strerror ( errno ) );
+        return FALSE;
+    }
+    // The file can be truncated while it is shown, without a handler reading past its end would terminate rofi.
+    if ( !dmenu_map_protect ( map, sb.st_size ) ) {
+        g_debug ( "Failed to install the SIGBUS handler: %s", g_strerror ( errno ) );
+        munmap ( map, sb.st_size );
+        return FALSE;
+    }
+    const char      *start  = map + pos;
+    gsize           size    = sb.st_size - pos;
+    unsigned int    nc      = CLAMP ( size / DMENU_MAP_MIN_CHUNK, 1, MAX ( config.threads, 1 ) );
+    nc = MAX ( nc, size / DMENU_MAP_MAX_CHUNK + 1 );
+    DmenuIndexChunk *chunks = g_malloc0_n ( nc, sizeof ( DmenuIndexChunk ) );
+    unsigned int    n       = 0;
+    gsize           offset  = 0;
+    gboolean        fits    = TRUE;
+    // Split the input in chunks of about the same size, that start at a row.
+    while ( offset < size ) {
+        gsize stop = MAX ( offset, ( size / nc ) * ( n + 1 ) );
+        if ( ( n + 1 ) < nc && stop < size ) {
+            const char *sep = memchr ( start + stop, pd->separator, size - stop );
+            stop = ( sep != NULL ) ? (gsize) ( sep - start + 1 ) : size;
+        }
+        else {
+            stop = size;
+        }
+        chunks[n].separator = pd->separator;
+        chunks[n].start     = start + offset;
+        chunks[n].len       = stop - offset;
+        chunks[n].arena     = n;
+        // Only a single row of 4 GiB does not fit.
+        fits   = fits && chunks[n].len <= G_MAXUINT32;
+        offset = stop;
+        n++;
+    }
+    if ( !fits ) {
+        g_debug ( "Input has a row that is too long to map, reading it instead." );
+        g_free ( chunks );
+        dmenu_map_release ( map, sb.st_size );
+        return FALSE;
+    }
+    TICK_N ( "Dmenu map input" );
+
+    GCond        cond;
+    GMutex       mutex;
+    unsigned int count = ( tpool != NULL ) ? ( n - 1 ) : 0;
+    g_mutex_init ( &mutex );
+    g_cond_init ( &cond );
+    for ( unsigned int i = 0; i < n; i++ ) {
+        chunks[i].st.callback = dmenu_index_chunk;
+        chunks[i].cond        = &cond;
+        chunks[i].mutex       = &mutex;
+        if ( i > 0 && tpool != NULL ) {
+            chunks[i].acount = &count;
+            g_thread_pool_push ( tpool, &chunks[i], NULL );
+        }
+    }
+    // Index the first chunk, and without a thread pool all chunks, in this thread.
+    for ( unsigned int i = 0; i < n; i++ ) {
+        if ( chunks[i].acount == NULL ) {
+            dmenu_index_chunk ( (thread_state *) &chunks[i], NULL );
+        }
+    }
+    g_mutex_lock ( &mutex );
+    while ( count > 0 ) {
+        g_cond_wait ( &cond, &mutex );
+    }
+    g_mutex_unlock ( &mutex );
+    g_cond_clear ( &cond );
+    g_mutex_clear ( &mutex );
+
+    unsigned int total = 0;
+    for ( unsigned int i = 0; i < n; i++ ) {
+        total += chunks[i].num_rows;
+    }
+    pd->map                  = map;
+    pd->map_size             = sb.st_size;
+    pd->arenas               = g_malloc_n ( n, sizeof ( char * ) );
+    pd->num_arenas           = n;
+    pd->arenas_real_length   = n;
+    pd->cmd_list             = g_malloc_n ( total, sizeof ( DmenuRow ) );
+    pd->cmd_list_real_length = total;
+    pd->cmd_list_length      = total;
+    rofi_match_store_resize ( pd->match_store, total * 2 );
+    total = 0;
+    for ( unsigned int i = 0; i < n; i++ ) {
+        pd->arenas[i] = (char *) chunks[i].start;
+        memcpy ( pd->cmd_list + total, chunks[i].rows, chunks[i].num_rows * sizeof ( DmenuRow ) );
+        for ( guint j = 0; chunks[i].extras != NULL && j < chunks[i].extras->len; j += 2 ) {
+            unsigned int index = total + g_array_index ( chunks[i].extras, unsigned int, j );
+            unsigned int len   = g_array_index ( chunks[i].extras, unsigned int, j + 1 );
+            unsigned int tlen  = pd->cmd_list[index].length;
+            // The mapping is read-only, parse a (nul terminated) copy.
+            char         *buf = g_strndup ( dmenu_get_entry ( pd, index ) + tlen + 1, len - tlen - 1 );
+            dmenu_add_extras ( pd, index, buf, len - tlen );
+            g_free ( buf );
+        }
+        for ( guint j = 0; chunks[i].invalid != NULL && j < chunks[i].invalid->len; j++ ) {
+            if ( pd->map_invalid == NULL ) {
+                pd->map_invalid = g_malloc0_n ( pd->cmd_list_length / 32 + 1, sizeof ( uint32_t ) );
+            }
+            bittoggle ( pd->map_invalid, total + g_array_index ( chunks[i].invalid, unsigned int, j ) );
+        }
+        total += chunks[i].num_rows;
+        g_free ( chunks[i].rows );
+        if ( chunks[i].extras != NULL ) {
+            g_array_free ( chunks[i].extras, TRUE );
+        }
+        if ( chunks[i].invalid != NULL ) {
+            g_array_free ( chunks[i].invalid, TRUE );
         }
-        g_data_input_stream_read_byte ( pd->data_input_stream, NULL, NULL );
-        read_add ( pd, data, len );
-        g_free ( data );
     }
-    g_input_stream_close_async ( G_INPUT_STREAM ( pd->input_stream ), G_PRIORITY_LOW, pd->cancel, async_close_callback, pd );
+    g_free ( chunks );
+    TICK_N ( "Dmenu index input" );
+    dmenu_read_done ( pd );
+    return TRUE;
 }
 
+
 static unsigned int dmenu_mode_get_num_entries ( const Mode *sw )
 {
     const DmenuModePrivateData *rmpd = (const DmenuModePrivateData *) mode_get_private_data ( sw );
@@ -261,9 +884,8 @@ static inline unsigned int get_index ( unsigned int length, int index )
 
 static char *get_display_data ( const Mode *data, unsigned int index, int *state, G_GNUC_UNUSED GList **list, int get_entry )
 {
-    Mode                 *sw   = (Mode *) data;
-    DmenuModePrivateData *pd   = (DmenuModePrivateData *) mode_get_private_data ( sw );
-    DmenuScriptEntry     *retv = (DmenuScriptEntry *) pd->cmd_list;
+    Mode                 *sw = (Mode *) data;
+    DmenuModePrivateData *pd = (DmenuModePrivateData *) mode_get_private_data ( sw );
     for ( unsigned int i = 0; i < pd->num_active_list; i++ ) {
         unsigned int start = get_index ( pd->cmd_list_length, pd->active_list[i].start );
         unsigned int stop  = get_index ( pd->cmd_list_length, pd->active_list[i].stop );
@@ -284,7 +906,29 @@ static char *get_display_data ( const Mode *data, unsigned int index, int *state
     if ( pd->do_markup ) {
         *state |= MARKUP;
     }
-    return get_entry ? dmenu_format_output_string ( pd, retv[index].entry ) : NULL;
+    if ( !get_entry ) {
+        return NULL;
+    }
+    char *entry = dmenu_dup_entry ( pd, index );
+    if ( pd->columns == NULL ) {
+        return entry;
+    }
+    char *retv = dmenu_format_output_string ( pd, entry );
+    g_free ( entry );
+    return retv;
+}
+
+static const char *dmenu_get_sort_key ( const Mode *data, unsigned int index, gssize *length )
+{
+    DmenuModePrivateData *pd = (DmenuModePrivateData *) mode_get_private_data ( data );
+    // With columns the displayed string is formatted, use the completion.
+    if ( pd->columns != NULL || !dmenu_entry_is_valid ( pd, index ) ) {
+        return NULL;
+    }
+    size_t     len  = 0;
+    const char *key = dmenu_get_match_entry ( pd, index, &len );
+    *length = len;
+    return key;
 }
 
 static void dmenu_mode_free ( Mode *sw )
@@ -303,20 +947,33 @@ static void dmenu_mode_free ( Mode *sw )
             g_cancellable_disconnect ( pd->cancel, pd->cancel_source );
             if ( pd->input_stream ) {
                 // Should close the stream if not yet done.
-                g_object_unref ( pd->data_input_stream );
                 g_object_unref ( pd->input_stream );
             }
             g_object_unref ( pd->cancel );
         }
+        g_free ( pd->read_buf );
 
-        for ( size_t i = 0; i < pd->cmd_list_length; i++ ) {
-            if ( pd->cmd_list[i].entry ) {
-                g_free ( pd->cmd_list[i].entry );
-                g_free ( pd->cmd_list[i].icon_name );
-                g_free ( pd->cmd_list[i].meta );
+        if ( pd->map != NULL ) {
+            // The arenas are part of the mapping.
+            dmenu_map_release ( pd->map, pd->map_size );
+            g_free ( pd->map_invalid );
+        }
+        else {
+            for ( unsigned int i = 0; i < pd->num_arenas; i++ ) {
+                g_free ( pd->arenas[i] );
             }
         }
+        g_free ( pd->arenas );
+        if ( pd->extras != NULL ) {
+            for ( unsigned int i = 0; i < pd->cmd_list_length; i++ ) {
+                g_free ( pd->extras[i].icon_name );
+                g_free ( pd->extras[i].meta );
+            }
+            g_free ( pd->extras );
+        }
         g_free ( pd->cmd_list );
+        g_free ( pd->plain );
+        rofi_match_store_free ( pd->match_store );
         g_free ( pd->urgent_list );
         g_free ( pd->active_list );
         g_free ( pd->selected_list );
@@ -340,6 +997,8 @@ Mode dmenu_mode =
     ._get_display_value = get_display_data,
     ._get_icon          = dmenu_get_icon,
     ._get_completion    = NULL,
+    ._get_sort_key      = dmenu_get_sort_key,
+    ._get_match_text    = dmenu_get_match_text,
     ._preprocess_input  = NULL,
     ._get_message       = dmenu_get_message,
     .private_data       = NULL,
@@ -357,6 +1016,7 @@ static int dmenu_mode_init ( Mode *sw )
 
     pd->separator     = '\n';
     pd->selected_line = UINT32_MAX;
+    pd->match_store   = rofi_match_store_new ( 0, FALSE );
 
     find_arg_str ( "-mesg", &( pd->message ) );
 
@@ -364,6 +1024,10 @@ static int dmenu_mode_init ( Mode *sw )
     find_arg_char ( "-sep", &( pd->separator ) );
 
     find_arg_uint (  "-selected-row", &( pd->selected_line ) );
+    // Known before reading, the markup is stripped from the rows while they are read.
+    if ( find_arg ( "-markup-rows" ) >= 0 ) {
+        pd->do_markup = TRUE;
+    }
     // By default we print the unescaped line back.
     pd->format = "s";
 
@@ -409,6 +1073,12 @@ static int dmenu_mode_init ( Mode *sw )
         char *estr = rofi_expand_path ( str );
         fd = open ( str, O_RDONLY );
         if ( fd < 0 ) {
+            if ( find_arg ( "-dump" ) >= 0 ) {
+                // Without user interface there is no dialog to show the error in.
+                g_warning ( "Failed to open file: %s: %s", estr, g_strerror ( errno ) );
+                g_free ( estr );
+                return FALSE;
+            }
             char *msg = g_markup_printf_escaped ( "Failed to open file: <b>%s</b>:\n\t<i>%s</i>", estr, g_strerror ( errno ) );
             rofi_view_error_dialog ( msg, TRUE );
             g_free ( msg );
@@ -422,7 +1092,6 @@ static int dmenu_mode_init ( Mode *sw )
         pd->cancel            = g_cancellable_new ();
         pd->cancel_source     = g_cancellable_connect ( pd->cancel, G_CALLBACK ( async_read_cancel ), pd, NULL );
         pd->input_stream      = g_unix_input_stream_new ( fd, fd != STDIN_FILENO );
-        pd->data_input_stream = g_data_input_stream_new ( pd->input_stream );
     }
     gchar *columns = NULL;
     if ( find_arg_str ( "-display-columns", &columns ) ) {
@@ -435,25 +1104,29 @@ static int dmenu_mode_init ( Mode *sw )
 
 static int dmenu_token_match ( const Mode *sw, rofi_int_matcher **tokens, unsigned int index )
 {
-    DmenuModePrivateData *rmpd = (DmenuModePrivateData *) mode_get_private_data ( sw );
-    /** Strip out the markup when matching. */
-    char                 *esc = NULL;
-    if ( rmpd->do_markup ) {
-        pango_parse_markup ( rmpd->cmd_list[index].entry, -1, 0, NULL, &esc, NULL, NULL );
-    }
-    else {
-        esc = rmpd->cmd_list[index].entry;
+    DmenuModePrivateData *rmpd  = (DmenuModePrivateData *) mode_get_private_data ( sw );
+    char                 *copy  = NULL;
+    size_t               len    = 0;
+    /** With markup, match the text with the markup stripped while reading. */
+    const char           *entry = dmenu_get_match_entry ( rmpd, index, &len );
+    if ( entry != NULL && !dmenu_entry_is_valid ( rmpd, index ) ) {
+        // Match the text as it is shown, with the invalid parts replaced.
+        entry = copy = dmenu_dup_entry ( rmpd, index );
+        len   = strlen ( copy );
     }
-    if ( esc ) {
-        //        int retv = helper_token_match ( tokens, esc );
-        int match = 1;
+    DmenuScriptEntry     *extras = dmenu_get_extras ( rmpd, index );
+    const char           *meta   = extras != NULL ? extras->meta : NULL;
+    int                  match   = FALSE;
+    if ( entry ) {
+        //        int retv = helper_token_match ( tokens, entry );
+        match = 1;
         if ( tokens ) {
             for ( int j = 0; match && tokens != NULL && tokens[j] != NULL; j++ ) {
                 rofi_int_matcher *ftokens[2] = { tokens[j], NULL };
                 int              test        = 0;
-                test = helper_token_match ( ftokens, esc );
-                if ( test == tokens[j]->invert && rmpd->cmd_list[index].meta ) {
-                    test = helper_token_match ( ftokens, rmpd->cmd_list[index].meta );
+                test = helper_token_match_len ( ftokens, entry, len, rmpd->match_store, index * 2 );
+                if ( test == tokens[j]->invert && meta ) {
+                    test = helper_token_match_store ( ftokens, meta, rmpd->match_store, index * 2 + 1 );
                 }
 
                 if ( test == 0 ) {
@@ -461,12 +1134,34 @@ static int dmenu_token_match ( const Mode *sw, rofi_int_matcher **tokens, unsign
                 }
             }
         }
-        if ( rmpd->do_markup ) {
-            g_free ( esc );
+    }
+    g_free ( copy );
+    return match;
+}
+
+static char *dmenu_get_match_text ( const Mode *sw, unsigned int index )
+{
+    DmenuModePrivateData *rmpd = (DmenuModePrivateData *) mode_get_private_data ( sw );
+    char                 *esc  = NULL;
+    if ( rmpd->plain != NULL ) {
+        size_t     len   = 0;
+        const char *plain = dmenu_get_match_entry ( rmpd, index, &len );
+        // Entries with invalid markup never match.
+        if ( plain == NULL ) {
+            return NULL;
         }
-        return match;
+        esc = g_strndup ( plain, len );
     }
-    return FALSE;
+    else {
+        esc = dmenu_dup_entry ( rmpd, index );
+    }
+    DmenuScriptEntry *extras = dmenu_get_extras ( rmpd, index );
+    if ( extras != NULL && extras->meta ) {
+        char *retv = g_strconcat ( esc, "\n", extras->meta, NULL );
+        g_free ( esc );
+        return retv;
+    }
+    return esc;
 }
 static char *dmenu_get_message ( const Mode *sw )
 {
@@ -480,8 +1175,8 @@ static cairo_surface_t *dmenu_get_icon ( const Mode *sw, unsigned int selected_l
 {
     DmenuModePrivateData *pd = (DmenuModePrivateData *) mode_get_private_data ( sw );
     g_return_val_if_fail ( pd->cmd_list != NULL, NULL );
-    DmenuScriptEntry     *dr = &( pd->cmd_list[selected_line] );
-    if ( dr->icon_name == NULL ) {
+    DmenuScriptEntry     *dr = dmenu_get_extras ( pd, selected_line );
+    if ( dr == NULL || dr->icon_name == NULL ) {
         return NULL;
     }
     if ( dr->icon_fetch_uid > 0 ) {
@@ -509,22 +1204,24 @@ static void dmenu_finish ( RofiViewState *state, int retv )
 
 static void dmenu_print_results ( DmenuModePrivateData *pd, const char *input )
 {
-    DmenuScriptEntry *cmd_list = pd->cmd_list;
-    int              seen      = FALSE;
+    int seen = FALSE;
     if ( pd->selected_list != NULL ) {
         for ( unsigned int st = 0; st < pd->cmd_list_length; st++ ) {
             if ( bitget ( pd->selected_list, st ) ) {
                 seen = TRUE;
-                rofi_output_formatted_line ( pd->format, cmd_list[st].entry, st, input );
+                char *entry = dmenu_dup_entry ( pd, st );
+                rofi_output_formatted_line ( pd->format, entry, st, input );
+                g_free ( entry );
             }
         }
     }
     if ( !seen ) {
-        const char *cmd = input;
+        char *entry = NULL;
         if ( pd->selected_line != UINT32_MAX ) {
-            cmd = cmd_list[pd->selected_line].entry;
+            entry = dmenu_dup_entry ( pd, pd->selected_line );
         }
-        rofi_output_formatted_line ( pd->format, cmd, pd->selected_line, input );
+        rofi_output_formatted_line ( pd->format, entry != NULL ? entry : input, pd->selected_line, input );
+        g_free ( entry );
     }
 }
 
@@ -533,7 +1230,6 @@ static void dmenu_finalize ( RofiViewState *state )
     int                  retv            = FALSE;
     DmenuModePrivateData *pd             = (DmenuModePrivateData *) rofi_view_get_mode ( state )->private_data;
     unsigned int         cmd_list_length = pd->cmd_list_length;
-    DmenuScriptEntry     *cmd_list       = pd->cmd_list;
 
     char                 *input = g_strdup ( rofi_view_get_user_input ( state ) );
     pd->selected_line = rofi_view_get_selected_line ( state );;
@@ -570,8 +1266,8 @@ static void dmenu_finalize ( RofiViewState *state )
                     rofi_view_set_overlay ( state, NULL );
                 }
             }
-            else if ( ( mretv & ( MENU_OK | MENU_QUICK_SWITCH ) ) && cmd_list[pd->selected_line].entry != NULL ) {
-                if ( cmd_list[pd->selected_line].nonselectable == TRUE ) {
+            else if ( ( mretv & ( MENU_OK | MENU_QUICK_SWITCH ) ) && pd->selected_line < cmd_list_length ) {
+                if ( dmenu_is_nonselectable ( pd, pd->selected_line ) ) {
                     g_free ( input );
                     return;
                 }
@@ -599,9 +1295,9 @@ static void dmenu_finalize ( RofiViewState *state )
     // We normally do not want to restart the loop.
     restart = FALSE;
     // Normal mode
-    if ( ( mretv & MENU_OK  ) && pd->selected_line != UINT32_MAX && cmd_list[pd->selected_line].entry != NULL ) {
+    if ( ( mretv & MENU_OK  ) && pd->selected_line < cmd_list_length ) {
         // Check if entry is non-selectable.
-        if ( cmd_list[pd->selected_line].nonselectable == TRUE ) {
+        if ( dmenu_is_nonselectable ( pd, pd->selected_line ) ) {
             g_free ( input );
             return;
         }
@@ -659,7 +1355,7 @@ int dmenu_switcher_dialog ( void )
     int                  async      = TRUE;
 
     // For now these only work in sync mode.
-    if ( find_arg ( "-sync" ) >= 0 || find_arg ( "-dump" ) >= 0 || find_arg ( "-select" ) >= 0
+    if ( find_arg ( "-sync" ) >= 0 || find_arg ( "-select" ) >= 0
          || find_arg ( "-no-custom" ) >= 0 || find_arg ( "-only-match" ) >= 0 || config.auto_select ||
          find_arg ( "-selected-row" ) >= 0 ) {
         async = FALSE;
@@ -667,7 +1363,11 @@ int dmenu_switcher_dialog ( void )
 
     // Check if the subsystem is setup for reading, otherwise do not read.
     if ( pd->cancel != NULL ) {
-        if ( async ) {
+        if ( dmenu_read_mmap ( pd ) ) {
+            // All rows are there already.
+            async = FALSE;
+        }
+        else if ( async ) {
             unsigned int pre_read = 25;
             find_arg_uint ( "-async-pre-read", &pre_read );
             async = get_dmenu_async ( pd, pre_read );
@@ -676,9 +1376,8 @@ int dmenu_switcher_dialog ( void )
             get_dmenu_sync ( pd );
         }
     }
-    char             *input          = NULL;
-    unsigned int     cmd_list_length = pd->cmd_list_length;
-    DmenuScriptEntry *cmd_list       = pd->cmd_list;
+    char         *input          = NULL;
+    unsigned int cmd_list_length = pd->cmd_list_length;
 
     pd->only_selected = FALSE;
     pd->multi_select  = FALSE;
@@ -686,9 +1385,6 @@ int dmenu_switcher_dialog ( void )
         menu_flags       = MENU_INDICATOR;
         pd->multi_select = TRUE;
     }
-    if ( find_arg ( "-markup-rows" ) >= 0 ) {
-        pd->do_markup = TRUE;
-    }
     if ( find_arg ( "-only-match" ) >= 0 || find_arg ( "-no-custom" ) >= 0 ) {
         pd->only_selected = TRUE;
         if ( cmd_list_length == 0 ) {
@@ -696,7 +1392,9 @@ int dmenu_switcher_dialog ( void )
         }
     }
     if ( config.auto_select && cmd_list_length == 1 ) {
-        rofi_output_formatted_line ( pd->format, cmd_list[0].entry, 0, config.filter );
+        char *entry = dmenu_dup_entry ( pd, 0 );
+        rofi_output_formatted_line ( pd->format, entry, 0, config.filter );
+        g_free ( entry );
         return TRUE;
     }
     if ( find_arg ( "-password" ) >= 0 ) {
@@ -711,26 +1409,16 @@ int dmenu_switcher_dialog ( void )
         rofi_int_matcher **tokens = helper_tokenize ( select, config.case_sensitive );
         unsigned int     i        = 0;
         for ( i = 0; i < cmd_list_length; i++ ) {
-            if ( helper_token_match ( tokens, cmd_list[i].entry ) ) {
+            char     *entry = dmenu_dup_entry ( pd, i );
+            gboolean found  = helper_token_match ( tokens, entry );
+            g_free ( entry );
+            if ( found ) {
                 pd->selected_line = i;
                 break;
             }
         }
         helper_tokenize_free ( tokens );
     }
-    if ( find_arg ( "-dump" ) >= 0 ) {
-        rofi_int_matcher **tokens = helper_tokenize ( config.filter ? config.filter : "", config.case_sensitive );
-        unsigned int     i        = 0;
-        for ( i = 0; i < cmd_list_length; i++ ) {
-            if ( tokens == NULL || helper_token_match ( tokens, cmd_list[i].entry ) ) {
-                rofi_output_formatted_line ( pd->format, cmd_list[i].entry, i, config.filter );
-            }
-        }
-        helper_tokenize_free ( tokens );
-        dmenu_mode_free ( &dmenu_mode );
-        g_free ( input );
-        return TRUE;
-    }
     find_arg_str (  "-p", &( dmenu_mode.display_name ) );
     RofiViewState *state = rofi_view_create ( &dmenu_mode, input, menu_flags, dmenu_finalize );
 
@@ -748,6 +1436,467 @@ int dmenu_switcher_dialog ( void )
     return FALSE;
 }
 
+/** Size of the blocks -dump reads the input in. */
+#define DUMP_BLOCK_SIZE           ( 1024 * 1024 )
+/** Maximum number of blocks per worker that are read, but not yet written. */
+#define DUMP_BLOCKS_PER_WORKER    4
+/** Size of the output buffer of -dump. */
+#define DUMP_OUTPUT_SIZE          ( 1024 * 1024 )
+
+/**
+ * A matching row, when the output is ranked.
+ */
+typedef struct
+{
+    /** Orders on distance, and on row index for equal distances. */
+    guint64 key;
+    /** The entry while matching the block, the formatted line after. */
+    char    *line;
+} DmenuDumpMatch;
+
+/**
+ * A block of rows, matched by a single worker.
+ */
+typedef struct
+{
+    /** Position of the block in the input. */
+    unsigned int seq;
+    /** Index of the first row in the block. */
+    unsigned int first_row;
+    /** The rows, there is room for a terminator after the last row. */
+    char         *data;
+    /** Length of data in bytes. */
+    gsize        len;
+    /** Entries that had to be made valid UTF-8. */
+    GPtrArray    *strings;
+    /** The formatted matching rows, when not ranked. */
+    GString      *output;
+    /** Number of lines in output. */
+    unsigned int num_lines;
+    /** Offset in output after each line, only with a limit. */
+    GArray       *line_ends;
+    /** The matching rows, when ranked. With a limit only the best, in a heap. */
+    GArray       *matches;
+} DmenuDumpBlock;
+
+/**
+ * State of -dump, shared between the reader and the workers.
+ */
+typedef struct
+{
+    /** Row separator. */
+    char                   separator;
+    /** Output format. */
+    const char             *format;
+    /** The filter. */
+    const char             *filter;
+    /** The tokens to match. */
+    rofi_int_matcher       **tokens;
+    /** The prepared pattern to rank on, NULL if not ranked. */
+    RofiMatchString        *pattern_ms;
+    /** Levenshtein pattern, with sorting method normal. */
+    RofiLevenshteinPattern *lev_pattern;
+    /** Fuzzy pattern, with sorting method fzf. */
+    RofiFuzzyPattern       *fzf_pattern;
+    /** Maximum number of rows to output, 0 for all. */
+    unsigned int           limit;
+    /** Set when the limit is reached, remaining blocks are skipped. */
+    gint                   stop;
+    /** Protects done. */
+    GMutex                 lock;
+    /** Signalled when a block is done. */
+    GCond                  cond;
+    /** The blocks that are done, ordered on position. */
+    GList                  *done;
+    /** Number of blocks that are read, but not yet written. */
+    unsigned int           pending;
+    /** Position of the next block to write. */
+    unsigned int           next_seq;
+    /** Number of rows written. */
+    unsigned int           written;
+    /** The matches, when ranked. With a limit only the best, in a heap. */
+    GArray                 *matches;
+} DmenuDump;
+
+static void dmenu_dump_heap_sift_down ( DmenuDumpMatch *heap, unsigned int size, unsigned int i )
+{
+    DmenuDumpMatch m = heap[i];
+    while ( TRUE ) {
+        unsigned int child = 2 * i + 1;
+        if ( child >= size ) {
+            break;
+        }
+        if ( ( child + 1 ) < size && heap[child + 1].key > heap[child].key ) {
+            child++;
+        }
+        if ( m.key >= heap[child].key ) {
+            break;
+        }
+        heap[i] = heap[child];
+        i       = child;
+    }
+    heap[i] = m;
+}
+
+static void dmenu_dump_heap_sift_up ( DmenuDumpMatch *heap, unsigned int i )
+{
+    DmenuDumpMatch m = heap[i];
+    while ( i > 0 && heap[( i - 1 ) / 2].key < m.key ) {
+        heap[i] = heap[( i - 1 ) / 2];
+        i       = ( i - 1 ) / 2;
+    }
+    heap[i] = m;
+}
+
+/**
+ * @param matches The matches to add to.
+ * @param limit The maximum number of matches to keep, 0 for all.
+ * @param match The match to add, replaced by the match that did not make the cut (line is NULL if none).
+ *
+ * With a limit matches is a max-heap of the best limit matches, so the memory used is bounded.
+ */
+static void dmenu_dump_keep_match ( GArray *matches, unsigned int limit, DmenuDumpMatch *match )
+{
+    if ( limit == 0 || matches->len < limit ) {
+        g_array_append_val ( matches, *match );
+        if ( limit > 0 ) {
+            dmenu_dump_heap_sift_up ( (DmenuDumpMatch *) matches->data, matches->len - 1 );
+        }
+        match->line = NULL;
+    }
+    else {
+        DmenuDumpMatch *heap = (DmenuDumpMatch *) matches->data;
+        if ( match->key < heap[0].key ) {
+            DmenuDumpMatch worst = heap[0];
+            heap[0] = *match;
+            dmenu_dump_heap_sift_down ( heap, matches->len, 0 );
+            *match = worst;
+        }
+    }
+}
+
+static gint dmenu_dump_match_cmp ( gconstpointer a, gconstpointer b )
+{
+    guint64 ka = ( (const DmenuDumpMatch *) a )->key;
+    guint64 kb = ( (const DmenuDumpMatch *) b )->key;
+    return ( ka > kb ) - ( ka < kb );
+}
+
+/**
+ * @param dump The dump state.
+ * @param entry The matching entry.
+ * @param index The index of the entry.
+ *
+ * @returns the key that orders the entry the same way the view ranks rows.
+ */
+static guint64 dmenu_dump_rank_key ( const DmenuDump *dump, const char *entry, unsigned int index )
+{
+    int             distance = 0;
+    RofiMatchString *ms      = rofi_match_string_new ( entry, TRUE );
+    if ( config.sorting_method_enum == SORT_FZF ) {
+        distance = rofi_scorer_fuzzy_pattern_evaluate ( dump->fzf_pattern, ms->ucs, ms->ucs_len );
+    }
+    else {
+        distance = levenshtein_pattern_distance ( dump->lev_pattern, ms->ucs, ms->ucs_len );
+    }
+    rofi_match_string_free ( ms );
+    return ( (guint64) ( ( (guint32) distance ) ^ 0x80000000u ) << 32 ) | index;
+}
+
+static void dmenu_dump_match_row ( DmenuDump *dump, DmenuDumpBlock *block, char *entry, gboolean valid, unsigned int index )
+{
+    if ( !valid && !g_utf8_validate ( entry, -1, NULL ) ) {
+        entry = rofi_force_utf8 ( entry, strlen ( entry ) );
+        if ( block->strings == NULL ) {
+            block->strings = g_ptr_array_new_with_free_func ( g_free );
+        }
+        g_ptr_array_add ( block->strings, entry );
+    }
+    if ( !helper_token_match ( dump->tokens, entry ) ) {
+        return;
+    }
+    if ( block->matches != NULL ) {
+        DmenuDumpMatch match = { dmenu_dump_rank_key ( dump, entry, index ), entry };
+        dmenu_dump_keep_match ( block->matches, dump->limit, &match );
+    }
+    else if ( dump->limit == 0 || block->num_lines < dump->limit ) {
+        rofi_append_formatted_line ( block->output, dump->format, entry, index, dump->filter );
+        if ( block->line_ends != NULL ) {
+            g_array_append_val ( block->line_ends, block->output->len );
+        }
+        block->num_lines++;
+    }
+}
+
+/**
+ * @param data The rows.
+ * @param len The length of data in bytes.
+ * @param separator The row separator.
+ *
+ * @returns the number of separators in data.
+ */
+static unsigned int dmenu_dump_count_rows ( const char *data, gsize len, char separator )
+{
+    unsigned int count = 0;
+    const char   *end  = data + len;
+    while ( ( data = memchr ( data, separator, end - data ) ) != NULL ) {
+        count++;
+        data++;
+    }
+    return count;
+}
+
+/**
+ * @param data The block.
+ * @param user_data The dump state.
+ *
+ * Worker that matches all rows in a block, and formats the matching rows.
+ */
+static void dmenu_dump_block_run ( gpointer data, gpointer user_data )
+{
+    DmenuDumpBlock *block = (DmenuDumpBlock *) data;
+    DmenuDump      *dump  = (DmenuDump *) user_data;
+
+    if ( dump->pattern_ms != NULL ) {
+        block->matches = g_array_new ( FALSE, FALSE, sizeof ( DmenuDumpMatch ) );
+    }
+    else {
+        block->output = g_string_new ( NULL );
+        if ( dump->limit > 0 ) {
+            block->line_ends = g_array_new ( FALSE, FALSE, sizeof ( gsize ) );
+        }
+    }
+    if ( !g_atomic_int_get ( &( dump->stop ) ) ) {
+        // An ASCII separator can not split a multi-byte character, so if the block is valid, so are the rows.
+        // Entries with extras (after a nul) fail this check and are validated one by one.
+        gboolean     valid = ( (guchar) dump->separator ) < 0x80 && g_utf8_validate ( block->data, block->len, NULL );
+        char         *row  = block->data;
+        char         *end  = block->data + block->len;
+        unsigned int index = block->first_row;
+        while ( row < end ) {
+            char *next = memchr ( row, dump->separator, end - row );
+            if ( next == NULL ) {
+                next = end;
+            }
+            *next = '\0';
+            dmenu_dump_match_row ( dump, block, row, valid, index++ );
+            row = next + 1;
+        }
+    }
+    // Only the kept matches are formatted, the entries are gone after this.
+    for ( unsigned int i = 0; block->matches != NULL && i < block->matches->len; i++ ) {
+        DmenuDumpMatch *match = &g_array_index ( block->matches, DmenuDumpMatch, i );
+        GString        *str   = g_string_new ( NULL );
+        rofi_append_formatted_line ( str, dump->format, match->line, (int) ( match->key & G_MAXUINT32 ), dump->filter );
+        match->line = g_string_free ( str, FALSE );
+    }
+    g_free ( block->data );
+    block->data = NULL;
+    if ( block->strings != NULL ) {
+        g_ptr_array_free ( block->strings, TRUE );
+        block->strings = NULL;
+    }
+
+    g_mutex_lock ( &( dump->lock ) );
+    GList *iter = dump->done;
+    while ( iter != NULL && ( (DmenuDumpBlock *) iter->data )->seq < block->seq ) {
+        iter = g_list_next ( iter );
+    }
+    dump->done = g_list_insert_before ( dump->done, iter, block );
+    g_cond_signal ( &( dump->cond ) );
+    g_mutex_unlock ( &( dump->lock ) );
+}
+
+/**
+ * @param dump The dump state.
+ * @param block The block to write, it is freed.
+ *
+ * Write the output of a block, or merge its matches when ranked.
+ */
+static void dmenu_dump_write_block ( DmenuDump *dump, DmenuDumpBlock *block )
+{
+    if ( block->matches != NULL ) {
+        for ( unsigned int i = 0; i < block->matches->len; i++ ) {
+            DmenuDumpMatch match = g_array_index ( block->matches, DmenuDumpMatch, i );
+            dmenu_dump_keep_match ( dump->matches, dump->limit, &match );
+            g_free ( match.line );
+        }
+        g_array_free ( block->matches, TRUE );
+    }
+    else {
+        gsize len = block->output->len;
+        if ( dump->limit > 0 ) {
+            unsigned int n = MIN ( block->num_lines, dump->limit - dump->written );
+            len            = ( n > 0 ) ? g_array_index ( block->line_ends, gsize, n - 1 ) : 0;
+            dump->written += n;
+            if ( dump->written == dump->limit ) {
+                g_atomic_int_set ( &( dump->stop ), TRUE );
+            }
+            g_array_free ( block->line_ends, TRUE );
+        }
+        fwrite ( block->output->str, 1, len, stdout );
+        g_string_free ( block->output, TRUE );
+    }
+    g_free ( block );
+}
+
+/**
+ * @param dump The dump state.
+ * @param max_pending The maximum number of blocks that can stay pending.
+ *
+ * Write the blocks that are done in input order, and wait for blocks to finish until at most max_pending are left.
+ */
+static void dmenu_dump_drain ( DmenuDump *dump, unsigned int max_pending )
+{
+    g_mutex_lock ( &( dump->lock ) );
+    while ( TRUE ) {
+        DmenuDumpBlock *block = ( dump->done != NULL ) ? (DmenuDumpBlock *) dump->done->data : NULL;
+        if ( block != NULL && block->seq == dump->next_seq ) {
+            dump->done = g_list_delete_link ( dump->done, dump->done );
+            // Writing can block, do not hold up the workers.
+            g_mutex_unlock ( &( dump->lock ) );
+            dmenu_dump_write_block ( dump, block );
+            g_mutex_lock ( &( dump->lock ) );
+            dump->next_seq++;
+            dump->pending--;
+        }
+        else if ( dump->pending > max_pending ) {
+            g_cond_wait ( &( dump->cond ), &( dump->lock ) );
+        }
+        else {
+            break;
+        }
+    }
+    g_mutex_unlock ( &( dump->lock ) );
+}
+
+int dmenu_dump ( void )
+{
+    if ( config_sanity_check_headless () || !mode_init ( &dmenu_mode ) ) {
+        dmenu_mode_free ( &dmenu_mode );
+        return EXIT_FAILURE;
+    }
+    DmenuModePrivateData *pd   = (DmenuModePrivateData *) dmenu_mode.private_data;
+    int                  retv  = EXIT_SUCCESS;
+    DmenuDump            *dump = g_malloc0 ( sizeof ( DmenuDump ) );
+    dump->separator = pd->separator;
+    dump->format    = pd->format;
+    dump->filter    = config.filter;
+    dump->tokens    = helper_tokenize ( config.filter ? config.filter : "", config.case_sensitive );
+    find_arg_uint ( "-dump-limit", &( dump->limit ) );
+    g_mutex_init ( &( dump->lock ) );
+    g_cond_init ( &( dump->cond ) );
+    // Rank the matches like the view does, the pattern is prepared once.
+    if ( config.sort && dump->tokens != NULL ) {
+        dump->pattern_ms = rofi_match_string_new ( config.filter, TRUE );
+        if ( config.sorting_method_enum == SORT_FZF ) {
+            dump->fzf_pattern = rofi_scorer_fuzzy_pattern_new ( dump->pattern_ms->ucs, dump->pattern_ms->ucs_len );
+        }
+        else {
+            dump->lev_pattern = levenshtein_pattern_new ( dump->pattern_ms->ucs, dump->pattern_ms->ucs_len );
+        }
+        dump->matches = g_array_new ( FALSE, FALSE, sizeof ( DmenuDumpMatch ) );
+    }
+    // Rows only have to be counted when their index is used.
+    gboolean count_rows = dump->pattern_ms != NULL || strpbrk ( dump->format, "id" ) != NULL;
+
+    GError      *error = NULL;
+    GThreadPool *pool  = g_thread_pool_new ( dmenu_dump_block_run, dump, config.threads, FALSE, &error );
+    if ( error != NULL ) {
+        g_warning ( "Failed to setup thread pool, matching on a single thread: '%s'", error->message );
+        g_error_free ( error );
+        pool = NULL;
+    }
+    unsigned int max_pending = MAX ( config.threads, 1 ) * DUMP_BLOCKS_PER_WORKER;
+    setvbuf ( stdout, NULL, _IOFBF, DUMP_OUTPUT_SIZE );
+
+    unsigned int seq  = 0;
+    unsigned int row  = 0;
+    gsize        size = DUMP_BLOCK_SIZE;
+    gsize        len  = 0;
+    char         *buf = g_malloc ( size );
+    gboolean     eof  = ( pd->input_stream == NULL );
+    while ( !eof && !g_atomic_int_get ( &( dump->stop ) ) ) {
+        // Keep one byte free, to terminate the last row.
+        gssize n = g_input_stream_read ( pd->input_stream, buf + len, size - len - 1, NULL, &error );
+        if ( n < 0 ) {
+            g_warning ( "Failed to read input: %s", error->message );
+            g_clear_error ( &error );
+            retv = EXIT_FAILURE;
+        }
+        eof  = ( n <= 0 );
+        len += MAX ( n, 0 );
+        gsize end = len;
+        if ( !eof ) {
+            // Only complete rows go in the block, the rest is carried over to the next.
+            char *last = memrchr ( buf, dump->separator, len );
+            if ( last == NULL ) {
+                // A single row that does not fit, grow the buffer.
+                if ( ( len + 1 ) == size ) {
+                    size *= 2;
+                    buf   = g_realloc ( buf, size );
+                }
+                continue;
+            }
+            end = last - buf + 1;
+        }
+        if ( end == 0 ) {
+            continue;
+        }
+        DmenuDumpBlock *block = g_malloc0 ( sizeof ( DmenuDumpBlock ) );
+        block->seq       = seq++;
+        block->first_row = row;
+        block->data      = buf;
+        block->len       = end;
+        if ( count_rows ) {
+            row += dmenu_dump_count_rows ( buf, end, dump->separator );
+        }
+        gsize rest = len - end;
+        size = MAX ( DUMP_BLOCK_SIZE, rest * 2 );
+        buf  = g_malloc ( size );
+        memcpy ( buf, block->data + end, rest );
+        len = rest;
+
+        dump->pending++;
+        if ( pool != NULL ) {
+            g_thread_pool_push ( pool, block, NULL );
+        }
+        else {
+            dmenu_dump_block_run ( block, dump );
+        }
+        dmenu_dump_drain ( dump, max_pending );
+    }
+    g_free ( buf );
+    dmenu_dump_drain ( dump, 0 );
+    if ( pool != NULL ) {
+        g_thread_pool_free ( pool, FALSE, TRUE );
+    }
+
+    if ( dump->matches != NULL ) {
+        g_array_sort ( dump->matches, dmenu_dump_match_cmp );
+        for ( unsigned int i = 0; i < dump->matches->len; i++ ) {
+            char *line = g_array_index ( dump->matches, DmenuDumpMatch, i ).line;
+            fputs ( line, stdout );
+            g_free ( line );
+        }
+        g_array_free ( dump->matches, TRUE );
+    }
+    if ( fflush ( stdout ) != 0 || ferror ( stdout ) ) {
+        g_warning ( "Failed to write output: %s", g_strerror ( errno ) );
+        retv = EXIT_FAILURE;
+    }
+
+    levenshtein_pattern_free ( dump->lev_pattern );
+    rofi_scorer_fuzzy_pattern_free ( dump->fzf_pattern );
+    rofi_match_string_free ( dump->pattern_ms );
+    helper_tokenize_free ( dump->tokens );
+    g_mutex_clear ( &( dump->lock ) );
+    g_cond_clear ( &( dump->cond ) );
+    g_free ( dump );
+    dmenu_mode_free ( &dmenu_mode );
+    return retv;
+}
+
 void print_dmenu_options ( void )
 {
     int is_term = isatty ( fileno ( stdout ) );
@@ -767,6 +1916,8 @@ void print_dmenu_options ( void )
     print_help_msg ( "-markup-rows", "", "Allow and render pango markup as input data.", NULL, is_term );
     print_help_msg ( "-sep", "[char]", "Element separator.", "'\\n'", is_term );
     print_help_msg ( "-input", "[filename]", "Read input from file instead from standard input.", NULL, is_term );
+    print_help_msg ( "-dump", "", "Print the filtered (and sorted) rows without showing a window.", NULL, is_term );
+    print_help_msg ( "-dump-limit", "[number]", "Maximum number of rows to print with -dump.", NULL, is_term );
     print_help_msg ( "-sync", "", "Force dmenu to first read all input data, then show dialog.", NULL, is_term );
     print_help_msg ( "-async-pre-read", "[number]", "Read several entries blocking before switching to async mode", "25", is_term );
     print_help_msg ( "-w", "windowid", "Position over window with X11 windowid.", NULL, is_term );
@@ -98,6 +98,8 @@ typedef struct
     char            **keywords;
     /* Comments */
     char            *comment;
+    /* The enabled fields, joined for matching. */
+    RofiMatchFields *match_fields;
 
     GKeyFile        *key_file;
 
@@ -134,20 +136,22 @@ static DRunEntryField matching_entry_fields[DRUN_MATCH_NUM_FIELDS] = {
 
 struct _DRunModePrivateData
 {
-    DRunModeEntry *entry_list;
-    unsigned int  cmd_list_length;
-    unsigned int  cmd_list_length_actual;
+    DRunModeEntry  *entry_list;
+    unsigned int   cmd_list_length;
+    unsigned int   cmd_list_length_actual;
+    // Prepared match strings, the joined fields of each entry.
+    RofiMatchStore *match_store;
     // List of disabled entries.
-    GHashTable    *disabled_entries;
-    unsigned int  disabled_entries_length;
-    unsigned int  expected_line_height;
+    GHashTable     *disabled_entries;
+    unsigned int   disabled_entries_length;
+    unsigned int   expected_line_height;
 
-    char          **show_categories;
+    char           **show_categories;
 
     // Theme
-    const gchar   *icon_theme;
+    const gchar    *icon_theme;
     // DE
-    gchar         **current_desktop_list;
+    gchar          **current_desktop_list;
 };
 
 struct RegexEvalArg
@@ -894,6 +898,40 @@ static void drun_mode_parse_entry_fields ()
     g_free ( switcher_str );
 }
 
+/**
+ * @param e The entry.
+ *
+ * Join the fields enabled for matching (drun-match-fields) of the entry, so a token is matched against them all at once.
+ */
+static void drun_entry_match_fields ( DRunModeEntry *e )
+{
+    GPtrArray *fields = g_ptr_array_new ();
+    if ( matching_entry_fields[DRUN_MATCH_FIELD_NAME].enabled ) {
+        g_ptr_array_add ( fields, e->name );
+    }
+    if ( matching_entry_fields[DRUN_MATCH_FIELD_GENERIC].enabled ) {
+        g_ptr_array_add ( fields, e->generic_name );
+    }
+    if ( matching_entry_fields[DRUN_MATCH_FIELD_EXEC].enabled ) {
+        g_ptr_array_add ( fields, e->exec );
+    }
+    if ( matching_entry_fields[DRUN_MATCH_FIELD_CATEGORIES].enabled ) {
+        for ( int iter = 0; e->categories && e->categories[iter]; iter++ ) {
+            g_ptr_array_add ( fields, e->categories[iter] );
+        }
+    }
+    if ( matching_entry_fields[DRUN_MATCH_FIELD_KEYWORDS].enabled ) {
+        for ( int iter = 0; e->keywords && e->keywords[iter]; iter++ ) {
+            g_ptr_array_add ( fields, e->keywords[iter] );
+        }
+    }
+    if ( matching_entry_fields[DRUN_MATCH_FIELD_COMMENT].enabled ) {
+        g_ptr_array_add ( fields, e->comment );
+    }
+    e->match_fields = helper_match_fields_new ( (const char * const *) fields->pdata, fields->len );
+    g_ptr_array_free ( fields, TRUE );
+}
+
 static int drun_mode_init ( Mode *sw )
 {
     if ( mode_get_private_data ( sw ) != NULL ) {
@@ -912,6 +950,10 @@ static int drun_mode_init ( Mode *sw )
 
     drun_mode_parse_entry_fields ();
     get_apps ( pd );
+    for ( unsigned int i = 0; i < pd->cmd_list_length; i++ ) {
+        drun_entry_match_fields ( &( pd->entry_list[i] ) );
+    }
+    pd->match_store = rofi_match_store_new ( pd->cmd_list_length, FALSE );
     return TRUE;
 }
 static void drun_entry_clear ( DRunModeEntry *e )
@@ -933,6 +975,7 @@ static void drun_entry_clear ( DRunModeEntry *e )
     }
     g_strfreev ( e->categories );
     g_strfreev ( e->keywords );
+    g_free ( e->match_fields );
     if ( e->key_file ) {
         g_key_file_free ( e->key_file );
     }
@@ -966,6 +1009,8 @@ static ModeMode drun_mode_result ( Mode *sw, int mretv, char **input, unsigned i
             memmove ( &( rmpd->entry_list[selected_line] ), &rmpd->entry_list[selected_line + 1],
                       sizeof ( DRunModeEntry ) * ( rmpd->cmd_list_length - selected_line - 1 ) );
             rmpd->cmd_list_length--;
+            // Entries shifted, so the slots no longer line up.
+            rofi_match_store_clear ( rmpd->match_store );
         }
         retv = RELOAD_DIALOG;
     }
@@ -980,6 +1025,7 @@ static void drun_mode_destroy ( Mode *sw )
         }
         g_hash_table_destroy ( rmpd->disabled_entries );
         g_free ( rmpd->entry_list );
+        rofi_match_store_free ( rmpd->match_store );
 
         g_strfreev ( rmpd->current_desktop_list );
         g_strfreev ( rmpd->show_categories );
@@ -1074,63 +1120,27 @@ static char *drun_get_completion ( const Mode *sw, unsigned int index )
     }
 }
 
+static const char *drun_get_sort_key ( const Mode *sw, unsigned int index, G_GNUC_UNUSED gssize *length )
+{
+    DRunModePrivateData *pd = (DRunModePrivateData *) mode_get_private_data ( sw );
+    return pd->entry_list[index].name;
+}
+
 static int drun_token_match ( const Mode *data, rofi_int_matcher **tokens, unsigned int index )
 {
     DRunModePrivateData *rmpd = (DRunModePrivateData *) mode_get_private_data ( data );
-    int                 match = 1;
-    if ( tokens ) {
-        for ( int j = 0; match && tokens != NULL && tokens[j] != NULL; j++ ) {
-            int              test        = 0;
-            rofi_int_matcher *ftokens[2] = { tokens[j], NULL };
-            // Match name
-            if ( matching_entry_fields[DRUN_MATCH_FIELD_NAME].enabled ) {
-                if ( rmpd->entry_list[index].name ) {
-                    test = helper_token_match ( ftokens, rmpd->entry_list[index].name );
-                }
-            }
-            if ( matching_entry_fields[DRUN_MATCH_FIELD_GENERIC].enabled ) {
-                // Match generic name
-                if ( test == tokens[j]->invert && rmpd->entry_list[index].generic_name ) {
-                    test = helper_token_match ( ftokens, rmpd->entry_list[index].generic_name );
-                }
-            }
-            if ( matching_entry_fields[DRUN_MATCH_FIELD_EXEC].enabled ) {
-                // Match executable name.
-                if ( test == tokens[j]->invert  ) {
-                    test = helper_token_match ( ftokens, rmpd->entry_list[index].exec );
-                }
-            }
-            if ( matching_entry_fields[DRUN_MATCH_FIELD_CATEGORIES].enabled ) {
-                // Match against category.
-                if ( test == tokens[j]->invert ) {
-                    gchar **list = rmpd->entry_list[index].categories;
-                    for ( int iter = 0; test == tokens[j]->invert && list && list[iter]; iter++ ) {
-                        test = helper_token_match ( ftokens, list[iter] );
-                    }
-                }
-            }
-            if ( matching_entry_fields[DRUN_MATCH_FIELD_KEYWORDS].enabled ) {
-                // Match against category.
-                if ( test == tokens[j]->invert ) {
-                    gchar **list = rmpd->entry_list[index].keywords;
-                    for ( int iter = 0; test == tokens[j]->invert && list && list[iter]; iter++ ) {
-                        test = helper_token_match ( ftokens, list[iter] );
-                    }
-                }
-            }
-            if ( matching_entry_fields[DRUN_MATCH_FIELD_COMMENT].enabled ) {
-                // Match executable name.
-                if ( test == tokens[j]->invert && rmpd->entry_list[index].comment ) {
-                    test = helper_token_match ( ftokens, rmpd->entry_list[index].comment );
-                }
-            }
-            if ( test == 0 ) {
-                match = 0;
-            }
-        }
-    }
+    return helper_token_match_fields ( tokens, rmpd->entry_list[index].match_fields, rmpd->match_store, index );
+}
 
-    return match;
+static char *drun_get_match_text ( const Mode *sw, unsigned int index )
+{
+    DRunModePrivateData   *rmpd = (DRunModePrivateData *) mode_get_private_data ( sw );
+    const RofiMatchFields *mf   = rmpd->entry_list[index].match_fields;
+    // Without fields the entry can not match.
+    if ( mf == NULL || mf->num_fields == 0 ) {
+        return NULL;
+    }
+    return g_strndup ( mf->text, mf->len );
 }
 
 static unsigned int drun_mode_get_num_entries ( const Mode *sw )
@@ -1149,6 +1159,8 @@ Mode drun_mode =
     ._destroy           = drun_mode_destroy,
     ._token_match       = drun_token_match,
     ._get_completion    = drun_get_completion,
+    ._get_sort_key      = drun_get_sort_key,
+    ._get_match_text    = drun_get_match_text,
     ._get_display_value = _get_display_value,
     ._get_icon          = _get_icon,
     ._preprocess_input  = NULL,
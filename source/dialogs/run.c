@@ -67,9 +67,11 @@
 typedef struct
 {
     /** list of available commands. */
-    char         **cmd_list;
+    char           **cmd_list;
     /** Length of the #cmd_list. */
-    unsigned int cmd_list_length;
+    unsigned int   cmd_list_length;
+    /** Prepared match strings, one per command. */
+    RofiMatchStore *match_store;
 } RunModePrivateData;
 
 /**
@@ -343,6 +345,7 @@ static int run_mode_init ( Mode *sw )
         RunModePrivateData *pd = g_malloc0 ( sizeof ( *pd ) );
         sw->private_data = (void *) pd;
         pd->cmd_list     = get_apps ( &( pd->cmd_list_length ) );
+        pd->match_store  = rofi_match_store_new ( pd->cmd_list_length, FALSE );
     }
 
     return TRUE;
@@ -352,6 +355,7 @@ static void run_mode_destroy ( Mode *sw )
     RunModePrivateData *rmpd = (RunModePrivateData *) sw->private_data;
     if ( rmpd != NULL ) {
         g_strfreev ( rmpd->cmd_list );
+        rofi_match_store_free ( rmpd->match_store );
         g_free ( rmpd );
         sw->private_data = NULL;
     }
@@ -402,10 +406,16 @@ static char *_get_display_value ( const Mode *sw, unsigned int selected_line, G_
     return get_entry ? g_strdup ( rmpd->cmd_list[selected_line] ) : NULL;
 }
 
+static const char *run_get_sort_key ( const Mode *sw, unsigned int selected_line, G_GNUC_UNUSED gssize *length )
+{
+    const RunModePrivateData *rmpd = (const RunModePrivateData *) sw->private_data;
+    return rmpd->cmd_list[selected_line];
+}
+
 static int run_token_match ( const Mode *sw, rofi_int_matcher **tokens, unsigned int index )
 {
     const RunModePrivateData *rmpd = (const RunModePrivateData *) sw->private_data;
-    return helper_token_match ( tokens, rmpd->cmd_list[index] );
+    return helper_token_match_store ( tokens, rmpd->cmd_list[index], rmpd->match_store, index );
 }
 
 #include "mode-private.h"
@@ -421,6 +431,7 @@ Mode run_mode =
     ._get_display_value = _get_display_value,
     ._get_icon          = NULL,
     ._get_completion    = NULL,
+    ._get_sort_key      = run_get_sort_key,
     ._preprocess_input  = NULL,
     .private_data       = NULL,
     .free               = NULL
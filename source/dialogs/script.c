@@ -57,6 +57,8 @@ typedef struct
     DmenuScriptEntry       *cmd_list;
     /** length list of visible items. */
     unsigned int           cmd_list_length;
+    /** Prepared match strings, two (entry and meta) per item. */
+    RofiMatchStore         *match_store;
 
     /** Urgent list */
     struct rofi_range_pair * urgent_list;
@@ -240,6 +242,7 @@ static int script_mode_init ( Mode *sw )
 		pd->delim        = '\n';
         sw->private_data = (void *) pd;
         pd->cmd_list     = execute_executor ( sw, NULL, &( pd->cmd_list_length ), 0 );
+        pd->match_store  = rofi_match_store_new ( pd->cmd_list_length * 2, FALSE );
     }
     return TRUE;
 }
@@ -314,7 +317,9 @@ static ModeMode script_mode_result ( Mode *sw, int mretv, char **input, unsigned
 
         rmpd->cmd_list        = new_list;
         rmpd->cmd_list_length = new_length;
-        retv                  = RESET_DIALOG;
+        rofi_match_store_free ( rmpd->match_store );
+        rmpd->match_store = rofi_match_store_new ( new_length * 2, FALSE );
+        retv              = RESET_DIALOG;
     }
     return retv;
 }
@@ -329,6 +334,7 @@ static void script_mode_destroy ( Mode *sw )
             g_free ( rmpd->cmd_list[i].meta );
         }
         g_free ( rmpd->cmd_list );
+        rofi_match_store_free ( rmpd->match_store );
         g_free ( rmpd->message );
         g_free ( rmpd->prompt );
         g_free ( rmpd->urgent_list );
@@ -371,6 +377,12 @@ static char *_get_display_value ( const Mode *sw, unsigned int selected_line, G_
     return get_entry ? g_strdup ( pd->cmd_list[selected_line].entry ) : NULL;
 }
 
+static const char *script_get_sort_key ( const Mode *sw, unsigned int selected_line, G_GNUC_UNUSED gssize *length )
+{
+    ScriptModePrivateData *pd = sw->private_data;
+    return pd->cmd_list[selected_line].entry;
+}
+
 static int script_token_match ( const Mode *sw, rofi_int_matcher **tokens, unsigned int index )
 {
     ScriptModePrivateData *rmpd = sw->private_data;
@@ -379,9 +391,9 @@ static int script_token_match ( const Mode *sw, rofi_int_matcher **tokens, unsig
         for ( int j = 0; match && tokens != NULL && tokens[j] != NULL; j++ ) {
             rofi_int_matcher *ftokens[2] = { tokens[j], NULL };
             int              test        = 0;
-            test = helper_token_match ( ftokens, rmpd->cmd_list[index].entry );
+            test = helper_token_match_store ( ftokens, rmpd->cmd_list[index].entry, rmpd->match_store, index * 2 );
             if ( test == tokens[j]->invert && rmpd->cmd_list[index].meta ) {
-                test = helper_token_match ( ftokens, rmpd->cmd_list[index].meta );
+                test = helper_token_match_store ( ftokens, rmpd->cmd_list[index].meta, rmpd->match_store, index * 2 + 1 );
             }
 
             if ( test == 0 ) {
@@ -439,6 +451,7 @@ Mode *script_switcher_parse_setup ( const char *str )
         sw->_get_message       = script_get_message;
         sw->_get_icon          = script_get_icon;
         sw->_get_completion    = NULL,
+        sw->_get_sort_key      = script_get_sort_key,
         sw->_preprocess_input  = NULL,
         sw->_get_display_value = _get_display_value;
 
@@ -71,11 +71,13 @@ typedef struct _SshEntry
  */
 typedef struct
 {
-    GList        *user_known_hosts;
+    GList          *user_known_hosts;
     /** List if available ssh hosts.*/
-    SshEntry     *hosts_list;
+    SshEntry       *hosts_list;
     /** Length of the #hosts_list.*/
-    unsigned int hosts_list_length;
+    unsigned int   hosts_list_length;
+    /** Prepared match strings, one per host. */
+    RofiMatchStore *match_store;
 } SSHModePrivateData;
 
 /**
@@ -543,7 +545,8 @@ static int ssh_mode_init ( Mode *sw )
     if ( mode_get_private_data ( sw ) == NULL ) {
         SSHModePrivateData *pd = g_malloc0 ( sizeof ( *pd ) );
         mode_set_private_data ( sw, (void *) pd );
-        pd->hosts_list = get_ssh ( pd, &( pd->hosts_list_length ) );
+        pd->hosts_list  = get_ssh ( pd, &( pd->hosts_list_length ) );
+        pd->match_store = rofi_match_store_new ( pd->hosts_list_length, FALSE );
     }
     return TRUE;
 }
@@ -574,6 +577,7 @@ static void ssh_mode_destroy ( Mode *sw )
         }
         g_list_free_full ( rmpd->user_known_hosts, g_free );
         g_free ( rmpd->hosts_list );
+        rofi_match_store_free ( rmpd->match_store );
         g_free ( rmpd );
         mode_set_private_data ( sw, NULL );
     }
@@ -637,6 +641,21 @@ static char *_get_display_value ( const Mode *sw, unsigned int selected_line, G_
     return get_entry ? g_strdup ( rmpd->hosts_list[selected_line].hostname ) : NULL;
 }
 
+/**
+ * @param sw Object handle to the SSH Mode object
+ * @param selected_line The entry to get the sort key of
+ * @param length Not used, the length is not known
+ *
+ * Get the hostname to sort the entry on.
+ *
+ * @returns the hostname
+ */
+static const char *_get_sort_key ( const Mode *sw, unsigned int selected_line, G_GNUC_UNUSED gssize *length )
+{
+    SSHModePrivateData *rmpd = (SSHModePrivateData *) mode_get_private_data ( sw );
+    return rmpd->hosts_list[selected_line].hostname;
+}
+
 /**
  * @param sw Object handle to the SSH Mode object
  * @param tokens The set of tokens to match against
@@ -649,7 +668,7 @@ static char *_get_display_value ( const Mode *sw, unsigned int selected_line, G_
 static int ssh_token_match ( const Mode *sw, rofi_int_matcher **tokens, unsigned int index )
 {
     SSHModePrivateData *rmpd = (SSHModePrivateData *) mode_get_private_data ( sw );
-    return helper_token_match ( tokens, rmpd->hosts_list[index].hostname );
+    return helper_token_match_store ( tokens, rmpd->hosts_list[index].hostname, rmpd->match_store, index );
 }
 #include "mode-private.h"
 Mode ssh_mode =
@@ -663,6 +682,7 @@ Mode ssh_mode =
     ._token_match       = ssh_token_match,
     ._get_display_value = _get_display_value,
     ._get_completion    = NULL,
+    ._get_sort_key      = _get_sort_key,
     ._preprocess_input  = NULL,
     .private_data       = NULL,
     .free               = NULL
@@ -125,17 +125,21 @@ typedef struct
 
 typedef struct
 {
-    unsigned int id;
-    winlist      *ids;
+    unsigned int   id;
+    winlist        *ids;
     // Current window.
-    unsigned int index;
-    char         *cache;
-    unsigned int wmdn_len;
-    unsigned int clf_len;
-    unsigned int name_len;
-    unsigned int title_len;
-    unsigned int role_len;
-    GRegex       *window_regex;
+    unsigned int   index;
+    char           *cache;
+    unsigned int   wmdn_len;
+    unsigned int   clf_len;
+    unsigned int   name_len;
+    unsigned int   title_len;
+    unsigned int   role_len;
+    GRegex          *window_regex;
+    // The enabled fields of each window, joined for matching.
+    RofiMatchFields **match_fields;
+    // Prepared match strings, the joined fields of each window.
+    RofiMatchStore  *match_store;
 } ModeModePrivateData;
 
 winlist *cache_client = NULL;
@@ -363,47 +367,7 @@ static client* window_client ( ModeModePrivateData *pd, xcb_window_t win )
 static int window_match ( const Mode *sw, rofi_int_matcher **tokens, unsigned int index )
 {
     ModeModePrivateData *rmpd = (ModeModePrivateData *) mode_get_private_data ( sw );
-    int                 match = 1;
-    const winlist       *ids  = ( winlist * ) rmpd->ids;
-    // Want to pull directly out of cache, X calls are not thread safe.
-    int                 idx = winlist_find ( cache_client, ids->array[index] );
-    g_assert ( idx >= 0 );
-    client              *c = cache_client->data[idx];
-
-    if ( tokens ) {
-        for ( int j = 0; match && tokens != NULL && tokens[j] != NULL; j++ ) {
-            int test = 0;
-            // Dirty hack. Normally helper_token_match does _all_ the matching,
-            // Now we want it to match only one item at the time.
-            // If hack not in place it would not match queries spanning multiple fields.
-            // e.g. when searching 'title element' and 'class element'
-            rofi_int_matcher *ftokens[2] = { tokens[j], NULL };
-            if ( c->title != NULL && c->title[0] != '\0' && matching_window_fields[WIN_MATCH_FIELD_TITLE].enabled ) {
-                test = helper_token_match ( ftokens, c->title );
-            }
-
-            if ( test == tokens[j]->invert && c->class != NULL && c->class[0] != '\0' && matching_window_fields[WIN_MATCH_FIELD_CLASS].enabled ) {
-                test = helper_token_match ( ftokens, c->class );
-            }
-
-            if ( test == tokens[j]->invert && c->role != NULL && c->role[0] != '\0' && matching_window_fields[WIN_MATCH_FIELD_ROLE].enabled ) {
-                test = helper_token_match ( ftokens, c->role );
-            }
-
-            if ( test == tokens[j]->invert && c->name != NULL && c->name[0] != '\0' && matching_window_fields[WIN_MATCH_FIELD_NAME].enabled ) {
-                test = helper_token_match ( ftokens, c->name );
-            }
-            if ( test == tokens[j]->invert && c->wmdesktopstr != NULL && c->wmdesktopstr[0] != '\0' && matching_window_fields[WIN_MATCH_FIELD_DESKTOP].enabled ) {
-                test = helper_token_match ( ftokens, c->wmdesktopstr );
-            }
-
-            if ( test == 0 ) {
-                match = 0;
-            }
-        }
-    }
-
-    return match;
+    return helper_token_match_fields ( tokens, rmpd->match_fields[index], rmpd->match_store, index );
 }
 
 static void window_mode_parse_fields ()
@@ -587,6 +551,45 @@ static void _window_mode_load_data ( Mode *sw, unsigned int cd )
     }
     xcb_ewmh_get_windows_reply_wipe ( &clients );
 }
+
+/**
+ * @param field The field of the window.
+ * @param enabled If the field is enabled for matching (window-match-fields).
+ *
+ * @returns the field if it can be matched, NULL otherwise.
+ */
+static const char *window_match_field ( const char *field, gboolean enabled )
+{
+    return ( enabled && field != NULL && field[0] != '\0' ) ? field : NULL;
+}
+
+/**
+ * @param pd The private data of the mode.
+ *
+ * Join the fields enabled for matching of each window, so a token is matched against them all at once.
+ * Should be called after the fields are parsed.
+ */
+static void window_mode_match_fields ( ModeModePrivateData *pd )
+{
+    if ( pd->ids == NULL ) {
+        return;
+    }
+    pd->match_fields = g_malloc0_n ( pd->ids->len, sizeof ( RofiMatchFields * ) );
+    for ( unsigned int i = 0; i < (unsigned int) pd->ids->len; i++ ) {
+        // Want to pull directly out of cache, X calls are not thread safe.
+        int idx = winlist_find ( cache_client, pd->ids->array[i] );
+        g_assert ( idx >= 0 );
+        const client *c = cache_client->data[idx];
+        const char   *fields[WIN_MATCH_NUM_FIELDS];
+        fields[WIN_MATCH_FIELD_TITLE]   = window_match_field ( c->title, matching_window_fields[WIN_MATCH_FIELD_TITLE].enabled );
+        fields[WIN_MATCH_FIELD_CLASS]   = window_match_field ( c->class, matching_window_fields[WIN_MATCH_FIELD_CLASS].enabled );
+        fields[WIN_MATCH_FIELD_ROLE]    = window_match_field ( c->role, matching_window_fields[WIN_MATCH_FIELD_ROLE].enabled );
+        fields[WIN_MATCH_FIELD_NAME]    = window_match_field ( c->name, matching_window_fields[WIN_MATCH_FIELD_NAME].enabled );
+        fields[WIN_MATCH_FIELD_DESKTOP] = window_match_field ( c->wmdesktopstr, matching_window_fields[WIN_MATCH_FIELD_DESKTOP].enabled );
+        pd->match_fields[i]             = helper_match_fields_new ( fields, WIN_MATCH_NUM_FIELDS );
+    }
+    pd->match_store = rofi_match_store_new ( pd->ids->len, FALSE );
+}
 static int window_mode_init ( Mode *sw )
 {
     if ( mode_get_private_data ( sw ) == NULL ) {
@@ -597,6 +600,7 @@ static int window_mode_init ( Mode *sw )
         if ( !window_matching_fields_parsed ) {
             window_mode_parse_fields ();
         }
+        window_mode_match_fields ( pd );
     }
     return TRUE;
 }
@@ -610,6 +614,7 @@ static int window_mode_init_cd ( Mode *sw )
         if ( !window_matching_fields_parsed ) {
             window_mode_parse_fields ();
         }
+        window_mode_match_fields ( pd );
     }
     return TRUE;
 }
@@ -709,7 +714,12 @@ static void window_mode_destroy ( Mode *sw )
 {
     ModeModePrivateData *rmpd = (ModeModePrivateData *) mode_get_private_data ( sw );
     if ( rmpd != NULL ) {
+        for ( unsigned int i = 0; rmpd->match_fields != NULL && i < (unsigned int) rmpd->ids->len; i++ ) {
+            g_free ( rmpd->match_fields[i] );
+        }
+        g_free ( rmpd->match_fields );
         winlist_free ( rmpd->ids );
+        rofi_match_store_free ( rmpd->match_store );
         x11_cache_free ();
         g_free ( rmpd->cache );
         g_regex_unref ( rmpd->window_regex );
@@ -123,61 +123,101 @@ int helper_parse_setup ( char * string, char ***output, int *length, ... )
     return FALSE;
 }
 
+/** Number of compiled tokens kept for reuse by helper_tokenize(). */
+#define TOKEN_CACHE_SIZE    32
+
+/**
+ * A compiled token kept for reuse.
+ */
+typedef struct
+{
+    /** The text of the token, including the negate character. */
+    char             *text;
+    /** The matching method the token is compiled for. */
+    MatchingMethod   method;
+    /** If the token is compiled case sensitive. */
+    int              case_sensitive;
+    /** If the token is compiled without diacritics. */
+    gboolean         normalize;
+    /** The negate character the token is compiled with. */
+    char             negate_char;
+    /** The compiled token, the cache holds a reference. */
+    rofi_int_matcher *token;
+} TokenCacheEntry;
+
+/** The compiled tokens, most recently used first. */
+static GQueue token_cache = G_QUEUE_INIT;
+/** Lock for token_cache. */
+static GMutex token_cache_mutex;
+
+/**
+ * @param token The token to release.
+ *
+ * Drop a reference to the token, free it when it was the last one.
+ */
+static void helper_token_unref ( rofi_int_matcher *token )
+{
+    if ( g_atomic_int_dec_and_test ( &( token->refcount ) ) ) {
+        if ( token->lazy_regex != NULL ) {
+            g_regex_unref ( token->lazy_regex );
+        }
+        g_free ( token->pattern );
+        g_free ( token->literal );
+        g_free ( token->folded );
+        g_free ( token );
+    }
+}
+
+/**
+ * @param entry The TokenCacheEntry to free.
+ */
+static void helper_token_cache_entry_free ( TokenCacheEntry *entry )
+{
+    helper_token_unref ( entry->token );
+    g_free ( entry->text );
+    g_free ( entry );
+}
+
 void helper_tokenize_free ( rofi_int_matcher ** tokens )
 {
     for ( size_t i = 0; tokens && tokens[i]; i++ ) {
-        g_regex_unref ( (GRegex *) tokens[i]->regex );
-        g_free ( tokens[i] );
+        helper_token_unref ( tokens[i] );
     }
     g_free ( tokens );
 }
 
-static gchar *glob_to_regex ( const char *input )
+void helper_tokenize_cache_clear ( void )
 {
-    gchar  *r    = g_regex_escape_string ( input, -1 );
-    size_t str_l = strlen ( r );
-    for ( size_t i = 0; i < str_l; i++ ) {
-        if ( r[i] == '\\' ) {
-            if ( r[i + 1] == '*' ) {
-                r[i] = '.';
-            }
-            else if ( r[i + 1] == '?' ) {
-                r[i + 1] = 'S';
-            }
-            i++;
-        }
+    g_mutex_lock ( &token_cache_mutex );
+    while ( !g_queue_is_empty ( &token_cache ) ) {
+        helper_token_cache_entry_free ( g_queue_pop_head ( &token_cache ) );
     }
-    return r;
+    g_mutex_unlock ( &token_cache_mutex );
 }
-static gchar *fuzzy_to_regex ( const char * input )
+
+/**
+ * @param input The text of the token.
+ * @param case_sensitive Whether case is significant.
+ * @param glob If '*' and '?' are wildcards.
+ * @param len Set to the number of characters in the pattern.
+ *
+ * @returns the newly allocated pattern of a fuzzy or glob token.
+ */
+static gunichar *helper_token_pattern ( const char *input, int case_sensitive, gboolean glob, glong *len )
 {
-    GString *str = g_string_new ( "" );
-    gchar   *r   = g_regex_escape_string ( input, -1 );
-    gchar   *iter;
-    int     first = 1;
-    for ( iter = r; iter && *iter != '\0'; iter = g_utf8_next_char ( iter ) ) {
-        if ( first ) {
-            g_string_append ( str, "(" );
-        }
-        else {
-            g_string_append ( str, ".*(" );
+    size_t   folded_len = 0;
+    char     *str       = case_sensitive ? g_strdup ( input ) : rofi_match_fold ( input, -1, &folded_len, NULL );
+    gunichar *pattern   = g_utf8_to_ucs4_fast ( str, -1, len );
+    g_free ( str );
+    for ( glong i = 0; glob && i < *len; i++ ) {
+        if ( pattern[i] == '*' ) {
+            pattern[i] = ROFI_GLOB_ANY;
         }
-        if ( *iter == '\\' ) {
-            g_string_append_c ( str, '\\' );
-            iter = g_utf8_next_char ( iter );
-            // If EOL, break out of for loop.
-            if ( ( *iter ) == '\0' ) {
-                break;
-            }
+        else if ( pattern[i] == '?' ) {
+            pattern[i] = ROFI_GLOB_ONE;
         }
-        g_string_append_unichar ( str, g_utf8_get_char ( iter ) );
-        g_string_append ( str, ")" );
-        first = 0;
     }
-    g_free ( r );
-    char *retv = str->str;
-    g_string_free ( str, FALSE );
-    return retv;
+    return pattern;
 }
 
 // Macro for quickly generating regex for matching.
@@ -186,6 +226,39 @@ static inline GRegex * R ( const char *s, int case_sensitive  )
     return g_regex_new ( s, G_REGEX_OPTIMIZE | ( ( case_sensitive ) ? 0 : G_REGEX_CASELESS ), 0, NULL );
 }
 
+/**
+ * @param token The token to estimate.
+ * @param input The text of the token, without the negate character.
+ *
+ * Estimate the cost and hit rate of a token. Plain tokens are cheapest, ASCII ones more so.
+ * Every extra character makes a match less likely, fuzzy tokens add the least as the characters
+ * can be anywhere.
+ */
+static void helper_token_estimate ( rofi_int_matcher *token, const char *input )
+{
+    glong  len  = g_utf8_strlen ( input, -1 );
+    double step = 0.25;
+    if ( token->literal != NULL ) {
+        token->cost = token->literal_ascii ? 1.0 : 4.0;
+    }
+    else if ( token->pattern != NULL ) {
+        token->cost = 4.0;
+        if ( !token->glob ) {
+            step = 0.5;
+        }
+    }
+    else {
+        token->cost = 8.0;
+    }
+    token->hit_rate = 0.9;
+    for ( glong i = 1; i < len; i++ ) {
+        token->hit_rate *= step;
+    }
+    if ( token->invert ) {
+        token->hit_rate = 1.0 - token->hit_rate;
+    }
+}
+
 static rofi_int_matcher * create_regex ( const char *input, int case_sensitive )
 {
     GRegex           * retv = NULL;
@@ -195,12 +268,25 @@ static rofi_int_matcher * create_regex ( const char *input, int case_sensitive )
         rv->invert = 1;
         input++;
     }
+    if ( config.normalize_match && config.matching_method != MM_REGEX ) {
+        // The tokens and rows are folded without diacritics.
+        rv->normalize  = TRUE;
+        case_sensitive = FALSE;
+    }
+    rv->case_sensitive = case_sensitive;
     switch ( config.matching_method )
     {
     case MM_GLOB:
-        r    = glob_to_regex ( input );
-        retv = R ( r, case_sensitive );
-        g_free ( r );
+    case MM_FUZZY:
+        // Matched without the regex engine.
+        rv->glob    = ( config.matching_method == MM_GLOB );
+        rv->pattern = helper_token_pattern ( input, case_sensitive, rv->glob, &( rv->pattern_len ) );
+        for ( glong i = 0; !case_sensitive && i < rv->pattern_len; i++ ) {
+            if ( rv->pattern[i] != ROFI_GLOB_ANY && rv->pattern[i] != ROFI_GLOB_ONE ) {
+                char buf[6];
+                rv->bloom |= rofi_match_bloom ( buf, g_unichar_to_utf8 ( rv->pattern[i], buf ) );
+            }
+        }
         break;
     case MM_REGEX:
         retv = R ( input, case_sensitive );
@@ -210,20 +296,136 @@ static rofi_int_matcher * create_regex ( const char *input, int case_sensitive )
             g_free ( r );
         }
         break;
-    case MM_FUZZY:
-        r    = fuzzy_to_regex ( input );
-        retv = R ( r, case_sensitive );
-        g_free ( r );
-        break;
     default:
-        r    = g_regex_escape_string ( input, -1 );
-        retv = R ( r, case_sensitive );
-        g_free ( r );
+        // Plain substring, match it without the regex engine. The regex is only compiled when asked for.
+        rv->literal       = g_strdup ( input );
+        rv->literal_len   = strlen ( input );
+        rv->literal_ascii = TRUE;
+        for ( size_t i = 0; i < rv->literal_len; i++ ) {
+            if ( (unsigned char) input[i] >= 0x80 ) {
+                rv->literal_ascii = FALSE;
+                break;
+            }
+        }
+        if ( !case_sensitive ) {
+            rv->folded = rofi_match_fold ( input, rv->literal_len, &( rv->folded_len ), NULL );
+            rv->bloom  = rofi_match_bloom ( rv->folded, rv->folded_len );
+        }
         break;
     }
-    rv->regex = retv;
+    rv->lazy_regex    = retv;
+    rv->refcount = 1;
+    helper_token_estimate ( rv, input );
     return rv;
 }
+
+/** Lock for compiling the regex of a token on first use. */
+static GMutex token_regex_mutex;
+
+GRegex *helper_token_get_regex ( rofi_int_matcher *token )
+{
+    GRegex *regex = g_atomic_pointer_get ( &( token->lazy_regex ) );
+    if ( regex != NULL || token->literal == NULL ) {
+        return regex;
+    }
+    g_mutex_lock ( &token_regex_mutex );
+    regex = token->lazy_regex;
+    if ( regex == NULL ) {
+        char *r = g_regex_escape_string ( token->literal, token->literal_len );
+        regex = R ( r, token->case_sensitive );
+        g_free ( r );
+        g_atomic_pointer_set ( &( token->lazy_regex ), regex );
+    }
+    g_mutex_unlock ( &token_regex_mutex );
+    return regex;
+}
+
+/**
+ * @param input The text of the token.
+ * @param case_sensitive Whether case is significant.
+ *
+ * Get the compiled token for input. Tokens are kept for reuse, in a query that is typed most tokens
+ * stay the same between key presses and do not have to be compiled again.
+ *
+ * @returns a reference to the compiled token, release it with helper_tokenize_free().
+ */
+static rofi_int_matcher * helper_token_get ( const char *input, int case_sensitive )
+{
+    rofi_int_matcher *token = NULL;
+    g_mutex_lock ( &token_cache_mutex );
+    for ( GList *iter = token_cache.head; iter != NULL; iter = g_list_next ( iter ) ) {
+        TokenCacheEntry *e = (TokenCacheEntry *) iter->data;
+        if ( e->method == config.matching_method && e->case_sensitive == case_sensitive && e->normalize == config.normalize_match &&
+             e->negate_char == config.matching_negate_char && strcmp ( e->text, input ) == 0 ) {
+            // Move to the front, the least recently used are dropped first.
+            g_queue_unlink ( &token_cache, iter );
+            g_queue_push_head_link ( &token_cache, iter );
+            token = e->token;
+            break;
+        }
+    }
+    if ( token == NULL ) {
+        TokenCacheEntry *e = g_malloc ( sizeof ( TokenCacheEntry ) );
+        e->text           = g_strdup ( input );
+        e->method         = config.matching_method;
+        e->case_sensitive = case_sensitive;
+        e->normalize      = config.normalize_match;
+        e->negate_char    = config.matching_negate_char;
+        e->token          = token = create_regex ( input, case_sensitive );
+        g_queue_push_head ( &token_cache, e );
+        if ( g_queue_get_length ( &token_cache ) > TOKEN_CACHE_SIZE ) {
+            helper_token_cache_entry_free ( g_queue_pop_tail ( &token_cache ) );
+        }
+    }
+    g_atomic_int_inc ( &( token->refcount ) );
+    g_mutex_unlock ( &token_cache_mutex );
+    return token;
+}
+
+/**
+ * @param token The token.
+ * @param hit_rate The fraction of rows the token matches.
+ *
+ * @returns the expected cost of the token per row it rejects.
+ */
+static double helper_token_rank ( const rofi_int_matcher *token, double hit_rate )
+{
+    return token->cost / ( 1.0 - MIN ( hit_rate, 0.99 ) );
+}
+
+void helper_tokenize_sort ( rofi_int_matcher **tokens, double *hit_rates )
+{
+    if ( tokens == NULL ) {
+        return;
+    }
+    // Stable insertion sort, there are only a few tokens.
+    for ( int i = 1; tokens[i] != NULL; i++ ) {
+        rofi_int_matcher *token = tokens[i];
+        double           rate   = ( hit_rates != NULL ) ? hit_rates[i] : token->hit_rate;
+        int              j      = i;
+        for (; j > 0; j-- ) {
+            const rofi_int_matcher *prev      = tokens[j - 1];
+            double                 prev_rate = ( hit_rates != NULL ) ? hit_rates[j - 1] : prev->hit_rate;
+            if ( prev->invert != token->invert ) {
+                if ( !prev->invert ) {
+                    break;
+                }
+            }
+            else if ( helper_token_rank ( prev, prev_rate ) <= helper_token_rank ( token, rate ) ) {
+                break;
+            }
+            tokens[j] = tokens[j - 1];
+            if ( hit_rates != NULL ) {
+                hit_rates[j] = hit_rates[j - 1];
+            }
+        }
+        tokens[j] = token;
+        if ( hit_rates != NULL ) {
+            hit_rates[j] = rate;
+        }
+    }
+}
+
 rofi_int_matcher **helper_tokenize ( const char *input, int case_sensitive )
 {
     if ( input == NULL ) {
@@ -238,7 +440,7 @@ rofi_int_matcher **helper_tokenize ( const char *input, int case_sensitive )
     rofi_int_matcher **retv = NULL;
     if ( !config.tokenize ) {
         retv    = g_malloc0 ( sizeof ( rofi_int_matcher* ) * 2 );
-        retv[0] = create_regex ( input, case_sensitive );
+        retv[0] = helper_token_get ( input, case_sensitive );
         return retv;
     }
 
@@ -253,12 +455,14 @@ rofi_int_matcher **helper_tokenize ( const char *input, int case_sensitive )
     const char * const sep = " ";
     for ( token = strtok_r ( str, sep, &saveptr ); token != NULL; token = strtok_r ( NULL, sep, &saveptr ) ) {
         retv                 = g_realloc ( retv, sizeof ( rofi_int_matcher* ) * ( num_tokens + 2 ) );
-        retv[num_tokens]     = create_regex ( token, case_sensitive );
+        retv[num_tokens]     = helper_token_get ( token, case_sensitive );
         retv[num_tokens + 1] = NULL;
         num_tokens++;
     }
     // Free str.
     g_free ( str );
+    // Evaluate the cheapest, most selective, tokens first.
+    helper_tokenize_sort ( retv, NULL );
     return retv;
 }
 
@@ -367,100 +571,730 @@ char helper_parse_char ( const char *arg )
     return '\n';
 }
 
-int find_arg_char ( const char * const key, char *val )
+int find_arg_char ( const char * const key, char *val )
+{
+    int i = find_arg ( key );
+
+    if ( val != NULL && i > 0 && i < ( stored_argc - 1 ) ) {
+        *val = helper_parse_char ( stored_argv[i + 1] );
+        return TRUE;
+    }
+    return FALSE;
+}
+
+/**
+ * @param th The highlight style.
+ * @param start The start of the range (in bytes).
+ * @param end The end of the range (in bytes).
+ * @param retv The attribute list to add the attributes to.
+ *
+ * Add the attributes for the highlight style over the range.
+ */
+static void helper_token_match_add_pango_attr ( RofiHighlightColorStyle th, int start, int end, PangoAttrList *retv )
+{
+    if ( th.style & ROFI_HL_BOLD ) {
+        PangoAttribute *pa = pango_attr_weight_new ( PANGO_WEIGHT_BOLD );
+        pa->start_index = start;
+        pa->end_index   = end;
+        pango_attr_list_insert ( retv, pa );
+    }
+    if ( th.style & ROFI_HL_UNDERLINE ) {
+        PangoAttribute *pa = pango_attr_underline_new ( PANGO_UNDERLINE_SINGLE );
+        pa->start_index = start;
+        pa->end_index   = end;
+        pango_attr_list_insert ( retv, pa );
+    }
+    if ( th.style & ROFI_HL_STRIKETHROUGH ) {
+        PangoAttribute *pa = pango_attr_strikethrough_new ( TRUE );
+        pa->start_index = start;
+        pa->end_index   = end;
+        pango_attr_list_insert ( retv, pa );
+    }
+    if ( th.style & ROFI_HL_SMALL_CAPS ) {
+        PangoAttribute *pa = pango_attr_variant_new ( PANGO_VARIANT_SMALL_CAPS );
+        pa->start_index = start;
+        pa->end_index   = end;
+        pango_attr_list_insert ( retv, pa );
+    }
+    if ( th.style & ROFI_HL_ITALIC ) {
+        PangoAttribute *pa = pango_attr_style_new ( PANGO_STYLE_ITALIC );
+        pa->start_index = start;
+        pa->end_index   = end;
+        pango_attr_list_insert ( retv, pa );
+    }
+    if ( th.style & ROFI_HL_COLOR ) {
+        PangoAttribute *pa = pango_attr_foreground_new (
+            th.color.red * 65535,
+            th.color.green * 65535,
+            th.color.blue * 65535 );
+        pa->start_index = start;
+        pa->end_index   = end;
+        pango_attr_list_insert ( retv, pa );
+
+        if ( th.color.alpha < 1.0 ) {
+            pa              = pango_attr_foreground_alpha_new ( th.color.alpha * 65535 );
+            pa->start_index = start;
+            pa->end_index   = end;
+            pango_attr_list_insert ( retv, pa );
+        }
+    }
+}
+
+/**
+ * @param spans The array of (start, end) pairs to add to.
+ * @param start The start of the span (in bytes).
+ * @param end The end of the span (in bytes).
+ */
+static void helper_token_match_add_span ( GArray *spans, int start, int end )
+{
+    // Extend the previous span when they touch, e.g. for consecutive characters of a fuzzy token.
+    if ( spans->len > 0 && g_array_index ( spans, int, spans->len - 1 ) == start ) {
+        g_array_index ( spans, int, spans->len - 1 ) = end;
+        return;
+    }
+    int span[2] = { start, end };
+    g_array_append_vals ( spans, span, 2 );
+}
+
+/**
+ * @param p Pointer to the (valid UTF-8) character, moved past it.
+ * @param fold If the character should be case folded.
+ *
+ * @returns the character at p.
+ */
+static inline gunichar helper_next_char ( const char **p, gboolean fold )
+{
+    gunichar c;
+    if ( (unsigned char) **p < 0x80 ) {
+        c = (unsigned char) *( *p )++;
+    }
+    else {
+        c  = g_utf8_get_char ( *p );
+        *p = g_utf8_next_char ( *p );
+    }
+    return fold ? rofi_match_fold_char ( c ) : c;
+}
+
+/**
+ * @param c The character to find.
+ * @param p The start of the text to search.
+ * @param end The end of the text.
+ *
+ * @returns the first occurrence of c, NULL if not found.
+ */
+static inline const char *helper_find_char ( gunichar c, const char *p, const char *end )
+{
+    if ( c < 0x80 ) {
+        return memchr ( p, (int) c, end - p );
+    }
+    char buf[6];
+    int  l = g_unichar_to_utf8 ( c, buf );
+    return memmem ( p, end - p, buf, l );
+}
+
+/**
+ * @param token The fuzzy token.
+ * @param text The (valid UTF-8) text to match.
+ * @param len The length of text in bytes.
+ * @param fold If text still has to be case folded, FALSE if it is compared as is.
+ * @param spans If not NULL, the matched characters are added to it.
+ *
+ * Match the characters of the token in order, with anything in between, in one forward scan.
+ * When the text is compared as is, it skips ahead to each character with memchr()/memmem().
+ *
+ * @returns TRUE if the token matches.
+ */
+static gboolean helper_token_match_fuzzy ( const rofi_int_matcher *token, const char *text, size_t len, gboolean fold, GArray *spans )
+{
+    const char *p   = text;
+    const char *end = text + len;
+    glong      k    = 0;
+    if ( !fold ) {
+        for (; k < token->pattern_len; k++ ) {
+            const char *hit = helper_find_char ( token->pattern[k], p, end );
+            if ( hit == NULL ) {
+                return FALSE;
+            }
+            p = g_utf8_next_char ( hit );
+            if ( spans != NULL ) {
+                helper_token_match_add_span ( spans, hit - text, p - text );
+            }
+        }
+        return TRUE;
+    }
+    while ( k < token->pattern_len && p < end ) {
+        const char *start = p;
+        if ( helper_next_char ( &p, TRUE ) == token->pattern[k] ) {
+            if ( spans != NULL ) {
+                helper_token_match_add_span ( spans, start - text, p - text );
+            }
+            k++;
+        }
+    }
+    return k == token->pattern_len;
+}
+
+/**
+ * @param pattern The part of a glob pattern to match, without ROFI_GLOB_ANY.
+ * @param plen Number of characters in pattern.
+ * @param p The position in the text to match at.
+ * @param end The end of the text.
+ * @param fold If the text still has to be case folded.
+ *
+ * @returns the end of the match, NULL if pattern does not match at p.
+ */
+static const char *helper_glob_match_segment ( const gunichar *pattern, glong plen, const char *p, const char *end, gboolean fold )
+{
+    for ( glong i = 0; i < plen; i++ ) {
+        if ( p >= end ) {
+            return NULL;
+        }
+        gunichar c = helper_next_char ( &p, fold );
+        if ( pattern[i] == ROFI_GLOB_ONE ) {
+            if ( c < 0x80 && g_ascii_isspace ( c ) ) {
+                return NULL;
+            }
+        }
+        else if ( c != pattern[i] ) {
+            return NULL;
+        }
+    }
+    return p;
+}
+
+/**
+ * @param token The glob token.
+ * @param p The start of the line.
+ * @param end The end of the line.
+ * @param fold If the text still has to be case folded.
+ * @param mstart Set to the start of the match.
+ * @param mend Set to the end of the match.
+ *
+ * Match a glob token within a single line. The segments between the ROFI_GLOB_ANY wildcards are searched for
+ * one after the other. As a segment may start anywhere after the previous one, its first match is always the best.
+ * The match is as long as the greedy regex the token used to be translated to: a leading ROFI_GLOB_ANY starts it at p,
+ * a trailing one ends it at the end of the line and otherwise it ends at the last match of the last segment.
+ *
+ * @returns TRUE if the token matches.
+ */
+static gboolean helper_glob_match_line ( const rofi_int_matcher *token, const char *p, const char *end, gboolean fold, const char **mstart, const char **mend )
+{
+    const gunichar *pattern = token->pattern;
+    glong          n        = token->pattern_len;
+    const char     *start   = p;
+    *mstart = NULL;
+    *mend   = p;
+    for ( glong i = 0; i < n; ) {
+        if ( pattern[i] == ROFI_GLOB_ANY ) {
+            i++;
+            continue;
+        }
+        glong j = i;
+        while ( j < n && pattern[j] != ROFI_GLOB_ANY ) {
+            j++;
+        }
+        const char *q   = p;
+        const char *hit = NULL;
+        while ( TRUE ) {
+            if ( !fold && pattern[i] != ROFI_GLOB_ONE ) {
+                // Skip ahead to the first character of the segment.
+                q = helper_find_char ( pattern[i], q, end );
+                if ( q == NULL ) {
+                    return FALSE;
+                }
+            }
+            hit = helper_glob_match_segment ( pattern + i, j - i, q, end, fold );
+            if ( hit != NULL ) {
+                break;
+            }
+            if ( q >= end ) {
+                return FALSE;
+            }
+            q = g_utf8_next_char ( q );
+        }
+        if ( *mstart == NULL ) {
+            *mstart = q;
+        }
+        if ( j == n && i > 0 ) {
+            // The last segment after a wildcard, like '.*' take up to its last match.
+            for ( q = g_utf8_next_char ( q ); q < end; q = g_utf8_next_char ( q ) ) {
+                const char *later = helper_glob_match_segment ( pattern + i, j - i, q, end, fold );
+                if ( later != NULL ) {
+                    hit = later;
+                }
+            }
+        }
+        p     = hit;
+        *mend = hit;
+        i     = j;
+    }
+    if ( n > 0 && pattern[0] == ROFI_GLOB_ANY ) {
+        *mstart = start;
+    }
+    if ( n > 0 && pattern[n - 1] == ROFI_GLOB_ANY ) {
+        *mend = end;
+    }
+    if ( *mstart == NULL ) {
+        *mstart = *mend;
+    }
+    return TRUE;
+}
+
+/**
+ * @param token The glob token.
+ * @param text The (valid UTF-8) text to match.
+ * @param len The length of text in bytes.
+ * @param fold If text still has to be case folded, FALSE if it is compared as is.
+ * @param spans If not NULL, all (non overlapping) matches are added to it.
+ *
+ * Match a glob token. Like the regex it used to be translated to, a match does not span multiple lines.
+ *
+ * @returns TRUE if the token matches.
+ */
+static gboolean helper_token_match_glob ( const rofi_int_matcher *token, const char *text, size_t len, gboolean fold, GArray *spans )
+{
+    const char *end  = text + len;
+    const char *line = text;
+    gboolean   found = FALSE;
+    while ( TRUE ) {
+        const char *nl   = memchr ( line, '\n', end - line );
+        const char *lend = ( nl != NULL ) ? nl : end;
+        const char *p    = line;
+        const char *mstart, *mend;
+        while ( helper_glob_match_line ( token, p, lend, fold, &mstart, &mend ) ) {
+            if ( spans == NULL ) {
+                return TRUE;
+            }
+            found = TRUE;
+            if ( mend > mstart ) {
+                helper_token_match_add_span ( spans, mstart - text, mend - text );
+            }
+            if ( mend >= lend ) {
+                break;
+            }
+            // Continue after the match, at least one character further.
+            p = ( mend > p ) ? mend : g_utf8_next_char ( p );
+        }
+        if ( nl == NULL ) {
+            break;
+        }
+        line = nl + 1;
+    }
+    return found;
+}
+
+/**
+ * @param token The fuzzy or glob token.
+ * @param text The (valid UTF-8) text to match.
+ * @param len The length of text in bytes.
+ * @param fold If text still has to be case folded, FALSE if it is compared as is.
+ * @param spans If not NULL, the matched parts are added to it.
+ *
+ * @returns TRUE if the token matches.
+ */
+static gboolean helper_token_match_pattern ( const rofi_int_matcher *token, const char *text, size_t len, gboolean fold, GArray *spans )
+{
+    if ( token->glob ) {
+        return helper_token_match_glob ( token, text, len, fold, spans );
+    }
+    return helper_token_match_fuzzy ( token, text, len, fold, spans );
+}
+
+/**
+ * @param text The text to check.
+ * @param len The length of text in bytes.
+ *
+ * @returns TRUE if text only contains ASCII characters.
+ */
+static gboolean helper_is_ascii ( const char *text, size_t len )
+{
+    for ( size_t i = 0; i < len; i++ ) {
+        if ( (unsigned char) text[i] >= 0x80 ) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/**
+ * @param token The case insensitive token to match.
+ * @param input The string to match against.
+ * @param len The length of input in bytes.
+ * @param spans If not NULL, the matched parts of input are added to it.
+ *
+ * Match a case insensitive token against a string that is not prepared in a match store, by folding the
+ * string like the store does first. So a token gives the same result with or without a store.
+ *
+ * @returns TRUE if the token (ignoring invert) matches input.
+ */
+static gboolean helper_token_match_folded ( const rofi_int_matcher *token, const char *input, size_t len, GArray *spans )
+{
+    unsigned int *offsets = NULL;
+    size_t       flen     = 0;
+    char         *folded  = rofi_match_fold ( input, len, &flen, ( spans != NULL ) ? &offsets : NULL );
+    gboolean     found    = FALSE;
+    if ( token->pattern != NULL ) {
+        GArray *fspans = ( spans != NULL ) ? g_array_new ( FALSE, FALSE, sizeof ( int ) ) : NULL;
+        found = helper_token_match_pattern ( token, folded, flen, FALSE, fspans );
+        // Map the spans back to the original string.
+        for ( guint i = 0; fspans != NULL && i < fspans->len; i += 2 ) {
+            helper_token_match_add_span ( spans, offsets[g_array_index ( fspans, int, i )], offsets[g_array_index ( fspans, int, i + 1 )] );
+        }
+        if ( fspans != NULL ) {
+            g_array_free ( fspans, TRUE );
+        }
+    }
+    else {
+        found = memmem ( folded, flen, token->folded, token->folded_len ) != NULL;
+    }
+    g_free ( folded );
+    g_free ( offsets );
+    return found;
+}
+
+/**
+ * @param token The literal token to find.
+ * @param input The string to find the token in.
+ * @param spans The array of (start, end) pairs to add the occurrences to.
+ *
+ * Find all (non overlapping) occurrences of a literal token.
+ */
+static void helper_token_match_literal_spans ( const rofi_int_matcher *token, const char *input, GArray *spans )
+{
+    const char   *needle  = token->case_sensitive ? token->literal : token->folded;
+    size_t       nlen     = token->case_sensitive ? token->literal_len : token->folded_len;
+    size_t       len      = strlen ( input );
+    const char   *str     = input;
+    unsigned int *offsets = NULL;
+    char         *folded  = NULL;
+    if ( nlen == 0 ) {
+        return;
+    }
+    if ( !token->case_sensitive ) {
+        folded = rofi_match_fold ( input, len, &len, &offsets );
+        str    = folded;
+    }
+    size_t pos = 0;
+    while ( pos < len ) {
+        const char *hit = memmem ( str + pos, len - pos, needle, nlen );
+        if ( hit == NULL ) {
+            break;
+        }
+        size_t start = hit - str;
+        pos = start + nlen;
+        helper_token_match_add_span ( spans,
+                                      offsets ? offsets[start] : start,
+                                      offsets ? offsets[pos] : pos );
+    }
+    g_free ( folded );
+    g_free ( offsets );
+}
+
+int *helper_token_match_get_spans ( rofi_int_matcher**tokens, const char *input, unsigned int *num_spans )
+{
+    GArray *spans = g_array_new ( FALSE, FALSE, sizeof ( int ) );
+    // Do a tokenized match.
+    if ( tokens ) {
+        for ( int j = 0; tokens[j]; j++ ) {
+            GMatchInfo *gmi = NULL;
+            if ( tokens[j]->invert ) {
+                continue;
+            }
+            if ( tokens[j]->literal != NULL ) {
+                helper_token_match_literal_spans ( tokens[j], input, spans );
+                continue;
+            }
+            if ( tokens[j]->pattern != NULL ) {
+                size_t len = strlen ( input );
+                if ( !tokens[j]->case_sensitive && !helper_is_ascii ( input, len ) ) {
+                    helper_token_match_folded ( tokens[j], input, len, spans );
+                }
+                else {
+                    helper_token_match_pattern ( tokens[j], input, len, !tokens[j]->case_sensitive, spans );
+                }
+                continue;
+            }
+            g_regex_match ( tokens[j]->lazy_regex, input, G_REGEX_MATCH_PARTIAL, &gmi );
+            while ( g_match_info_matches ( gmi ) ) {
+                int count = g_match_info_get_match_count ( gmi );
+                for ( int index = ( count > 1 ) ? 1 : 0; index < count; index++ ) {
+                    int start, end;
+                    g_match_info_fetch_pos ( gmi, index, &start, &end );
+                    helper_token_match_add_span ( spans, start, end );
+                }
+                g_match_info_next ( gmi, NULL );
+            }
+            g_match_info_free ( gmi );
+        }
+    }
+    *num_spans = spans->len / 2;
+    return (int *) g_array_free ( spans, FALSE );
+}
+
+void helper_token_match_spans_pango_attr ( RofiHighlightColorStyle th, const int *spans, unsigned int num_spans, PangoAttrList *retv )
+{
+    for ( unsigned int i = 0; i < num_spans; i++ ) {
+        helper_token_match_add_pango_attr ( th, spans[2 * i], spans[2 * i + 1], retv );
+    }
+}
+
+PangoAttrList *helper_token_match_get_pango_attr ( RofiHighlightColorStyle th, rofi_int_matcher**tokens, const char *input, PangoAttrList *retv )
+{
+    unsigned int num_spans = 0;
+    int          *spans    = helper_token_match_get_spans ( tokens, input, &num_spans );
+    helper_token_match_spans_pango_attr ( th, spans, num_spans, retv );
+    g_free ( spans );
+    return retv;
+}
+
+/** Byte with all bits set to 1, multiply by a byte to repeat it in every byte of a word. */
+#define SWAR_ONES    0x0101010101010101ULL
+/** High bit of every byte in a word. */
+#define SWAR_HIGH    ( 0x80 * SWAR_ONES )
+/** Low 7 bits of every byte in a word. */
+#define SWAR_LOW     ( 0x7F * SWAR_ONES )
+
+/**
+ * @param w 8 bytes packed in a word.
+ *
+ * @returns w with every byte in the range A-Z converted to lower case.
+ */
+static inline guint64 swar_ascii_tolower ( guint64 w )
+{
+    guint64 low   = w & SWAR_LOW;
+    guint64 ge_a  = low + ( 0x80 - 'A' ) * SWAR_ONES;
+    guint64 gt_z  = low + ( 0x7F - 'Z' ) * SWAR_ONES;
+    guint64 upper = ge_a & ~gt_z & ~w & SWAR_HIGH;
+    return w | ( upper >> 2 );
+}
+
+/**
+ * @param w 8 bytes packed in a word.
+ *
+ * @returns a word with the high bit set for every byte in w that is 0.
+ */
+static inline guint64 swar_zero_bytes ( guint64 w )
+{
+    return ~( ( ( w & SWAR_LOW ) + SWAR_LOW ) | w ) & SWAR_HIGH;
+}
+
+/**
+ * @param haystack The string to search in.
+ * @param hlen The length of haystack in bytes.
+ * @param needle The ASCII string to search for.
+ * @param nlen The length of needle in bytes.
+ *
+ * Search for needle, ignoring the (ASCII) case. The haystack is scanned 8 bytes at a time
+ * for the first character of needle.
+ *
+ * @returns TRUE if needle is found.
+ */
+static gboolean helper_literal_find_ascii_caseless ( const char *haystack, size_t hlen, const char *needle, size_t nlen )
+{
+    if ( nlen == 0 ) {
+        return TRUE;
+    }
+    if ( hlen < nlen ) {
+        return FALSE;
+    }
+    const char    first = g_ascii_tolower ( needle[0] );
+    const guint64 fw    = (unsigned char) first * SWAR_ONES;
+    // Last possible start position + 1.
+    const size_t  end = hlen - nlen + 1;
+    size_t        i   = 0;
+    for (; ( i + 8 ) <= end; i += 8 ) {
+        guint64 w;
+        memcpy ( &w, haystack + i, sizeof ( w ) );
+        if ( swar_zero_bytes ( swar_ascii_tolower ( w ) ^ fw ) == 0 ) {
+            continue;
+        }
+        for ( size_t k = i; k < ( i + 8 ); k++ ) {
+            if ( g_ascii_tolower ( haystack[k] ) == first && g_ascii_strncasecmp ( haystack + k + 1, needle + 1, nlen - 1 ) == 0 ) {
+                return TRUE;
+            }
+        }
+    }
+    for (; i < end; i++ ) {
+        if ( g_ascii_tolower ( haystack[i] ) == first && g_ascii_strncasecmp ( haystack + i + 1, needle + 1, nlen - 1 ) == 0 ) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/**
+ * @param token The literal token to match.
+ * @param input The string to match against.
+ * @param len The length of input in bytes.
+ *
+ * @returns TRUE if the token is a substring of input.
+ */
+static gboolean helper_token_match_literal ( const rofi_int_matcher *token, const char *input, size_t len )
+{
+    if ( token->case_sensitive ) {
+        return memmem ( input, len, token->literal, token->literal_len ) != NULL;
+    }
+    if ( helper_is_ascii ( input, len ) ) {
+        // Folding ASCII only lowers the case, so only a token that folds to ASCII can match.
+        return helper_is_ascii ( token->folded, token->folded_len ) &&
+               helper_literal_find_ascii_caseless ( input, len, token->folded, token->folded_len );
+    }
+    return helper_token_match_folded ( token, input, len, NULL );
+}
+
+/**
+ * @param token The token to match.
+ * @param input The string to match against.
+ * @param len The length of input in bytes.
+ *
+ * Match a token with the engine for its kind, without a match store.
+ *
+ * @returns TRUE if the token (ignoring invert) matches input.
+ */
+static gboolean helper_token_match_text ( const rofi_int_matcher *token, const char *input, size_t len )
+{
+    if ( token->literal != NULL ) {
+        return helper_token_match_literal ( token, input, len );
+    }
+    if ( token->pattern != NULL ) {
+        if ( !token->case_sensitive && !helper_is_ascii ( input, len ) ) {
+            return helper_token_match_folded ( token, input, len, NULL );
+        }
+        return helper_token_match_pattern ( token, input, len, !token->case_sensitive, NULL );
+    }
+    return g_regex_match_full ( token->lazy_regex, input, len, 0, 0, NULL, NULL );
+}
+
+/** Number of rows rejected on the bloom of a token, per thread. */
+static GPrivate helper_bloom_rejects = G_PRIVATE_INIT ( NULL );
+
+/**
+ * Count a row rejected on the bloom of a token, for the calling thread.
+ */
+static inline void helper_bloom_rejects_add ( void )
+{
+    guint n = GPOINTER_TO_UINT ( g_private_get ( &helper_bloom_rejects ) );
+    g_private_set ( &helper_bloom_rejects, GUINT_TO_POINTER ( n + 1 ) );
+}
+
+unsigned int helper_token_match_take_bloom_rejects ( void )
 {
-    int i = find_arg ( key );
+    guint n = GPOINTER_TO_UINT ( g_private_get ( &helper_bloom_rejects ) );
+    g_private_set ( &helper_bloom_rejects, NULL );
+    return n;
+}
 
-    if ( val != NULL && i > 0 && i < ( stored_argc - 1 ) ) {
-        *val = helper_parse_char ( stored_argv[i + 1] );
-        return TRUE;
-    }
-    return FALSE;
+int helper_token_match_store ( rofi_int_matcher* const *tokens, const char *input, RofiMatchStore *store, unsigned int slot )
+{
+    return helper_token_match_len ( tokens, input, strlen ( input ), store, slot );
 }
 
-PangoAttrList *helper_token_match_get_pango_attr ( RofiHighlightColorStyle th, rofi_int_matcher**tokens, const char *input, PangoAttrList *retv )
+int helper_token_match_len ( rofi_int_matcher* const *tokens, const char *input, size_t len, RofiMatchStore *store, unsigned int slot )
 {
+    int                   match = TRUE;
+    const RofiMatchString *ms   = NULL;
     // Do a tokenized match.
     if ( tokens ) {
-        for ( int j = 0; tokens[j]; j++ ) {
-            GMatchInfo *gmi = NULL;
-            if ( tokens[j]->invert ) {
-                continue;
-            }
-            g_regex_match ( tokens[j]->regex, input, G_REGEX_MATCH_PARTIAL, &gmi );
-            while ( g_match_info_matches ( gmi ) ) {
-                int count = g_match_info_get_match_count ( gmi );
-                for ( int index = ( count > 1 ) ? 1 : 0; index < count; index++ ) {
-                    int start, end;
-                    g_match_info_fetch_pos ( gmi, index, &start, &end );
-                    if ( th.style & ROFI_HL_BOLD ) {
-                        PangoAttribute *pa = pango_attr_weight_new ( PANGO_WEIGHT_BOLD );
-                        pa->start_index = start;
-                        pa->end_index   = end;
-                        pango_attr_list_insert ( retv, pa );
-                    }
-                    if ( th.style & ROFI_HL_UNDERLINE ) {
-                        PangoAttribute *pa = pango_attr_underline_new ( PANGO_UNDERLINE_SINGLE );
-                        pa->start_index = start;
-                        pa->end_index   = end;
-                        pango_attr_list_insert ( retv, pa );
-                    }
-                    if ( th.style & ROFI_HL_STRIKETHROUGH ) {
-                        PangoAttribute *pa = pango_attr_strikethrough_new ( TRUE );
-                        pa->start_index = start;
-                        pa->end_index   = end;
-                        pango_attr_list_insert ( retv, pa );
-                    }
-                    if ( th.style & ROFI_HL_SMALL_CAPS ) {
-                        PangoAttribute *pa = pango_attr_variant_new ( PANGO_VARIANT_SMALL_CAPS );
-                        pa->start_index = start;
-                        pa->end_index   = end;
-                        pango_attr_list_insert ( retv, pa );
-                    }
-                    if ( th.style & ROFI_HL_ITALIC ) {
-                        PangoAttribute *pa = pango_attr_style_new ( PANGO_STYLE_ITALIC );
-                        pa->start_index = start;
-                        pa->end_index   = end;
-                        pango_attr_list_insert ( retv, pa );
-                    }
-                    if ( th.style & ROFI_HL_COLOR ) {
-                        PangoAttribute *pa = pango_attr_foreground_new (
-                            th.color.red * 65535,
-                            th.color.green * 65535,
-                            th.color.blue * 65535 );
-                        pa->start_index = start;
-                        pa->end_index   = end;
-                        pango_attr_list_insert ( retv, pa );
-
-                        if ( th.color.alpha < 1.0 ) {
-                            pa              = pango_attr_foreground_alpha_new ( th.color.alpha * 65535 );
-                            pa->start_index = start;
-                            pa->end_index   = end;
-                            pango_attr_list_insert ( retv, pa );
-                        }
-                    }
+        for ( int j = 0; match && tokens[j]; j++ ) {
+            const rofi_int_matcher *token = tokens[j];
+            // Case insensitive tokens match against the folded text in the store.
+            if ( store != NULL && ( token->folded != NULL || ( token->pattern != NULL && !token->case_sensitive ) ) ) {
+                if ( ms == NULL ) {
+                    ms = rofi_match_store_get ( store, slot, input, len );
                 }
-                g_match_info_next ( gmi, NULL );
             }
-            g_match_info_free ( gmi );
+            if ( ms != NULL && ( token->bloom & ~( ms->bloom ) ) != 0 ) {
+                // The row lacks a character of the token.
+                match = FALSE;
+                helper_bloom_rejects_add ();
+            }
+            else if ( ms != NULL && token->folded != NULL ) {
+                match = memmem ( ms->folded, ms->folded_len, token->folded, token->folded_len ) != NULL;
+            }
+            else if ( ms != NULL && token->pattern != NULL && !token->case_sensitive ) {
+                match = helper_token_match_pattern ( token, ms->folded, ms->folded_len, FALSE, NULL );
+            }
+            else {
+                match = helper_token_match_text ( token, input, len );
+            }
+            match ^= token->invert;
         }
     }
-    return retv;
+    return match;
 }
 
-int helper_token_match ( rofi_int_matcher* const *tokens, const char *input )
+RofiMatchFields *helper_match_fields_new ( const char * const *fields, unsigned int num_fields )
 {
-    int match = TRUE;
-    // Do a tokenized match.
-    if ( tokens ) {
-        for ( int j = 0; match && tokens[j]; j++ ) {
-            match  = g_regex_match ( tokens[j]->regex, input, 0, NULL );
-            match ^= tokens[j]->invert;
+    size_t       len = 0;
+    unsigned int n   = 0;
+    for ( unsigned int i = 0; i < num_fields; i++ ) {
+        if ( fields[i] != NULL ) {
+            len += strlen ( fields[i] ) + 1;
+            n++;
+        }
+    }
+    // One allocation for the struct, the offsets and the text.
+    RofiMatchFields *mf = g_malloc ( sizeof ( RofiMatchFields ) + ( n + 1 ) * sizeof ( unsigned int ) + len + 1 );
+    mf->offsets    = (unsigned int *) ( mf + 1 );
+    mf->text       = (char *) ( mf->offsets + n + 1 );
+    mf->len        = len;
+    mf->num_fields = n;
+    len            = 0;
+    n              = 0;
+    for ( unsigned int i = 0; i < num_fields; i++ ) {
+        if ( fields[i] != NULL ) {
+            size_t l = strlen ( fields[i] );
+            mf->offsets[n++] = len;
+            memcpy ( mf->text + len, fields[i], l );
+            mf->text[len + l] = ROFI_MATCH_FIELD_SEPARATOR;
+            len              += l + 1;
+        }
+    }
+    mf->offsets[n] = len;
+    mf->text[len]  = '\0';
+    return mf;
+}
+
+int helper_token_match_fields ( rofi_int_matcher* const *tokens, const RofiMatchFields *fields, RofiMatchStore *store, unsigned int slot )
+{
+    int                   match = TRUE;
+    const RofiMatchString *ms   = NULL;
+    for ( int j = 0; match && tokens != NULL && tokens[j] != NULL; j++ ) {
+        const rofi_int_matcher *token = tokens[j];
+        gboolean               found  = FALSE;
+        if ( fields == NULL || fields->num_fields == 0 ) {
+            found = FALSE;
+        }
+        else if ( token->literal != NULL && memchr ( token->literal, ROFI_MATCH_FIELD_SEPARATOR, token->literal_len ) == NULL ) {
+            // The token does not contain the separator, so it can only be found within a field.
+            if ( token->folded != NULL && store != NULL && ms == NULL ) {
+                ms = rofi_match_store_get ( store, slot, fields->text, fields->len );
+            }
+            if ( token->folded != NULL && ms != NULL ) {
+                found = memmem ( ms->folded, ms->folded_len, token->folded, token->folded_len ) != NULL;
+            }
+            else {
+                found = helper_token_match_literal ( token, fields->text, fields->len );
+            }
+        }
+        else {
+            // Other tokens can match across the separator, match them against each field.
+            for ( unsigned int i = 0; !found && i < fields->num_fields; i++ ) {
+                const char *field = fields->text + fields->offsets[i];
+                size_t     flen   = fields->offsets[i + 1] - fields->offsets[i] - 1;
+                found = helper_token_match_text ( token, field, flen );
+            }
         }
+        match = found ^ token->invert;
     }
     return match;
 }
 
+int helper_token_match ( rofi_int_matcher* const *tokens, const char *input )
+{
+    return helper_token_match_store ( tokens, input, NULL, 0 );
+}
+
 int execute_generator ( const char * cmd )
 {
     char **args = NULL;
@@ -549,11 +1383,16 @@ gboolean helper_validate_font ( PangoFontDescription *pfd, const char *font )
  *
  * This functions exits the program with 1 when it finds an invalid configuration.
  */
-int config_sanity_check ( void )
+/**
+ * @param msg The message to append the errors to.
+ *
+ * Look up the sorting and matching method from their names in the configuration.
+ *
+ * @returns TRUE if a name is invalid.
+ */
+static int config_sanity_check_methods ( GString *msg )
 {
-    int     found_error = FALSE;
-    GString *msg        = g_string_new (
-        "<big><b>The configuration failed to validate:</b></big>\n" );
+    int found_error = FALSE;
 
     if ( config.sorting_method ) {
         if ( g_strcmp0 ( config.sorting_method, "normal" ) == 0 ) {
@@ -591,6 +1430,14 @@ int config_sanity_check ( void )
             found_error = 1;
         }
     }
+    return found_error;
+}
+
+int config_sanity_check ( void )
+{
+    GString *msg        = g_string_new (
+        "<big><b>The configuration failed to validate:</b></big>\n" );
+    int     found_error = config_sanity_check_methods ( msg );
 
     if ( config.element_height < 1 ) {
         g_string_append_printf ( msg, "\t<b>config.element_height</b>=%d is invalid. An element needs to be atleast 1 line high.\n",
@@ -661,6 +1508,21 @@ int config_sanity_check ( void )
     return FALSE;
 }
 
+int config_sanity_check_headless ( void )
+{
+    GString *msg        = g_string_new ( NULL );
+    int     found_error = config_sanity_check_methods ( msg );
+    if ( found_error ) {
+        char *text = NULL;
+        if ( pango_parse_markup ( msg->str, -1, 0, NULL, &text, NULL, NULL ) ) {
+            g_warning ( "The configuration failed to validate:\n%s", text );
+            g_free ( text );
+        }
+    }
+    g_string_free ( msg, TRUE );
+    return found_error;
+}
+
 char *rofi_expand_path ( const char *input )
 {
     char **str = g_strsplit ( input, G_DIR_SEPARATOR_S, -1 );
@@ -691,42 +1553,233 @@ char *rofi_expand_path ( const char *input )
     return retv;
 }
 
-/** Return the minimum value of a,b,c */
-#define MIN3( a, b, c )    ( ( a ) < ( b ) ? ( ( a ) < ( c ) ? ( a ) : ( c ) ) : ( ( b ) < ( c ) ? ( b ) : ( c ) ) )
+/** Number of pattern characters handled per bit-vector word. */
+#define LEVENSHTEIN_WORD_BITS    64
 
-unsigned int levenshtein ( const char *needle, const glong needlelen, const char *haystack, const glong haystacklen )
+/**
+ * Pattern of the bit-parallel levenshtein distance, see levenshtein_pattern_new().
+ */
+struct _RofiLevenshteinPattern
+{
+    /** Number of codepoints in the pattern. */
+    glong        len;
+    /** Number of words in a match vector. */
+    glong        words;
+    /** If the pattern (and haystack) characters are case folded. */
+    gboolean     fold;
+    /** Match vectors, words per row. Row 0 (all zero) is for characters not in the pattern. */
+    guint64      *peq;
+    /** Row in peq for each ASCII character. */
+    unsigned int ascii[128];
+    /** Sorted non-ASCII characters in the pattern. */
+    gunichar     *chars;
+    /** Row in peq for each entry in chars. */
+    unsigned int *rows;
+    /** Number of entries in chars. */
+    unsigned int num_chars;
+};
+
+/**
+ * @param c The character.
+ *
+ * Case fold a character like the plain levenshtein() did, so the distances do not change.
+ *
+ * @returns the folded character.
+ */
+static inline gunichar levenshtein_fold_char ( gunichar c )
+{
+    if ( c < 0x80 ) {
+        return ( c >= 'A' && c <= 'Z' ) ? ( c + ( 'a' - 'A' ) ) : c;
+    }
+    return g_unichar_tolower ( c );
+}
+
+/**
+ * @param pat The pattern.
+ * @param c The (folded) character.
+ *
+ * @returns the row in the match vectors for c.
+ */
+static inline unsigned int levenshtein_pattern_row ( const RofiLevenshteinPattern *pat, gunichar c )
+{
+    if ( c < 128 ) {
+        return pat->ascii[c];
+    }
+    unsigned int lo = 0, hi = pat->num_chars;
+    while ( lo < hi ) {
+        unsigned int mid = ( lo + hi ) / 2;
+        if ( pat->chars[mid] < c ) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+    return ( lo < pat->num_chars && pat->chars[lo] == c ) ? pat->rows[lo] : 0;
+}
+
+RofiLevenshteinPattern *levenshtein_pattern_new ( const gunichar *needle, const glong needlelen )
+{
+    RofiLevenshteinPattern *pat = g_malloc0 ( sizeof ( RofiLevenshteinPattern ) );
+    pat->len   = needlelen;
+    pat->words = ( needlelen + LEVENSHTEIN_WORD_BITS - 1 ) / LEVENSHTEIN_WORD_BITS;
+    pat->fold  = !config.case_sensitive;
+
+    // Collect the distinct non-ASCII characters, one row each.
+    gunichar *folded = g_new ( gunichar, needlelen + 1 );
+    for ( glong i = 0; i < needlelen; i++ ) {
+        folded[i] = pat->fold ? levenshtein_fold_char ( needle[i] ) : needle[i];
+    }
+    unsigned int num_rows = 1;
+    pat->chars = g_new ( gunichar, needlelen + 1 );
+    pat->rows  = g_new ( unsigned int, needlelen + 1 );
+    for ( glong i = 0; i < needlelen; i++ ) {
+        gunichar c = folded[i];
+        if ( c < 128 ) {
+            if ( pat->ascii[c] == 0 ) {
+                pat->ascii[c] = num_rows++;
+            }
+            continue;
+        }
+        // Insertion sort, patterns are short.
+        unsigned int k = pat->num_chars;
+        while ( k > 0 && pat->chars[k - 1] > c ) {
+            k--;
+        }
+        if ( k > 0 && pat->chars[k - 1] == c ) {
+            continue;
+        }
+        memmove ( &( pat->chars[k + 1] ), &( pat->chars[k] ), ( pat->num_chars - k ) * sizeof ( gunichar ) );
+        memmove ( &( pat->rows[k + 1] ), &( pat->rows[k] ), ( pat->num_chars - k ) * sizeof ( unsigned int ) );
+        pat->chars[k] = c;
+        pat->rows[k]  = num_rows++;
+        pat->num_chars++;
+    }
+    // Set bit i in the row of the character at position i.
+    pat->peq = g_new0 ( guint64, num_rows * MAX ( 1, pat->words ) );
+    for ( glong i = 0; i < needlelen; i++ ) {
+        unsigned int row = levenshtein_pattern_row ( pat, folded[i] );
+        pat->peq[row * pat->words + i / LEVENSHTEIN_WORD_BITS] |= G_GUINT64_CONSTANT ( 1 ) << ( i % LEVENSHTEIN_WORD_BITS );
+    }
+    g_free ( folded );
+    return pat;
+}
+
+void levenshtein_pattern_free ( RofiLevenshteinPattern *pat )
+{
+    if ( pat == NULL ) {
+        return;
+    }
+    g_free ( pat->peq );
+    g_free ( pat->chars );
+    g_free ( pat->rows );
+    g_free ( pat );
+}
+
+/**
+ * @param eq The match vector of the haystack character.
+ * @param pv The positive vertical deltas, updated.
+ * @param mv The negative vertical deltas, updated.
+ * @param hin The horizontal delta (-1, 0, 1) entering the block at the top.
+ * @param last Mask of the bit of the last row in the block.
+ *
+ * Advance one block of the bit-parallel (Myers/Hyyrö) levenshtein column by one haystack character.
+ *
+ * @returns the horizontal delta leaving the block at row last.
+ */
+static inline int levenshtein_block ( guint64 eq, guint64 *pv, guint64 *mv, int hin, guint64 last )
+{
+    guint64 xv  = eq | *mv;
+    guint64 neg = ( hin < 0 ) ? 1 : 0;
+    eq |= neg;
+    guint64 xh = ( ( ( eq & *pv ) + *pv ) ^ *pv ) | eq;
+    guint64 ph = *mv | ~( xh | *pv );
+    guint64 mh = *pv & xh;
+    int     hout = ( ph & last ) ? 1 : ( ( mh & last ) ? -1 : 0 );
+    ph  = ( ph << 1 ) | ( ( hin > 0 ) ? 1 : 0 );
+    mh  = ( mh << 1 ) | neg;
+    *pv = mh | ~( xv | ph );
+    *mv = ph & xv;
+    return hout;
+}
+
+unsigned int levenshtein_pattern_distance ( const RofiLevenshteinPattern *pat, const gunichar *haystack, const glong haystacklen )
+{
+    if ( pat->len == 0 ) {
+        return haystacklen;
+    }
+    // Bits above the last row only hold garbage, it never moves down.
+    guint64      last  = G_GUINT64_CONSTANT ( 1 ) << ( ( pat->len - 1 ) % LEVENSHTEIN_WORD_BITS );
+    unsigned int score = pat->len;
+    if ( pat->words == 1 ) {
+        guint64 pv = ~G_GUINT64_CONSTANT ( 0 );
+        guint64 mv = 0;
+        for ( glong x = 0; x < haystacklen; x++ ) {
+            gunichar c = pat->fold ? levenshtein_fold_char ( haystack[x] ) : haystack[x];
+            score += levenshtein_block ( pat->peq[levenshtein_pattern_row ( pat, c )], &pv, &mv, 1, last );
+        }
+        return score;
+    }
+    guint64 pv[pat->words];
+    guint64 mv[pat->words];
+    for ( glong b = 0; b < pat->words; b++ ) {
+        pv[b] = ~G_GUINT64_CONSTANT ( 0 );
+        mv[b] = 0;
+    }
+    const guint64 high = G_GUINT64_CONSTANT ( 1 ) << ( LEVENSHTEIN_WORD_BITS - 1 );
+    for ( glong x = 0; x < haystacklen; x++ ) {
+        gunichar      c   = pat->fold ? levenshtein_fold_char ( haystack[x] ) : haystack[x];
+        const guint64 *eq = &( pat->peq[levenshtein_pattern_row ( pat, c ) * pat->words] );
+        // The first row of the distance matrix grows by one every column.
+        int           h = 1;
+        for ( glong b = 0; b < pat->words - 1; b++ ) {
+            h = levenshtein_block ( eq[b], &pv[b], &mv[b], h, high );
+        }
+        score += levenshtein_block ( eq[pat->words - 1], &pv[pat->words - 1], &mv[pat->words - 1], h, last );
+    }
+    return score;
+}
+
+unsigned int levenshtein_ucs ( const gunichar *needle, const glong needlelen, const gunichar *haystack, const glong haystacklen )
 {
     if ( needlelen == G_MAXLONG ) {
         // String to long, we cannot handle this.
         return UINT_MAX;
     }
-    unsigned int column[needlelen + 1];
-    for ( glong y = 0; y < needlelen; y++ ) {
-        column[y] = y;
-    }
-    // Removed out of the loop, otherwise static code analyzers think it is unset.. silly but true.
-    // old loop: for ( glong y = 0; y <= needlelen; y++)
-    column[needlelen] = needlelen;
-    for ( glong x = 1; x <= haystacklen; x++ ) {
-        const char *needles = needle;
-        column[0] = x;
-        gunichar   haystackc = g_utf8_get_char ( haystack );
-        if ( !config.case_sensitive ) {
-            haystackc = g_unichar_tolower ( haystackc );
-        }
-        for ( glong y = 1, lastdiag = x - 1; y <= needlelen; y++ ) {
-            gunichar needlec = g_utf8_get_char ( needles );
-            if ( !config.case_sensitive ) {
-                needlec = g_unichar_tolower ( needlec );
-            }
-            unsigned int olddiag = column[y];
-            column[y] = MIN3 ( column[y] + 1, column[y - 1] + 1, lastdiag + ( needlec == haystackc ? 0 : 1 ) );
-            lastdiag  = olddiag;
-            needles   = g_utf8_next_char ( needles );
-        }
-        haystack = g_utf8_next_char ( haystack );
+    RofiLevenshteinPattern *pat  = levenshtein_pattern_new ( needle, needlelen );
+    unsigned int           retv = levenshtein_pattern_distance ( pat, haystack, haystacklen );
+    levenshtein_pattern_free ( pat );
+    return retv;
+}
+
+/**
+ * @param str The (valid UTF-8) string to decode.
+ * @param len The number of characters to decode.
+ *
+ * @returns a newly allocated array with the codepoints of the first len characters of str.
+ */
+static gunichar *helper_utf8_decode ( const char *str, glong len )
+{
+    gunichar *retv = g_new ( gunichar, len + 1 );
+    for ( glong i = 0; i < len; i++, str = g_utf8_next_char ( str ) ) {
+        retv[i] = g_utf8_get_char ( str );
+    }
+    retv[len] = 0;
+    return retv;
+}
+
+unsigned int levenshtein ( const char *needle, const glong needlelen, const char *haystack, const glong haystacklen )
+{
+    if ( needlelen == G_MAXLONG ) {
+        // String to long, we cannot handle this.
+        return UINT_MAX;
     }
-    return column[needlelen];
+    gunichar     *n   = helper_utf8_decode ( needle, needlelen );
+    gunichar     *h   = helper_utf8_decode ( haystack, haystacklen );
+    unsigned int retv = levenshtein_ucs ( n, needlelen, h, haystacklen );
+    g_free ( n );
+    g_free ( h );
+    return retv;
 }
 
 char * rofi_latin_to_utf8_strdup ( const char *input, gssize length )
@@ -778,8 +1831,10 @@ char * rofi_force_utf8 ( const gchar *data, ssize_t length )
  * FZF like scorer
  */
 
-/** Max length of input to score. */
+/** Max length of input to score with the full dynamic programming when pattern is not a subsequence of it. */
 #define FUZZY_SCORER_MAX_LENGTH         256
+/** Max number of cells the banded dynamic programming visits, above this the greedy alignment is scored. */
+#define FUZZY_SCORER_MAX_WORK           ( 64 * 1024 )
 /** minimum score */
 #define MIN_SCORE                       ( INT_MIN / 2 )
 /** Leading gap score */
@@ -856,13 +1911,199 @@ static int rofi_scorer_get_score_for ( enum CharClass prev, enum CharClass curr
     return 0;
 }
 
+struct _RofiFuzzyPattern
+{
+    /** The (case folded) pattern characters, without the white space. */
+    gunichar *chars;
+    /** Multiplier of the character score for each of chars. */
+    int      *multiplier;
+    /** Number of entries in chars. */
+    glong    len;
+    /** If the pattern is matched case sensitive. */
+    gboolean case_sensitive;
+};
+
+/**
+ * Per thread scratch space of the scorer, so scoring a row does not allocate.
+ */
+typedef struct
+{
+    /** The dp row. */
+    int   *dp;
+    /** Size of dp. */
+    glong dp_size;
+    /** First position of each pattern character in the band. */
+    glong *lo;
+    /** Last position of each pattern character in the band. */
+    glong *hi;
+    /** Size of lo and hi. */
+    glong band_size;
+} RofiScorerScratch;
+
+static void rofi_scorer_scratch_free ( gpointer data )
+{
+    RofiScorerScratch *scratch = (RofiScorerScratch *) data;
+    g_free ( scratch->dp );
+    g_free ( scratch->lo );
+    g_free ( scratch->hi );
+    g_free ( scratch );
+}
+
+/** Scratch space of the calling thread. */
+static GPrivate rofi_scorer_scratch = G_PRIVATE_INIT ( rofi_scorer_scratch_free );
+
+/**
+ * @param dp_size The needed size of the dp row.
+ * @param band_size The needed size of the band.
+ *
+ * @returns the scratch space of the calling thread, large enough for dp_size and band_size.
+ */
+static RofiScorerScratch *rofi_scorer_scratch_get ( glong dp_size, glong band_size )
+{
+    RofiScorerScratch *scratch = g_private_get ( &rofi_scorer_scratch );
+    if ( scratch == NULL ) {
+        scratch = g_malloc0 ( sizeof ( RofiScorerScratch ) );
+        g_private_set ( &rofi_scorer_scratch, scratch );
+    }
+    if ( dp_size > scratch->dp_size ) {
+        scratch->dp_size = MAX ( dp_size, scratch->dp_size * 2 );
+        scratch->dp      = g_renew ( int, scratch->dp, scratch->dp_size );
+    }
+    if ( band_size > scratch->band_size ) {
+        scratch->band_size = MAX ( band_size, scratch->band_size * 2 );
+        scratch->lo        = g_renew ( glong, scratch->lo, scratch->band_size );
+        scratch->hi        = g_renew ( glong, scratch->hi, scratch->band_size );
+    }
+    return scratch;
+}
+
+RofiFuzzyPattern *rofi_scorer_fuzzy_pattern_new ( const gunichar *pattern, glong plen )
+{
+    RofiFuzzyPattern *pat = g_malloc0 ( sizeof ( RofiFuzzyPattern ) );
+    pat->chars          = g_new ( gunichar, plen + 1 );
+    pat->multiplier     = g_new ( int, plen + 1 );
+    pat->case_sensitive = config.case_sensitive;
+    // whether the start of a word in pattern
+    gboolean pstart = TRUE;
+    for ( glong pi = 0; pi < plen; pi++ ) {
+        gunichar pc = pattern[pi];
+        if ( g_unichar_isspace ( pc ) ) {
+            pstart = TRUE;
+            continue;
+        }
+        pat->chars[pat->len]      = pat->case_sensitive ? pc : rofi_match_fold_char ( pc );
+        pat->multiplier[pat->len] = pstart ? PATTERN_START_MULTIPLIER : PATTERN_NON_START_MULTIPLIER;
+        pat->len++;
+        pstart = FALSE;
+    }
+    return pat;
+}
+
+void rofi_scorer_fuzzy_pattern_free ( RofiFuzzyPattern *pat )
+{
+    if ( pat == NULL ) {
+        return;
+    }
+    g_free ( pat->chars );
+    g_free ( pat->multiplier );
+    g_free ( pat );
+}
+
+/**
+ * @param pat The pattern.
+ * @param pc  The pattern character.
+ * @param sc  The input character.
+ *
+ * @returns TRUE if pc matches sc.
+ */
+static inline gboolean rofi_scorer_char_equal ( const RofiFuzzyPattern *pat, gunichar pc, gunichar sc )
+{
+    return pat->case_sensitive ? pc == sc : pc == rofi_match_fold_char ( sc );
+}
+
+/**
+ * @param pat The pattern.
+ * @param str The input.
+ * @param slen Length of str.
+ * @param lo If not NULL, set to the position of each pattern character in the leftmost alignment.
+ *
+ * Scalar subsequence scan, it stops as soon as the rest of str is shorter than the rest of the pattern.
+ *
+ * @returns the number of pattern characters found in order, pat->len if the pattern is a subsequence of str.
+ */
+static glong rofi_scorer_fuzzy_leftmost ( const RofiFuzzyPattern *pat, const gunichar *str, glong slen, glong *lo )
+{
+    glong pi = 0;
+    for ( glong si = 0; pi < pat->len && ( slen - si ) >= ( pat->len - pi ); si++ ) {
+        if ( rofi_scorer_char_equal ( pat, pat->chars[pi], str[si] ) ) {
+            if ( lo != NULL ) {
+                lo[pi] = si;
+            }
+            pi++;
+        }
+    }
+    return pi;
+}
+
+gboolean rofi_scorer_fuzzy_pattern_is_subsequence ( const RofiFuzzyPattern *pat, const gunichar *str, glong slen )
+{
+    return rofi_scorer_fuzzy_leftmost ( pat, str, slen, NULL ) == pat->len;
+}
+
+/**
+ * @param str The input.
+ * @param si  The position in str.
+ *
+ * @returns the score of the character at si, see rofi_scorer_get_score_for.
+ */
+static inline int rofi_scorer_position_score ( const gunichar *str, glong si )
+{
+    enum CharClass prev = ( si > 0 ) ? rofi_scorer_get_character_class ( str[si - 1] ) : NON_WORD;
+    return rofi_scorer_get_score_for ( prev, rofi_scorer_get_character_class ( str[si] ) );
+}
+
+/**
+ * @param value The score.
+ *
+ * @returns value clamped to the range of the dynamic programming.
+ */
+static inline int rofi_scorer_clamp ( gint64 value )
+{
+    return (int) CLAMP ( value, MIN_SCORE, -MIN_SCORE );
+}
+
+/**
+ * @param pat The pattern.
+ * @param str The input.
+ * @param slen Length of str.
+ * @param lo The first position of each pattern character in the leftmost alignment.
+ *
+ * Score the single (leftmost) alignment, used when the band is too wide to do the dynamic programming.
+ *
+ * @returns the (negated) score.
+ */
+static int rofi_scorer_fuzzy_evaluate_greedy ( const RofiFuzzyPattern *pat, const gunichar *str, glong slen, const glong *lo )
+{
+    gint64 value = (gint64) LEADING_GAP_SCORE * lo[0] + rofi_scorer_position_score ( str, lo[0] ) * pat->multiplier[0];
+    for ( glong pi = 1; pi < pat->len; pi++ ) {
+        int t = rofi_scorer_position_score ( str, lo[pi] ) * pat->multiplier[pi];
+        if ( lo[pi] == lo[pi - 1] + 1 ) {
+            value = MAX ( value + CONSECUTIVE_SCORE, value + t );
+        }
+        else {
+            value = value + (gint64) GAP_SCORE * ( lo[pi] - lo[pi - 1] - 1 ) + t;
+        }
+    }
+    value += (gint64) GAP_SCORE * ( slen - 1 - lo[pat->len - 1] );
+    return -rofi_scorer_clamp ( value );
+}
+
 /**
- * @param pattern   The user input to match against.
- * @param plen      Pattern length.
+ * @param pat       The prepared user input to match against.
  * @param str       The input to match against pattern.
  * @param slen      Length of str.
  *
- *  rofi_scorer_fuzzy_evaluate implements a global sequence alignment algorithm to find the maximum accumulated score by
+ *  rofi_scorer_fuzzy_pattern_evaluate implements a global sequence alignment algorithm to find the maximum accumulated score by
  *  aligning `pattern` to `str`. It applies when `pattern` is a subsequence of `str`.
  *
  *  Scoring criteria
@@ -881,51 +2122,78 @@ static int rofi_scorer_get_score_for ( enum CharClass prev, enum CharClass curr
  *  The first dimension can be suppressed since we do not need a matching scheme, which reduces the space complexity from
  *  O(N*M) to O(M)
  *
+ *  Only the band of cells between the leftmost and rightmost alignment of each pattern character is evaluated.
+ *  When that band is too large (FUZZY_SCORER_MAX_WORK) the leftmost alignment is scored instead, so any length of
+ *  `str` is scored with bounded work. Scratch space is kept per thread, scoring does not allocate.
+ *  Inputs longer than FUZZY_SCORER_MAX_LENGTH that `pattern` is not a subsequence of are rejected by a scalar
+ *  subsequence scan before any scoring.
+ *
  * @returns the sorting weight.
  */
-int rofi_scorer_fuzzy_evaluate ( const char *pattern, glong plen, const char *str, glong slen )
+int rofi_scorer_fuzzy_pattern_evaluate ( const RofiFuzzyPattern *pat, const gunichar *str, glong slen )
 {
-    if ( slen > FUZZY_SCORER_MAX_LENGTH ) {
+    glong pi, si;
+    glong n = pat->len;
+    if ( n == 0 || slen == 0 ) {
         return -MIN_SCORE;
     }
-    glong    pi, si;
-    // whether we are aligning the first character of pattern
-    gboolean pfirst = TRUE;
-    // whether the start of a word in pattern
-    gboolean pstart = TRUE;
-    // score for each position
-    int      *score = g_malloc_n ( slen, sizeof ( int ) );
-    // dp[i]: maximum value by aligning pattern[0..pi] to str[0..si]
-    int      *dp = g_malloc_n ( slen, sizeof ( int ) );
-    // uleft: value of the upper left cell; ulefts: maximum value of uleft and cells on the left. The arbitrary initial
-    // values suppress warnings.
-    int            uleft = 0, ulefts = 0, left, lefts;
-    const gchar    *pit = pattern, *sit;
-    enum CharClass prev = NON_WORD;
-    for ( si = 0, sit = str; si < slen; si++, sit = g_utf8_next_char ( sit ) ) {
-        enum CharClass cur = rofi_scorer_get_character_class ( g_utf8_get_char ( sit ) );
-        score[si] = rofi_scorer_get_score_for ( prev, cur );
-        prev      = cur;
-        dp[si]    = MIN_SCORE;
-    }
-    for ( pi = 0; pi < plen; pi++, pit = g_utf8_next_char ( pit ) ) {
-        gunichar pc = g_utf8_get_char ( pit ), sc;
-        if ( g_unichar_isspace ( pc ) ) {
-            pstart = TRUE;
-            continue;
+    RofiScorerScratch *scratch = rofi_scorer_scratch_get ( 0, n );
+    glong             *lo      = scratch->lo;
+    glong             *hi      = scratch->hi;
+    // Subsequence prefilter, it finds the leftmost alignment on the way.
+    gboolean subsequence = ( rofi_scorer_fuzzy_leftmost ( pat, str, slen, lo ) == n );
+    if ( !subsequence && slen > FUZZY_SCORER_MAX_LENGTH ) {
+        // Not a subsequence, it would not get a real score.
+        return -MIN_SCORE;
+    }
+    /**
+     * Only cells between the leftmost and the rightmost alignment of a pattern character can be part of a full alignment.
+     * Find those bounds greedily and restrict the dynamic programming to that band.
+     */
+    if ( subsequence ) {
+        for ( si = slen - 1, pi = n - 1; pi >= 0; si-- ) {
+            if ( rofi_scorer_char_equal ( pat, pat->chars[pi], str[si] ) ) {
+                hi[pi--] = si;
+            }
+        }
+        glong work = hi[0] - lo[0] + 1;
+        for ( pi = 1; pi < n; pi++ ) {
+            work += hi[pi] - lo[pi - 1] + 1;
+        }
+        if ( work > FUZZY_SCORER_MAX_WORK ) {
+            return rofi_scorer_fuzzy_evaluate_greedy ( pat, str, slen, lo );
+        }
+    }
+    else {
+        // Not a subsequence, do the full dynamic programming so short inputs keep their (low) ordering.
+        for ( pi = 0; pi < n; pi++ ) {
+            lo[pi] = 0;
+            hi[pi] = slen - 1;
+        }
+    }
+
+    // dp[si - base]: maximum value by aligning pattern[0..pi] to str[0..si]
+    glong base = lo[0];
+    scratch = rofi_scorer_scratch_get ( hi[n - 1] - base + 1, n );
+    int   *dp = scratch->dp - base;
+    for ( si = base; si <= hi[n - 1]; si++ ) {
+        dp[si] = MIN_SCORE;
+    }
+    for ( si = lo[0]; si <= hi[0]; si++ ) {
+        if ( rofi_scorer_char_equal ( pat, pat->chars[0], str[si] ) ) {
+            int t = rofi_scorer_position_score ( str, si ) * pat->multiplier[0];
+            dp[si] = rofi_scorer_clamp ( (gint64) LEADING_GAP_SCORE * si + t );
         }
-        lefts = MIN_SCORE;
-        for ( si = 0, sit = str; si < slen; si++, sit = g_utf8_next_char ( sit ) ) {
+    }
+    for ( pi = 1; pi < n; pi++ ) {
+        // uleft: value of the upper left cell; ulefts: maximum value of uleft and cells on the left.
+        int uleft = MIN_SCORE, ulefts = MIN_SCORE, left, lefts = MIN_SCORE;
+        for ( si = lo[pi - 1]; si <= hi[pi]; si++ ) {
             left  = dp[si];
             lefts = MAX ( lefts + GAP_SCORE, left );
-            sc    = g_utf8_get_char ( sit );
-            if ( config.case_sensitive
-                 ? pc == sc
-                 : g_unichar_tolower ( pc ) == g_unichar_tolower ( sc ) ) {
-                int t = score[si] * ( pstart ? PATTERN_START_MULTIPLIER : PATTERN_NON_START_MULTIPLIER );
-                dp[si] = pfirst
-                         ? LEADING_GAP_SCORE * si + t
-                         : MAX ( uleft + CONSECUTIVE_SCORE, ulefts + t );
+            if ( si >= lo[pi] && rofi_scorer_char_equal ( pat, pat->chars[pi], str[si] ) ) {
+                int t = rofi_scorer_position_score ( str, si ) * pat->multiplier[pi];
+                dp[si] = MAX ( uleft + CONSECUTIVE_SCORE, ulefts + t );
             }
             else {
                 dp[si] = MIN_SCORE;
@@ -933,15 +2201,31 @@ int rofi_scorer_fuzzy_evaluate ( const char *pattern, glong plen, const char *st
             uleft  = left;
             ulefts = lefts;
         }
-        pfirst = pstart = FALSE;
     }
-    lefts = MIN_SCORE;
-    for ( si = 0; si < slen; si++ ) {
+    int lefts = MIN_SCORE;
+    for ( si = lo[n - 1]; si <= hi[n - 1]; si++ ) {
         lefts = MAX ( lefts + GAP_SCORE, dp[si] );
     }
-    g_free ( score );
-    g_free ( dp );
-    return -lefts;
+    // The trailing gap.
+    return -rofi_scorer_clamp ( (gint64) lefts + (gint64) GAP_SCORE * ( slen - 1 - hi[n - 1] ) );
+}
+
+int rofi_scorer_fuzzy_evaluate_ucs ( const gunichar *pattern, glong plen, const gunichar *str, glong slen )
+{
+    RofiFuzzyPattern *pat  = rofi_scorer_fuzzy_pattern_new ( pattern, plen );
+    int              retv = rofi_scorer_fuzzy_pattern_evaluate ( pat, str, slen );
+    rofi_scorer_fuzzy_pattern_free ( pat );
+    return retv;
+}
+
+int rofi_scorer_fuzzy_evaluate ( const char *pattern, glong plen, const char *str, glong slen )
+{
+    gunichar *p   = helper_utf8_decode ( pattern, plen );
+    gunichar *s   = helper_utf8_decode ( str, slen );
+    int      retv = rofi_scorer_fuzzy_evaluate_ucs ( p, plen, s, slen );
+    g_free ( p );
+    g_free ( s );
+    return retv;
 }
 
 /**
@@ -1199,51 +2483,59 @@ void parse_ranges ( char *input, rofi_range_pair **list, unsigned int *length )
  * calls flush on the file descriptor.
  */
 void rofi_output_formatted_line ( const char *format, const char *string, int selected_line, const char *filter )
+{
+    GString *str = g_string_new ( NULL );
+    rofi_append_formatted_line ( str, format, string, selected_line, filter );
+    fwrite ( str->str, 1, str->len, stdout );
+    fflush ( stdout );
+    g_string_free ( str, TRUE );
+}
+
+void rofi_append_formatted_line ( GString *str, const char *format, const char *string, int selected_line, const char *filter )
 {
     for ( int i = 0; format && format[i]; i++ ) {
         if ( format[i] == 'i' ) {
-            fprintf ( stdout, "%d", selected_line );
+            g_string_append_printf ( str, "%d", selected_line );
         }
         else if ( format[i] == 'd' ) {
-            fprintf ( stdout, "%d", ( selected_line + 1 ) );
+            g_string_append_printf ( str, "%d", ( selected_line + 1 ) );
         }
         else if ( format[i] == 's' ) {
-            fputs ( string, stdout );
+            g_string_append ( str, string );
         }
         else if ( format[i] == 'p' ) {
             char *esc = NULL;
             pango_parse_markup ( string, -1, 0, NULL, &esc, NULL, NULL );
             if ( esc ) {
-                fputs ( esc, stdout );
+                g_string_append ( str, esc );
                 g_free ( esc );
             }
             else {
-                fputs ( "invalid string", stdout );
+                g_string_append ( str, "invalid string" );
             }
         }
         else if ( format[i] == 'q' ) {
             char *quote = g_shell_quote ( string );
-            fputs ( quote, stdout );
+            g_string_append ( str, quote );
             g_free ( quote );
         }
         else if ( format[i] == 'f' ) {
             if ( filter ) {
-                fputs ( filter, stdout );
+                g_string_append ( str, filter );
             }
         }
         else if ( format[i] == 'F' ) {
             if ( filter ) {
                 char *quote = g_shell_quote ( filter );
-                fputs ( quote, stdout );
+                g_string_append ( str, quote );
                 g_free ( quote );
             }
         }
         else {
-            fputc ( format[i], stdout );
+            g_string_append_c ( str, format[i] );
         }
     }
-    fputc ( '\n', stdout );
-    fflush ( stdout );
+    g_string_append_c ( str, '\n' );
 }
 
 static gboolean helper_eval_cb2 ( const GMatchInfo *info, GString *res, gpointer data )
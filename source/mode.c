@@ -94,6 +94,31 @@ char * mode_get_completion ( const Mode *mode, unsigned int selected_line )
     }
 }
 
+const char * mode_get_sort_key ( const Mode *mode, unsigned int selected_line, gssize *length )
+{
+    g_assert ( mode != NULL );
+    *length = -1;
+    if ( mode->_get_sort_key != NULL ) {
+        return mode->_get_sort_key ( mode, selected_line, length );
+    }
+    return NULL;
+}
+
+gboolean mode_has_match_text ( const Mode *mode )
+{
+    g_assert ( mode != NULL );
+    return mode->_get_match_text != NULL;
+}
+
+char * mode_get_match_text ( const Mode *mode, unsigned int selected_line )
+{
+    g_assert ( mode != NULL );
+    if ( mode->_get_match_text != NULL ) {
+        return mode->_get_match_text ( mode, selected_line );
+    }
+    return NULL;
+}
+
 ModeMode mode_result ( Mode *mode, int menu_retv, char **input, unsigned int selected_line )
 {
     g_assert ( mode != NULL );
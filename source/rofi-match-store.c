@@ -0,0 +1,434 @@
+/*
+ * rofi
+ *
+ * MIT/X11 License
+ * Copyright © 2013-2020 Qball Cow <qball@gmpclient.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+/** The log domain of this Helper. */
+#define G_LOG_DOMAIN    "Helpers.MatchStore"
+
+#include <config.h>
+#include <string.h>
+#include <glib.h>
+
+#include "rofi-match-store.h"
+#include "rofi-types.h"
+#include "settings.h"
+
+struct _RofiMatchStore
+{
+    /** The prepared strings, NULL if not prepared (yet). */
+    RofiMatchString **slots;
+    /** Number of slots. */
+    unsigned int    num_slots;
+    /** If the codepoints are stored. */
+    gboolean        codepoints;
+    /** Set when a string did not fit in the memory limit. */
+    volatile gint   full;
+    /** Memory used by the prepared strings in this store. */
+    volatile gsize  size;
+};
+
+/** Memory used by the prepared strings in all stores. */
+static volatile gsize match_store_total_size = 0;
+
+/**
+ * @param text The text to check.
+ * @param len The length of text in bytes.
+ *
+ * @returns TRUE if text only contains ASCII characters.
+ */
+static gboolean rofi_match_is_ascii ( const char *text, size_t len )
+{
+    for ( size_t i = 0; i < len; i++ ) {
+        if ( (unsigned char) text[i] >= 0x80 ) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/**
+ * @param c The character to check.
+ *
+ * @returns TRUE if c can be composed with the character(s) before it.
+ */
+static inline gboolean rofi_match_is_continuation ( gunichar c )
+{
+    // Hangul jamo vowels and trailing consonants compose with the (leading consonant) starter before them.
+    return g_unichar_combining_class ( c ) != 0 || ( c >= 0x1160 && c <= 0x11FF );
+}
+
+/**
+ * Growing array of decoded codepoints.
+ */
+typedef struct
+{
+    /** The codepoints. */
+    gunichar     *ucs;
+    /** For each codepoint the byte offset it originates from, NULL if not requested. */
+    unsigned int *src;
+    /** Number of codepoints. */
+    glong        len;
+    /** Allocated size. */
+    glong        size;
+} RofiMatchDecoded;
+
+static void rofi_match_decoded_append ( RofiMatchDecoded *d, gunichar c, unsigned int offset, gboolean with_src )
+{
+    if ( d->len == d->size ) {
+        d->size = MAX ( 16, d->size * 2 );
+        d->ucs  = g_renew ( gunichar, d->ucs, d->size );
+        if ( with_src ) {
+            d->src = g_renew ( unsigned int, d->src, d->size );
+        }
+    }
+    d->ucs[d->len] = c;
+    if ( with_src ) {
+        d->src[d->len] = offset;
+    }
+    d->len++;
+}
+
+/**
+ * @param d The array to append to.
+ * @param c The (NFC normalized) character to append.
+ * @param offset The byte offset c originates from.
+ * @param with_src If the source offsets should be stored.
+ *
+ * Append a character. With normalize-match it is decomposed and the diacritics (non spacing marks) are dropped,
+ * the remaining characters all originate from offset.
+ */
+static void rofi_match_decoded_add ( RofiMatchDecoded *d, gunichar c, unsigned int offset, gboolean with_src )
+{
+    if ( !config.normalize_match || c < 0x80 ) {
+        rofi_match_decoded_append ( d, c, offset, with_src );
+        return;
+    }
+    gunichar decomp[G_UNICHAR_MAX_DECOMPOSITION_LENGTH];
+    gsize    n = g_unichar_fully_decompose ( c, FALSE, decomp, G_UNICHAR_MAX_DECOMPOSITION_LENGTH );
+    for ( gsize i = 0; i < n; i++ ) {
+        if ( g_unichar_type ( decomp[i] ) != G_UNICODE_NON_SPACING_MARK ) {
+            rofi_match_decoded_append ( d, decomp[i], offset, with_src );
+        }
+    }
+}
+
+/**
+ * @param text The (non ASCII) text to decode.
+ * @param len The length of text in bytes.
+ * @param d The array to append the codepoints to.
+ * @param with_src If the source offsets should be stored.
+ *
+ * Decode text into NFC normalized codepoints. Text that is already normalized is decoded as is, otherwise each
+ * starter with the characters composing with it is normalized on its own, so every codepoint can be mapped back.
+ * Invalid UTF-8 bytes are decoded as the replacement character.
+ * With normalize-match the diacritics are removed, see rofi_match_decoded_add().
+ */
+static void rofi_match_decode ( const char *text, size_t len, RofiMatchDecoded *d, gboolean with_src )
+{
+    const char *end  = text + len;
+    char       *norm = g_utf8_normalize ( text, len, G_NORMALIZE_NFC );
+    if ( norm == NULL || ( strlen ( norm ) == len && memcmp ( norm, text, len ) == 0 ) ) {
+        for ( const char *p = text; p < end; ) {
+            gunichar c = g_utf8_get_char_validated ( p, end - p );
+            if ( c == (gunichar) -1 || c == (gunichar) -2 ) {
+                rofi_match_decoded_append ( d, 0xFFFD, p - text, with_src );
+                p++;
+                continue;
+            }
+            rofi_match_decoded_add ( d, c, p - text, with_src );
+            p = g_utf8_next_char ( p );
+        }
+        g_free ( norm );
+        return;
+    }
+    g_free ( norm );
+    // Valid UTF-8, that is not normalized.
+    for ( const char *p = text; p < end; ) {
+        const char *q = g_utf8_next_char ( p );
+        while ( q < end && rofi_match_is_continuation ( g_utf8_get_char ( q ) ) ) {
+            q = g_utf8_next_char ( q );
+        }
+        char *cluster = g_utf8_normalize ( p, q - p, G_NORMALIZE_NFC );
+        for ( const char *c = cluster; c && *c; c = g_utf8_next_char ( c ) ) {
+            rofi_match_decoded_add ( d, g_utf8_get_char ( c ), p - text, with_src );
+        }
+        g_free ( cluster );
+        p = q;
+    }
+}
+
+char *rofi_match_fold ( const char *text, gssize len, size_t *folded_len, unsigned int **offsets )
+{
+    size_t slen = ( len < 0 ) ? strlen ( text ) : (size_t) len;
+    if ( rofi_match_is_ascii ( text, slen ) ) {
+        char *retv = g_malloc ( slen + 1 );
+        for ( size_t i = 0; i < slen; i++ ) {
+            retv[i] = g_ascii_tolower ( text[i] );
+        }
+        retv[slen] = '\0';
+        if ( offsets != NULL ) {
+            *offsets = g_new ( unsigned int, slen + 1 );
+            for ( size_t i = 0; i <= slen; i++ ) {
+                ( *offsets )[i] = i;
+            }
+        }
+        *folded_len = slen;
+        return retv;
+    }
+
+    RofiMatchDecoded d    = { NULL, NULL, 0, 0 };
+    GString          *str = g_string_sized_new ( slen + 1 );
+    GArray           *map = offsets ? g_array_sized_new ( FALSE, FALSE, sizeof ( unsigned int ), slen + 1 ) : NULL;
+    rofi_match_decode ( text, slen, &d, offsets != NULL );
+    for ( glong i = 0; i < d.len; i++ ) {
+        gsize l = str->len;
+        g_string_append_unichar ( str, rofi_match_fold_char ( d.ucs[i] ) );
+        for (; map && l < str->len; l++ ) {
+            g_array_append_val ( map, d.src[i] );
+        }
+    }
+    if ( map ) {
+        unsigned int last = slen;
+        g_array_append_val ( map, last );
+        *offsets = (unsigned int *) g_array_free ( map, FALSE );
+    }
+    g_free ( d.ucs );
+    g_free ( d.src );
+    *folded_len = str->len;
+    return g_string_free ( str, FALSE );
+}
+
+/**
+ * @param c The byte.
+ *
+ * @returns the bit of c in the bloom.
+ */
+static inline guint64 rofi_match_bloom_bit ( guchar c )
+{
+    if ( c >= 'a' && c <= 'z' ) {
+        return G_GUINT64_CONSTANT ( 1 ) << ( c - 'a' );
+    }
+    if ( c >= '0' && c <= '9' ) {
+        return G_GUINT64_CONSTANT ( 1 ) << ( 26 + c - '0' );
+    }
+    return G_GUINT64_CONSTANT ( 1 ) << ( 36 + c % 28 );
+}
+
+guint64 rofi_match_bloom ( const char *text, size_t len )
+{
+    guint64 bloom = 0;
+    for ( size_t i = 0; i < len; i++ ) {
+        bloom |= rofi_match_bloom_bit ( text[i] );
+    }
+    return bloom;
+}
+
+/**
+ * @param text The (non ASCII) text to decode.
+ * @param len The length of text in bytes.
+ * @param ucs If not NULL, set to the codepoints.
+ *
+ * Decode text as is, without normalizing it. Invalid UTF-8 bytes are decoded as the replacement character.
+ *
+ * @returns the number of codepoints in text.
+ */
+static glong rofi_match_decode_raw ( const char *text, size_t len, gunichar *ucs )
+{
+    const char *end = text + len;
+    glong      n    = 0;
+    for ( const char *p = text; p < end; n++ ) {
+        gunichar c = g_utf8_get_char_validated ( p, end - p );
+        if ( c == (gunichar) -1 || c == (gunichar) -2 ) {
+            c = 0xFFFD;
+            p++;
+        }
+        else {
+            p = g_utf8_next_char ( p );
+        }
+        if ( ucs != NULL ) {
+            ucs[n] = c;
+        }
+    }
+    return n;
+}
+
+/**
+ * @param text The (UTF-8) text to prepare.
+ * @param len The length of text in bytes.
+ * @param codepoints If the codepoints should be stored.
+ * @param size Set to the number of bytes allocated.
+ *
+ * Prepare a string, the strings and codepoints are allocated in the same block.
+ *
+ * @returns a newly allocated RofiMatchString.
+ */
+static RofiMatchString *rofi_match_string_build ( const char *text, size_t len, gboolean codepoints, gsize *size )
+{
+    RofiMatchString *ms = NULL;
+    if ( rofi_match_is_ascii ( text, len ) ) {
+        *size = sizeof ( RofiMatchString ) + ( codepoints ? len * sizeof ( gunichar ) : 0 ) + len + 1;
+        ms    = g_malloc ( *size );
+        gunichar *ucs    = (gunichar *) ( ms + 1 );
+        char     *folded = (char *) ( ucs + ( codepoints ? len : 0 ) );
+        guint64  bloom   = 0;
+        for ( size_t i = 0; i < len; i++ ) {
+            folded[i] = g_ascii_tolower ( text[i] );
+            bloom    |= rofi_match_bloom_bit ( folded[i] );
+            if ( codepoints ) {
+                ucs[i] = (unsigned char) text[i];
+            }
+        }
+        folded[len]    = '\0';
+        ms->folded     = folded;
+        ms->folded_len = len;
+        ms->ucs        = codepoints ? ucs : NULL;
+        ms->ucs_len    = len;
+        ms->bloom      = bloom;
+        return ms;
+    }
+    RofiMatchDecoded d          = { NULL, NULL, 0, 0 };
+    size_t           folded_len = 0;
+    rofi_match_decode ( text, len, &d, FALSE );
+    for ( glong i = 0; i < d.len; i++ ) {
+        folded_len += g_unichar_to_utf8 ( rofi_match_fold_char ( d.ucs[i] ), NULL );
+    }
+    // The scorers get the codepoints as is, like they did before there was a store, not the normalized ones.
+    glong ucs_len = codepoints ? rofi_match_decode_raw ( text, len, NULL ) : 0;
+    *size = sizeof ( RofiMatchString ) + ucs_len * sizeof ( gunichar ) + folded_len + 1;
+    ms    = g_malloc ( *size );
+    gunichar *ucs    = (gunichar *) ( ms + 1 );
+    char     *folded = (char *) ( ucs + ucs_len );
+    char     *iter   = folded;
+    for ( glong i = 0; i < d.len; i++ ) {
+        iter += g_unichar_to_utf8 ( rofi_match_fold_char ( d.ucs[i] ), iter );
+    }
+    if ( codepoints ) {
+        rofi_match_decode_raw ( text, len, ucs );
+    }
+    *iter          = '\0';
+    ms->folded     = folded;
+    ms->folded_len = folded_len;
+    ms->ucs        = codepoints ? ucs : NULL;
+    ms->ucs_len    = ucs_len;
+    ms->bloom      = rofi_match_bloom ( folded, folded_len );
+    g_free ( d.ucs );
+    return ms;
+}
+
+RofiMatchString *rofi_match_string_new ( const char *text, gboolean codepoints )
+{
+    gsize size = 0;
+    text = text ? text : "";
+    return rofi_match_string_build ( text, strlen ( text ), codepoints, &size );
+}
+
+void rofi_match_string_free ( RofiMatchString *ms )
+{
+    g_free ( ms );
+}
+
+RofiMatchStore *rofi_match_store_new ( unsigned int num_slots, gboolean codepoints )
+{
+    RofiMatchStore *store = g_malloc0 ( sizeof ( RofiMatchStore ) );
+    store->codepoints = codepoints;
+    rofi_match_store_resize ( store, num_slots );
+    return store;
+}
+
+void rofi_match_store_clear ( RofiMatchStore *store )
+{
+    if ( store == NULL ) {
+        return;
+    }
+    for ( unsigned int i = 0; i < store->num_slots; i++ ) {
+        g_free ( store->slots[i] );
+        store->slots[i] = NULL;
+    }
+    g_atomic_pointer_add ( &match_store_total_size, -(gssize) store->size );
+    store->size = 0;
+    store->full = FALSE;
+}
+
+void rofi_match_store_free ( RofiMatchStore *store )
+{
+    if ( store == NULL ) {
+        return;
+    }
+    rofi_match_store_clear ( store );
+    g_free ( store->slots );
+    g_free ( store );
+}
+
+void rofi_match_store_resize ( RofiMatchStore *store, unsigned int num_slots )
+{
+    if ( store == NULL || num_slots <= store->num_slots ) {
+        return;
+    }
+    // Grow geometric, stores are resized while reading entries one by one.
+    unsigned int n = MAX ( num_slots, store->num_slots * 2 );
+    store->slots = g_renew ( RofiMatchString *, store->slots, n );
+    memset ( &( store->slots[store->num_slots] ), 0, ( n - store->num_slots ) * sizeof ( RofiMatchString * ) );
+    store->num_slots = n;
+}
+
+const RofiMatchString *rofi_match_store_peek ( RofiMatchStore *store, unsigned int slot )
+{
+    if ( store == NULL || slot >= store->num_slots ) {
+        return NULL;
+    }
+    return g_atomic_pointer_get ( &( store->slots[slot] ) );
+}
+
+const RofiMatchString *rofi_match_store_get ( RofiMatchStore *store, unsigned int slot, const char *text, gssize len )
+{
+    if ( store == NULL || slot >= store->num_slots || text == NULL ) {
+        return NULL;
+    }
+    RofiMatchString *ms = g_atomic_pointer_get ( &( store->slots[slot] ) );
+    if ( ms != NULL ) {
+        return ms;
+    }
+    if ( g_atomic_int_get ( &( store->full ) ) ) {
+        return NULL;
+    }
+    gsize size = 0;
+    ms = rofi_match_string_build ( text, ( len < 0 ) ? strlen ( text ) : (size_t) len, store->codepoints, &size );
+    if ( ( g_atomic_pointer_add ( &match_store_total_size, size ) + size ) > ROFI_MATCH_STORE_MAX_SIZE ) {
+        g_atomic_pointer_add ( &match_store_total_size, -(gssize) size );
+        g_atomic_int_set ( &( store->full ), TRUE );
+        g_debug ( "Match store memory limit reached, not preparing more entries." );
+        g_free ( ms );
+        return NULL;
+    }
+    if ( !g_atomic_pointer_compare_and_exchange ( &( store->slots[slot] ), NULL, ms ) ) {
+        // Another thread prepared it first.
+        g_atomic_pointer_add ( &match_store_total_size, -(gssize) size );
+        g_free ( ms );
+        return g_atomic_pointer_get ( &( store->slots[slot] ) );
+    }
+    g_atomic_pointer_add ( &( store->size ), size );
+    return ms;
+}
@@ -0,0 +1,201 @@
+/*
+ * rofi
+ *
+ * MIT/X11 License
+ * Copyright © 2013-2020 Qball Cow <qball@gmpclient.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+/** The log domain of this Helper. */
+#define G_LOG_DOMAIN    "Helpers.Rank"
+
+#include <config.h>
+#include <glib.h>
+
+#include "rofi-rank.h"
+
+/** Minimum number of rows ranked at once. */
+#define RANK_MIN_BATCH    64
+
+/**
+ * @param distance The distance of the row.
+ * @param index The (unfiltered) index of the row.
+ *
+ * @returns the key that orders rows on distance, and on index for equal distances.
+ */
+static inline guint64 rofi_rank_key ( int distance, unsigned int index )
+{
+    return ( (guint64) ( ( (guint32) distance ) ^ 0x80000000u ) << 32 ) | index;
+}
+
+/**
+ * @param keys The heap.
+ * @param size The number of keys in the heap.
+ * @param i The key to move down.
+ *
+ * Restore the min-heap property below i.
+ */
+static void rofi_rank_sift_down ( guint64 *keys, unsigned int size, unsigned int i )
+{
+    guint64 key = keys[i];
+    while ( TRUE ) {
+        unsigned int child = 2 * i + 1;
+        if ( child >= size ) {
+            break;
+        }
+        if ( ( child + 1 ) < size && keys[child + 1] < keys[child] ) {
+            child++;
+        }
+        if ( key <= keys[child] ) {
+            break;
+        }
+        keys[i] = keys[child];
+        i       = child;
+    }
+    keys[i] = key;
+}
+
+/**
+ * @param keys The heap.
+ * @param i The key to move up.
+ *
+ * Restore the min-heap property above i, e.g. after adding a key at the end.
+ */
+static void rofi_rank_sift_up ( guint64 *keys, unsigned int i )
+{
+    guint64 key = keys[i];
+    while ( i > 0 ) {
+        unsigned int parent = ( i - 1 ) / 2;
+        if ( keys[parent] <= key ) {
+            break;
+        }
+        keys[i] = keys[parent];
+        i       = parent;
+    }
+    keys[i] = key;
+}
+
+/**
+ * @param rank The ranking.
+ * @param line_map The (unfiltered) indexes of the filtered rows.
+ * @param num The number of rows in the line_map.
+ * @param n The number of rows that should be ranked.
+ *
+ * Move the best rows from the heap to the line_map, until the first n rows are ranked.
+ */
+static void rofi_rank_extend ( RofiRank *rank, unsigned int *line_map, unsigned int num, unsigned int n )
+{
+    guint64 *keys = rank->keys;
+    n = MIN ( n, num );
+    while ( rank->sorted < n ) {
+        line_map[rank->sorted++] = (unsigned int) ( keys[0] & G_MAXUINT32 );
+        keys[0]                  = keys[--rank->heap_size];
+        rofi_rank_sift_down ( keys, rank->heap_size, 0 );
+    }
+}
+
+/**
+ * @param rank The ranking.
+ * @param size The number of keys that should fit.
+ *
+ * Grow the keys of the ranking to hold at least size keys.
+ */
+static void rofi_rank_reserve ( RofiRank *rank, unsigned int size )
+{
+    if ( size > rank->keys_size ) {
+        rank->keys_size = MAX ( size, rank->keys_size * 2 );
+        rank->keys      = g_renew ( guint64, rank->keys, rank->keys_size );
+    }
+}
+
+void rofi_rank_init ( RofiRank *rank, unsigned int *line_map, const int *distance, unsigned int num )
+{
+    rofi_rank_reserve ( rank, num );
+    for ( unsigned int i = 0; i < num; i++ ) {
+        rank->keys[i] = rofi_rank_key ( distance[line_map[i]], line_map[i] );
+    }
+    for ( unsigned int i = num / 2; i > 0; i-- ) {
+        rofi_rank_sift_down ( rank->keys, num, i - 1 );
+    }
+    rank->heap_size = num;
+    rank->sorted    = 0;
+    rofi_rank_extend ( rank, line_map, num, RANK_MIN_BATCH );
+}
+
+void rofi_rank_clear ( RofiRank *rank, unsigned int num )
+{
+    rank->heap_size = 0;
+    rank->sorted    = num;
+}
+
+void rofi_rank_append ( RofiRank *rank, unsigned int *line_map, const int *distance, unsigned int num, const unsigned int *rows, unsigned int n )
+{
+    if ( n == 0 ) {
+        return;
+    }
+    rofi_rank_reserve ( rank, rank->heap_size + rank->sorted + n );
+    guint64 *keys = rank->keys;
+    guint64 best  = G_MAXUINT64;
+    for ( unsigned int i = 0; i < n; i++ ) {
+        guint64 key = rofi_rank_key ( distance[rows[i]], rows[i] );
+        best                  = MIN ( best, key );
+        keys[rank->heap_size] = key;
+        rofi_rank_sift_up ( keys, rank->heap_size++ );
+    }
+    // The ranked rows are in order, the ones before the best new row stay where they are.
+    unsigned int low  = 0;
+    unsigned int high = rank->sorted;
+    while ( low < high ) {
+        unsigned int mid   = low + ( high - low ) / 2;
+        unsigned int index = line_map[mid];
+        if ( rofi_rank_key ( distance[index], index ) < best ) {
+            low = mid + 1;
+        }
+        else {
+            high = mid;
+        }
+    }
+    for ( unsigned int i = low; i < rank->sorted; i++ ) {
+        unsigned int index = line_map[i];
+        keys[rank->heap_size] = rofi_rank_key ( distance[index], index );
+        rofi_rank_sift_up ( keys, rank->heap_size++ );
+    }
+    rank->sorted = low;
+    rofi_rank_extend ( rank, line_map, num, RANK_MIN_BATCH );
+}
+
+unsigned int rofi_rank_line_map ( RofiRank *rank, unsigned int *line_map, unsigned int num, unsigned int position )
+{
+    if ( position >= rank->sorted ) {
+        rofi_rank_extend ( rank, line_map, num, MAX ( position + 1, MAX ( rank->sorted * 2, RANK_MIN_BATCH ) ) );
+    }
+    return line_map[position];
+}
+
+void rofi_rank_free ( RofiRank *rank )
+{
+    g_free ( rank->keys );
+    rank->keys      = NULL;
+    rank->keys_size = 0;
+    rank->heap_size = 0;
+    rank->sorted    = 0;
+}
@@ -0,0 +1,521 @@
+/*
+ * rofi
+ *
+ * MIT/X11 License
+ * Copyright © 2013-2020 Qball Cow <qball@gmpclient.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+/** The log domain of this Helper. */
+#define G_LOG_DOMAIN    "Helpers.TrigramIndex"
+
+#include <config.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+
+#include "rofi-types.h"
+#include "rofi-match-store.h"
+#include "rofi-trigram-index.h"
+
+/** Number of bits in the trigram hash, trigrams are hashed into 2^bits lists. */
+#define TRIGRAM_BUCKET_BITS    16
+/** Number of lists per shard. */
+#define TRIGRAM_NUM_BUCKETS    ( 1u << TRIGRAM_BUCKET_BITS )
+/** Number of rows a worker indexes between checks if the build is cancelled. */
+#define TRIGRAM_CANCEL_ROWS    1024
+
+/**
+ * The list of rows of one bucket, while the shard is built.
+ */
+typedef struct
+{
+    /** The encoded deltas. */
+    guint8  *data;
+    /** Used bytes in data. */
+    guint32 len;
+    /** Allocated bytes in data. */
+    guint32 size;
+    /** The last row added. */
+    guint32 last;
+    /** The number of rows added. */
+    guint32 count;
+} TrigramBucket;
+
+/**
+ * A range of consecutive rows, indexed by one worker.
+ */
+typedef struct
+{
+    /** The index the shard belongs to. */
+    RofiTrigramIndex *index;
+    /** The first row. */
+    unsigned int     start;
+    /** The end of the rows. */
+    unsigned int     stop;
+    /** Start of the list of each bucket in postings, and the end of the last list. */
+    guint32          *offsets;
+    /** The number of rows in each bucket. */
+    guint32          *counts;
+    /** The encoded lists of all buckets. */
+    guint8           *postings;
+} TrigramShard;
+
+struct _RofiTrigramIndex
+{
+    /** The indexed mode. */
+    const Mode     *sw;
+    /** The number of indexed rows. */
+    unsigned int   num_rows;
+    /** The shards. */
+    TrigramShard   *shards;
+    /** The number of shards. */
+    unsigned int   num_shards;
+    /** The pool that builds the shards, NULL if it could not be created. */
+    GThreadPool    *pool;
+    /** Number of shards that are still being built. */
+    gint           running;
+    /** Set to stop building. */
+    gint           cancel;
+    /** Set when the memory limit was hit. */
+    gint           full;
+    /** Set when all shards are built. */
+    gint           ready;
+    /** Memory used by the index. */
+    volatile gsize size;
+    /** When building started. */
+    gint64         start_time;
+};
+
+/**
+ * @param a The first character.
+ * @param b The second character.
+ * @param c The third character.
+ *
+ * @returns the bucket of the trigram.
+ */
+static inline guint32 trigram_bucket ( gunichar a, gunichar b, gunichar c )
+{
+    guint64 h = ( a * G_GUINT64_CONSTANT ( 0x9E3779B97F4A7C15 ) ) ^
+                ( b * G_GUINT64_CONSTANT ( 0xC2B2AE3D27D4EB4F ) ) ^
+                ( c * G_GUINT64_CONSTANT ( 0x165667B19E3779F9 ) );
+    return (guint32) ( h >> ( 64 - TRIGRAM_BUCKET_BITS ) );
+}
+
+/**
+ * @param ids The array to add the buckets to.
+ * @param text The (UTF-8) text.
+ * @param len The length of text in bytes.
+ * @param fold If the characters should be case folded first.
+ *
+ * Add the bucket of every trigram in text to ids.
+ *
+ * @returns TRUE if text only contains ASCII characters.
+ */
+static gboolean trigram_collect ( GArray *ids, const char *text, size_t len, gboolean fold )
+{
+    gboolean   ascii = TRUE;
+    gunichar   a     = 0, b = 0;
+    unsigned   n     = 0;
+    const char *end  = text + len;
+    for ( const char *p = text; p < end; p = g_utf8_next_char ( p ) ) {
+        gunichar c = (guchar) *p;
+        if ( c >= 0x80 ) {
+            ascii = FALSE;
+            c     = g_utf8_get_char ( p );
+        }
+        if ( fold ) {
+            c = rofi_match_fold_char ( c );
+        }
+        if ( ++n >= 3 ) {
+            guint32 id = trigram_bucket ( a, b, c );
+            g_array_append_val ( ids, id );
+        }
+        a = b;
+        b = c;
+    }
+    return ascii;
+}
+
+/**
+ * Sort bucket ids.
+ */
+static int trigram_id_sort ( const void *a, const void *b )
+{
+    guint32 ia = *( (const guint32 *) a );
+    guint32 ib = *( (const guint32 *) b );
+    return ( ia > ib ) - ( ia < ib );
+}
+
+/**
+ * @param ids The bucket ids.
+ *
+ * Sort ids and remove duplicates.
+ */
+static void trigram_ids_unique ( GArray *ids )
+{
+    guint32      *v = (guint32 *) ids->data;
+    unsigned int n  = 0;
+    if ( ids->len < 2 ) {
+        return;
+    }
+    qsort ( v, ids->len, sizeof ( guint32 ), trigram_id_sort );
+    for ( unsigned int i = 0; i < ids->len; i++ ) {
+        if ( n == 0 || v[n - 1] != v[i] ) {
+            v[n++] = v[i];
+        }
+    }
+    g_array_set_size ( ids, n );
+}
+
+/**
+ * @param index The index.
+ * @param shard The shard that is built.
+ * @param bucket The bucket to add the row to.
+ * @param row The row, not smaller than the rows already in the bucket.
+ *
+ * Append the delta to the previous row as variable length integer, 7 bits per byte.
+ *
+ * @returns FALSE if the memory limit is hit.
+ */
+static gboolean trigram_bucket_add ( RofiTrigramIndex *index, const TrigramShard *shard, TrigramBucket *bucket, guint32 row )
+{
+    // The row is already in the bucket, through an earlier trigram of the row.
+    if ( bucket->count > 0 && bucket->last == row ) {
+        return TRUE;
+    }
+    guint32 delta = row - ( bucket->count ? bucket->last : shard->start );
+    if ( ( bucket->len + 5 ) > bucket->size ) {
+        guint32 size = MAX ( 16, bucket->size * 2 );
+        if ( ( g_atomic_pointer_add ( &( index->size ), size - bucket->size ) + size - bucket->size ) > ROFI_TRIGRAM_INDEX_MAX_SIZE ) {
+            g_atomic_pointer_add ( &( index->size ), -(gssize) ( size - bucket->size ) );
+            return FALSE;
+        }
+        bucket->data = g_realloc ( bucket->data, size );
+        bucket->size = size;
+    }
+    while ( delta >= 0x80 ) {
+        bucket->data[bucket->len++] = (guint8) ( delta | 0x80 );
+        delta                     >>= 7;
+    }
+    bucket->data[bucket->len++] = (guint8) delta;
+    bucket->last                = row;
+    bucket->count++;
+    return TRUE;
+}
+
+/**
+ * @param index The index.
+ * @param shard The shard.
+ * @param buckets The buckets the shard is built in, freed.
+ *
+ * Copy the lists of the buckets into one compact array.
+ */
+static void trigram_shard_compact ( RofiTrigramIndex *index, TrigramShard *shard, TrigramBucket *buckets )
+{
+    gsize total = 0;
+    gsize built = 0;
+    for ( unsigned int i = 0; i < TRIGRAM_NUM_BUCKETS; i++ ) {
+        total += buckets[i].len;
+        built += buckets[i].size;
+    }
+    shard->offsets  = g_new ( guint32, TRIGRAM_NUM_BUCKETS + 1 );
+    shard->counts   = g_new ( guint32, TRIGRAM_NUM_BUCKETS );
+    shard->postings = g_malloc ( MAX ( 1, total ) );
+    total           = 0;
+    for ( unsigned int i = 0; i < TRIGRAM_NUM_BUCKETS; i++ ) {
+        shard->offsets[i] = total;
+        shard->counts[i]  = buckets[i].count;
+        if ( buckets[i].len > 0 ) {
+            memcpy ( shard->postings + total, buckets[i].data, buckets[i].len );
+        }
+        total += buckets[i].len;
+        g_free ( buckets[i].data );
+    }
+    shard->offsets[TRIGRAM_NUM_BUCKETS] = total;
+    g_free ( buckets );
+    gsize size = total + ( 2 * TRIGRAM_NUM_BUCKETS + 1 ) * sizeof ( guint32 );
+    g_atomic_pointer_add ( &( index->size ), (gssize) size - (gssize) built );
+}
+
+/**
+ * @param data The TrigramShard to build.
+ * @param user_data Unused.
+ *
+ * Index the rows of the shard, runs in the thread pool of the index.
+ */
+static void trigram_shard_build ( gpointer data, G_GNUC_UNUSED gpointer user_data )
+{
+    TrigramShard     *shard   = (TrigramShard *) data;
+    RofiTrigramIndex *index   = shard->index;
+    TrigramBucket    *buckets = g_new0 ( TrigramBucket, TRIGRAM_NUM_BUCKETS );
+    GArray           *ids     = g_array_new ( FALSE, FALSE, sizeof ( guint32 ) );
+    gboolean         ok       = TRUE;
+    for ( unsigned int row = shard->start; ok && row < shard->stop; row++ ) {
+        if ( ( ( row - shard->start ) % TRIGRAM_CANCEL_ROWS ) == 0 && g_atomic_int_get ( &( index->cancel ) ) ) {
+            break;
+        }
+        char *text = mode_get_match_text ( index->sw, row );
+        // The row can not match any token.
+        if ( text == NULL ) {
+            continue;
+        }
+        size_t len = strlen ( text );
+        g_array_set_size ( ids, 0 );
+        if ( !trigram_collect ( ids, text, len, TRUE ) ) {
+            // Tokens are also matched against the normalized text in the match store.
+            size_t flen;
+            char   *folded = rofi_match_fold ( text, len, &flen, NULL );
+            trigram_collect ( ids, folded, flen, FALSE );
+            g_free ( folded );
+        }
+        g_free ( text );
+        for ( unsigned int i = 0; ok && i < ids->len; i++ ) {
+            ok = trigram_bucket_add ( index, shard, &( buckets[g_array_index ( ids, guint32, i )] ), row );
+        }
+        if ( !ok ) {
+            g_atomic_int_set ( &( index->full ), TRUE );
+            g_atomic_int_set ( &( index->cancel ), TRUE );
+        }
+    }
+    g_array_free ( ids, TRUE );
+    trigram_shard_compact ( index, shard, buckets );
+
+    if ( g_atomic_int_dec_and_test ( &( index->running ) ) ) {
+        if ( g_atomic_int_get ( &( index->full ) ) ) {
+            g_debug ( "Trigram index of %u rows is larger than %u MiB, not used.", index->num_rows, ROFI_TRIGRAM_INDEX_MAX_SIZE / ( 1024 * 1024 ) );
+        }
+        else if ( !g_atomic_int_get ( &( index->cancel ) ) ) {
+            g_debug ( "Trigram index of %u rows built by %u workers in %.2f ms, using %.2f MiB.",
+                      index->num_rows, index->num_shards, ( g_get_monotonic_time () - index->start_time ) / 1000.0,
+                      (gsize) g_atomic_pointer_get ( &( index->size ) ) / ( 1024.0 * 1024.0 ) );
+            g_atomic_int_set ( &( index->ready ), TRUE );
+        }
+    }
+}
+
+RofiTrigramIndex *rofi_trigram_index_new ( const Mode *sw, unsigned int num_rows, unsigned int num_shards )
+{
+    RofiTrigramIndex *index = g_malloc0 ( sizeof ( RofiTrigramIndex ) );
+    index->sw         = sw;
+    index->num_rows   = num_rows;
+    index->num_shards = CLAMP ( num_shards, 1, MAX ( 1, num_rows ) );
+    index->shards     = g_new0 ( TrigramShard, index->num_shards );
+    index->running    = index->num_shards;
+    index->start_time = g_get_monotonic_time ();
+    for ( unsigned int i = 0; i < index->num_shards; i++ ) {
+        index->shards[i].index = index;
+        index->shards[i].start = ( (guint64) num_rows * i ) / index->num_shards;
+        index->shards[i].stop  = ( (guint64) num_rows * ( i + 1 ) ) / index->num_shards;
+    }
+    /**
+     * The index has its own pool, so filtering on the shared thread pool is not held up while the index is built.
+     */
+    GError *error = NULL;
+    index->pool = g_thread_pool_new ( trigram_shard_build, NULL, index->num_shards, FALSE, &error );
+    if ( error != NULL ) {
+        g_warning ( "Failed to setup thread pool for the trigram index: '%s'", error->message );
+        g_error_free ( error );
+        index->pool = NULL;
+    }
+    for ( unsigned int i = 0; i < index->num_shards; i++ ) {
+        if ( index->pool != NULL ) {
+            g_thread_pool_push ( index->pool, &( index->shards[i] ), NULL );
+        }
+        else {
+            trigram_shard_build ( &( index->shards[i] ), NULL );
+        }
+    }
+    return index;
+}
+
+void rofi_trigram_index_free ( RofiTrigramIndex *index )
+{
+    if ( index == NULL ) {
+        return;
+    }
+    g_atomic_int_set ( &( index->cancel ), TRUE );
+    if ( index->pool != NULL ) {
+        // Waits for the workers, they stop at the next check.
+        g_thread_pool_free ( index->pool, FALSE, TRUE );
+    }
+    for ( unsigned int i = 0; i < index->num_shards; i++ ) {
+        g_free ( index->shards[i].offsets );
+        g_free ( index->shards[i].counts );
+        g_free ( index->shards[i].postings );
+    }
+    g_free ( index->shards );
+    g_free ( index );
+}
+
+gboolean rofi_trigram_index_ready ( RofiTrigramIndex *index )
+{
+    return g_atomic_int_get ( &( index->ready ) );
+}
+
+size_t rofi_trigram_index_get_size ( RofiTrigramIndex *index )
+{
+    return (gsize) g_atomic_pointer_get ( &( index->size ) );
+}
+
+/**
+ * @param ids The array to add the buckets to.
+ * @param token The token.
+ *
+ * Add the buckets of the trigrams that must be in every row the token matches.
+ */
+static void trigram_token_collect ( GArray *ids, const rofi_int_matcher *token )
+{
+    // Inverted tokens and regular expressions can not use the index.
+    if ( token->invert || token->literal == NULL ) {
+        return;
+    }
+    GString *str = g_string_sized_new ( token->literal_len + 1 );
+    for ( const char *p = token->literal; *p; p = g_utf8_next_char ( p ) ) {
+        g_string_append_unichar ( str, rofi_match_fold_char ( g_utf8_get_char ( p ) ) );
+    }
+    /**
+     * The rows contain the trigrams of both the folded and the normalized folded text. Only if the token is the
+     * same for both, its trigrams are in every row it matches.
+     */
+    if ( token->folded == NULL || strcmp ( str->str, token->folded ) == 0 ) {
+        trigram_collect ( ids, str->str, str->len, FALSE );
+    }
+    g_string_free ( str, TRUE );
+}
+
+/**
+ * @param shard The shard.
+ * @param id The bucket.
+ * @param rows The rows, filled with the rows in bucket.
+ *
+ * @returns the number of rows.
+ */
+static unsigned int trigram_shard_decode ( const TrigramShard *shard, guint32 id, unsigned int *rows )
+{
+    const guint8 *p   = shard->postings + shard->offsets[id];
+    const guint8 *end = shard->postings + shard->offsets[id + 1];
+    unsigned int n    = 0;
+    guint32      row  = shard->start;
+    while ( p < end ) {
+        guint32  delta = 0;
+        unsigned shift = 0;
+        for (; *p & 0x80; p++, shift += 7 ) {
+            delta |= (guint32) ( *p & 0x7F ) << shift;
+        }
+        delta    |= (guint32) ( *p++ ) << shift;
+        row      += delta;
+        rows[n++] = row;
+    }
+    return n;
+}
+
+/**
+ * @param shard The shard.
+ * @param id The bucket.
+ * @param rows The (ascending) rows, only the rows that are also in bucket are kept.
+ * @param n The number of rows.
+ *
+ * @returns the number of rows kept.
+ */
+static unsigned int trigram_shard_intersect ( const TrigramShard *shard, guint32 id, unsigned int *rows, unsigned int n )
+{
+    const guint8 *p   = shard->postings + shard->offsets[id];
+    const guint8 *end = shard->postings + shard->offsets[id + 1];
+    unsigned int kept = 0;
+    unsigned int k    = 0;
+    guint32      row  = shard->start;
+    while ( p < end && k < n ) {
+        guint32  delta = 0;
+        unsigned shift = 0;
+        for (; *p & 0x80; p++, shift += 7 ) {
+            delta |= (guint32) ( *p & 0x7F ) << shift;
+        }
+        delta |= (guint32) ( *p++ ) << shift;
+        row   += delta;
+        while ( k < n && rows[k] < row ) {
+            k++;
+        }
+        if ( k < n && rows[k] == row ) {
+            rows[kept++] = row;
+            k++;
+        }
+    }
+    return kept;
+}
+
+/**
+ * Sort bucket ids on the number of rows in them.
+ */
+static gint trigram_id_sort_count ( gconstpointer a, gconstpointer b, gpointer data )
+{
+    const guint32 *counts = (const guint32 *) data;
+    guint32       ca      = counts[*( (const guint32 *) a )];
+    guint32       cb      = counts[*( (const guint32 *) b )];
+    return ( ca > cb ) - ( ca < cb );
+}
+
+/**
+ * @param shard The shard.
+ * @param ids The buckets that all should contain the row, reordered.
+ * @param num_ids The number of buckets.
+ * @param rows Filled with the rows in all buckets.
+ *
+ * Intersect the lists, starting with the shortest so the candidates shrink fast.
+ *
+ * @returns the number of rows.
+ */
+static unsigned int trigram_shard_query ( const TrigramShard *shard, guint32 *ids, unsigned int num_ids, unsigned int *rows )
+{
+    g_qsort_with_data ( ids, num_ids, sizeof ( guint32 ), trigram_id_sort_count, shard->counts );
+    unsigned int n = trigram_shard_decode ( shard, ids[0], rows );
+    for ( unsigned int i = 1; n > 0 && i < num_ids; i++ ) {
+        n = trigram_shard_intersect ( shard, ids[i], rows, n );
+    }
+    return n;
+}
+
+int rofi_trigram_index_query ( RofiTrigramIndex *index, rofi_int_matcher **tokens, unsigned int num_rows, unsigned int *rows )
+{
+    if ( tokens == NULL || num_rows < index->num_rows ) {
+        return -1;
+    }
+    GArray *ids = g_array_new ( FALSE, FALSE, sizeof ( guint32 ) );
+    for ( int j = 0; tokens[j] != NULL; j++ ) {
+        trigram_token_collect ( ids, tokens[j] );
+    }
+    if ( ids->len == 0 ) {
+        g_array_free ( ids, TRUE );
+        return -1;
+    }
+    trigram_ids_unique ( ids );
+    unsigned int n = 0;
+    for ( unsigned int s = 0; s < index->num_shards; s++ ) {
+        n += trigram_shard_query ( &( index->shards[s] ), (guint32 *) ids->data, ids->len, rows + n );
+    }
+    g_array_free ( ids, TRUE );
+    // Rows added after the index was built are not in it.
+    for ( unsigned int i = index->num_rows; i < num_rows; i++ ) {
+        rows[n++] = i;
+    }
+    return n;
+}
@@ -442,6 +442,8 @@ static void cleanup ()
 
     nk_bindings_free ( bindings );
 
+    helper_tokenize_cache_clear ();
+
     // Cleaning up memory allocated by the Xresources file.
     config_xresource_free ();
     g_free ( modi );
@@ -867,7 +869,9 @@ int main ( int argc, char *argv[] )
     bindings = nk_bindings_new ( 0 );
     TICK_N ( "NK Bindings" );
 
-    if ( !display_setup ( main_loop, bindings ) ) {
+    // Filtering with -dump has no user interface, so it does not need a display.
+    gboolean headless = dmenu_mode && find_arg ( "-dump" ) >= 0;
+    if ( !headless && !display_setup ( main_loop, bindings ) ) {
         g_warning ( "Connection has error" );
         cleanup ();
         return EXIT_FAILURE;
@@ -926,7 +930,9 @@ int main ( int argc, char *argv[] )
             g_free ( etc );
         }
         // Load in config from X resources.
-        config_parse_xresource_options ( xcb );
+        if ( !headless ) {
+            config_parse_xresource_options ( xcb );
+        }
 
         if ( config_path_new && g_file_test ( config_path_new, G_FILE_TEST_IS_REGULAR ) ) {
             if ( rofi_theme_parse_file ( config_path_new ) ) {
@@ -963,6 +969,13 @@ int main ( int argc, char *argv[] )
     }
     parse_keys_abe ( bindings );
 
+    if ( headless ) {
+        rofi_view_workers_initialize ();
+        return_code = dmenu_dump ();
+        cleanup ();
+        return return_code;
+    }
+
     // Get the path to the cache dir.
     cache_dir = g_get_user_cache_dir ();
 
@@ -78,9 +78,19 @@
 void rofi_view_update ( RofiViewState *state, gboolean qr );
 
 static int rofi_view_calculate_height ( RofiViewState *state );
+static void rofi_view_filter_cancel ( RofiViewState *state );
+static void rofi_view_trigram_index_clear ( RofiViewState *state );
+static void rofi_view_filter_flush ( RofiViewState *state );
 
 /** Thread pool used for filtering */
 GThreadPool *tpool = NULL;
+/** Thread pool used for filtering in the background, so a pass never has to wait on the work queued on tpool. */
+static GThreadPool *filter_pool = NULL;
+
+/** Maximum number of filter results kept in the filter cache. */
+#define FILTER_CACHE_MAX_ENTRIES    64
+/** Maximum memory (in bytes) used by the results kept in the filter cache. */
+#define FILTER_CACHE_MAX_SIZE       ( 16 * 1024 * 1024 )
 
 /** Global pointer to the currently active RofiViewState */
 RofiViewState *current_active_menu = NULL;
@@ -112,6 +122,8 @@ struct
     workarea           mon;
     /** timeout for reloading */
     guint              idle_timeout;
+    /** If the rows changed since the reload was queued, instead of only getting appended to. */
+    gboolean           reload_rows;
     /** debug counter for redraws */
     unsigned long long count;
     /** redraw idle time. */
@@ -127,6 +139,7 @@ struct
     .flags          = MENU_NORMAL,
     .views          = G_QUEUE_INIT,
     .idle_timeout   = 0,
+    .reload_rows    = FALSE,
     .count          = 0L,
     .repaint_source = 0,
     .fullscreen     = FALSE,
@@ -158,17 +171,147 @@ static char * get_matching_state ( void )
     }
     return " ";
 }
+/**
+ * @param state The Menu Handle
+ * @param position The position in the filtered list.
+ *
+ * @returns the (unfiltered) index of the row at position, see rofi_rank_line_map().
+ */
+static inline unsigned int rofi_view_line_map ( RofiViewState *state, unsigned int position )
+{
+    return rofi_rank_line_map ( &( state->rank ), state->line_map, state->filtered_lines, position );
+}
 
 /**
- * Levenshtein Sorting.
+ * A cached filter result.
+ */
+typedef struct
+{
+    /** User input the result was filtered with. */
+    char                *input;
+    /** Preprocessed pattern the result was filtered with. */
+    char                *pattern;
+    /** Matching method used. */
+    MatchingMethod      method;
+    /** Case sensitivity used. */
+    unsigned int        case_sensitive;
+    /** Tokenize setting used. */
+    unsigned int        tokenize;
+    /** If the result was sorted. */
+    unsigned int        sort;
+    /** Sorting method used. */
+    SortingMethod       sorting_method;
+    /** The filtered rows, in index order. */
+    unsigned int        *line_map;
+    /** The distance of each of the filtered rows, NULL if not sorted. */
+    int                 *distance;
+    /** Number of rows in line_map. */
+    unsigned int        filtered_lines;
+    /** Memory used by this entry. */
+    size_t              size;
+} FilterCacheEntry;
+
+static void rofi_view_filter_cache_entry_free ( FilterCacheEntry *entry )
+{
+    g_free ( entry->input );
+    g_free ( entry->pattern );
+    g_free ( entry->line_map );
+    g_free ( entry->distance );
+    g_free ( entry );
+}
+
+/**
+ * @param state The Menu Handle
+ *
+ * Drop all cached filter results, e.g. because the rows changed.
  */
-static int lev_sort ( const void *p1, const void *p2, void *arg )
+static void rofi_view_filter_cache_clear ( RofiViewState *state )
 {
-    const int *a         = p1;
-    const int *b         = p2;
-    int       *distances = arg;
+    FilterCacheEntry *entry;
+    while ( ( entry = g_queue_pop_head ( &( state->filter_cache ) ) ) != NULL ) {
+        rofi_view_filter_cache_entry_free ( entry );
+    }
+    state->filter_cache_size = 0;
+}
 
-    return distances[*a] - distances[*b];
+/**
+ * @param state The Menu Handle
+ * @param input The user input.
+ * @param pattern The preprocessed user input.
+ *
+ * Look up the filter result for input and restore it into the line_map.
+ * On success the entry is moved to the front of the cache.
+ *
+ * @returns TRUE if the result was restored from the cache.
+ */
+static gboolean rofi_view_filter_cache_lookup ( RofiViewState *state, const char *input, const char *pattern )
+{
+    for ( GList *iter = state->filter_cache.head; iter != NULL; iter = g_list_next ( iter ) ) {
+        FilterCacheEntry *entry = iter->data;
+        if ( entry->method != config.matching_method ||
+             entry->case_sensitive != config.case_sensitive ||
+             entry->tokenize != config.tokenize ||
+             entry->sort != config.sort ||
+             ( entry->sort && entry->sorting_method != config.sorting_method_enum ) ) {
+            continue;
+        }
+        if ( g_strcmp0 ( entry->input, input ) != 0 || g_strcmp0 ( entry->pattern, pattern ) != 0 ) {
+            continue;
+        }
+        memcpy ( state->line_map, entry->line_map, entry->filtered_lines * sizeof ( unsigned int ) );
+        state->filtered_lines = entry->filtered_lines;
+        for ( unsigned int i = 0; entry->distance != NULL && i < entry->filtered_lines; i++ ) {
+            state->distance[entry->line_map[i]] = entry->distance[i];
+        }
+        // Move to front.
+        g_queue_unlink ( &( state->filter_cache ), iter );
+        g_queue_push_head_link ( &( state->filter_cache ), iter );
+        state->filter_cache_hits++;
+        return TRUE;
+    }
+    state->filter_cache_misses++;
+    return FALSE;
+}
+
+/**
+ * @param state The Menu Handle
+ * @param input The user input.
+ * @param pattern The preprocessed user input.
+ *
+ * Store the current filter result in the cache, evicting the least recently used
+ * results when the cache grows too large.
+ */
+static void rofi_view_filter_cache_insert ( RofiViewState *state, const char *input, const char *pattern )
+{
+    size_t size = sizeof ( FilterCacheEntry ) + state->filtered_lines * ( config.sort ? sizeof ( unsigned int ) + sizeof ( int ) : sizeof ( unsigned int ) );
+    if ( size > FILTER_CACHE_MAX_SIZE ) {
+        return;
+    }
+    while ( state->filter_cache.length >= FILTER_CACHE_MAX_ENTRIES ||
+            ( state->filter_cache.length > 0 && ( state->filter_cache_size + size ) > FILTER_CACHE_MAX_SIZE ) ) {
+        FilterCacheEntry *entry = g_queue_pop_tail ( &( state->filter_cache ) );
+        state->filter_cache_size -= entry->size;
+        rofi_view_filter_cache_entry_free ( entry );
+    }
+    FilterCacheEntry *entry = g_malloc0 ( sizeof ( FilterCacheEntry ) );
+    entry->input          = g_strdup ( input );
+    entry->pattern        = g_strdup ( pattern );
+    entry->method         = config.matching_method;
+    entry->case_sensitive = config.case_sensitive;
+    entry->tokenize       = config.tokenize;
+    entry->sort           = config.sort;
+    entry->sorting_method = config.sorting_method_enum;
+    entry->line_map       = g_memdup ( state->line_map, state->filtered_lines * sizeof ( unsigned int ) );
+    entry->filtered_lines = state->filtered_lines;
+    if ( config.sort ) {
+        entry->distance = g_new ( int, state->filtered_lines );
+        for ( unsigned int i = 0; i < state->filtered_lines; i++ ) {
+            entry->distance[i] = state->distance[state->line_map[i]];
+        }
+    }
+    entry->size           = size;
+    g_queue_push_head ( &( state->filter_cache ), entry );
+    state->filter_cache_size += size;
 }
 
 /**
@@ -455,15 +598,27 @@ static void rofi_view_reload_message_bar ( RofiViewState *state )
 static gboolean rofi_view_reload_idle ( G_GNUC_UNUSED gpointer data )
 {
     if ( current_active_menu ) {
-        current_active_menu->reload   = TRUE;
+        if ( CacheState.reload_rows ) {
+            current_active_menu->reload = TRUE;
+        }
+        else {
+            current_active_menu->append = TRUE;
+        }
         current_active_menu->refilter = TRUE;
         rofi_view_queue_redraw ();
     }
     CacheState.idle_timeout = 0;
+    CacheState.reload_rows  = FALSE;
     return G_SOURCE_REMOVE;
 }
 
 void rofi_view_reload ( void  )
+{
+    CacheState.reload_rows = TRUE;
+    rofi_view_reload_append ();
+}
+
+void rofi_view_reload_append ( void )
 {
     // @TODO add check if current view is equal to the callee
     if ( CacheState.idle_timeout == 0 ) {
@@ -519,7 +674,7 @@ void rofi_view_set_selected_line ( RofiViewState *state, unsigned int selected_l
     // Find the line.
     unsigned int selected = 0;
     for ( unsigned int i = 0; ( ( state->selected_line ) ) < UINT32_MAX && !selected && i < state->filtered_lines; i++ ) {
-        if ( state->line_map[i] == ( state->selected_line ) ) {
+        if ( rofi_view_line_map ( state, i ) == ( state->selected_line ) ) {
             selected = i;
             break;
         }
@@ -529,11 +684,114 @@ void rofi_view_set_selected_line ( RofiViewState *state, unsigned int selected_l
     xcb_flush ( xcb->connection );
 }
 
-void rofi_view_free ( RofiViewState *state )
+/** Maximum number of rows with memoized match spans, the rows drawn longest ago are dropped when it grows beyond this. */
+#define HIGHLIGHT_MAX_ROWS    1024
+/** Number of most recently drawn rows kept when the memo is full, this is more than fit on screen. */
+#define HIGHLIGHT_KEEP_ROWS    ( HIGHLIGHT_MAX_ROWS / 2 )
+
+/**
+ * The memoized match spans of a row.
+ */
+typedef struct
+{
+    /** The highlight generation the spans were found in. */
+    guint        generation;
+    /** The highlight stamp of the last time the row was drawn. */
+    guint        stamp;
+    /** Copy of the text the spans were found in. */
+    char         *text;
+    /** Number of spans. */
+    unsigned int num_spans;
+    /** The (start, end) pairs of the spans. */
+    int          *spans;
+} RofiViewHighlight;
+
+/**
+ * @param data The RofiViewHighlight to free.
+ */
+static void rofi_view_highlight_free ( gpointer data )
+{
+    RofiViewHighlight *hl = (RofiViewHighlight *) data;
+    g_free ( hl->text );
+    g_free ( hl->spans );
+    g_free ( hl );
+}
+
+/**
+ * @param key The (unfiltered) index of the row.
+ * @param value The RofiViewHighlight of the row.
+ * @param data Pointer to the oldest stamp to keep.
+ *
+ * @returns TRUE if the row was not drawn recently enough to be on screen.
+ */
+static gboolean rofi_view_highlight_is_stale ( G_GNUC_UNUSED gpointer key, gpointer value, gpointer data )
+{
+    const RofiViewHighlight *hl = (const RofiViewHighlight *) value;
+    guint                   keep = *( (guint *) data );
+    // Wrap-around safe comparison of the stamps.
+    return (gint) ( hl->stamp - keep ) < 0;
+}
+
+/**
+ * @param state The Menu Handle
+ * @param tokens The tokens the rows are filtered with, the view takes ownership. Can be NULL.
+ *
+ * Replace the tokens, this invalidates the memoized match spans.
+ */
+static void rofi_view_set_tokens ( RofiViewState *state, rofi_int_matcher **tokens )
 {
     if ( state->tokens ) {
         helper_tokenize_free ( state->tokens );
-        state->tokens = NULL;
+    }
+    state->tokens = tokens;
+    state->highlight.generation++;
+    if ( state->highlight.rows != NULL ) {
+        g_hash_table_remove_all ( state->highlight.rows );
+    }
+}
+
+/**
+ * @param state The Menu Handle
+ * @param index The (unfiltered) index of the row.
+ * @param text The (visible) text of the row.
+ *
+ * Get the parts of the row the tokens match. They are only searched for again when the tokens or the text of the row changed,
+ * so moving the selection or scrolling back does not match the rows again.
+ * When the memo is full, only the rows that were not among the last drawn, and so are off screen, are dropped.
+ *
+ * @returns the match spans of the row.
+ */
+static const RofiViewHighlight *rofi_view_highlight_get ( RofiViewState *state, unsigned int index, const char *text )
+{
+    if ( state->highlight.rows == NULL ) {
+        state->highlight.rows = g_hash_table_new_full ( g_direct_hash, g_direct_equal, NULL, rofi_view_highlight_free );
+    }
+    guint             stamp = ++( state->highlight.stamp );
+    RofiViewHighlight *hl   = g_hash_table_lookup ( state->highlight.rows, GUINT_TO_POINTER ( index ) );
+    if ( hl != NULL && hl->generation == state->highlight.generation && g_strcmp0 ( hl->text, text ) == 0 ) {
+        hl->stamp = stamp;
+        return hl;
+    }
+    if ( hl == NULL && g_hash_table_size ( state->highlight.rows ) >= HIGHLIGHT_MAX_ROWS ) {
+        guint keep = stamp - HIGHLIGHT_KEEP_ROWS;
+        g_hash_table_foreach_remove ( state->highlight.rows, rofi_view_highlight_is_stale, &keep );
+    }
+    hl             = g_malloc ( sizeof ( RofiViewHighlight ) );
+    hl->generation = state->highlight.generation;
+    hl->stamp      = stamp;
+    hl->text       = g_strdup ( text );
+    hl->spans      = helper_token_match_get_spans ( state->tokens, text, &( hl->num_spans ) );
+    g_hash_table_replace ( state->highlight.rows, GUINT_TO_POINTER ( index ), hl );
+    return hl;
+}
+
+void rofi_view_free ( RofiViewState *state )
+{
+    rofi_view_filter_cancel ( state );
+    rofi_view_trigram_index_clear ( state );
+    rofi_view_set_tokens ( state, NULL );
+    if ( state->highlight.rows != NULL ) {
+        g_hash_table_destroy ( state->highlight.rows );
     }
     // Do this here?
     // Wait for final release?
@@ -541,6 +799,11 @@ void rofi_view_free ( RofiViewState *state )
 
     g_free ( state->line_map );
     g_free ( state->distance );
+    rofi_match_store_free ( state->sort_store );
+    rofi_rank_free ( &( state->rank ) );
+    g_free ( state->last_filter.input );
+    g_free ( state->last_filter.pattern );
+    rofi_view_filter_cache_clear ( state );
     // Free the switcher boxes.
     // When state is free'ed we should no longer need these.
     g_free ( state->modi );
@@ -563,7 +826,7 @@ unsigned int rofi_view_get_next_position ( const RofiViewState *state )
     unsigned int next_pos = state->selected_line;
     unsigned int selected = listview_get_selected ( state->list_view );
     if ( ( selected + 1 ) < state->num_lines ) {
-        ( next_pos ) = state->line_map[selected + 1];
+        ( next_pos ) = rofi_view_line_map ( (RofiViewState *) state, selected + 1 );
     }
     return next_pos;
 }
@@ -591,35 +854,119 @@ static RofiViewState * __rofi_view_state_create ( void )
     return g_malloc0 ( sizeof ( RofiViewState ) );
 }
 
+/** Minimum number of rows claimed at once by a filter worker. */
+#define FILTER_MIN_CHUNK          256
+/** Maximum number of rows claimed at once by a filter worker, bounds how long cancelling a pass takes. */
+#define FILTER_MAX_CHUNK          16384
+/** Minimum number of rows per filter worker, below this less workers are used. */
+#define FILTER_WORKER_MIN_ROWS    1000
+/** Minimum number of rows before a filter pass is run in the background. */
+#define FILTER_ASYNC_MIN_ROWS     100000
+/** Minimum number of rows before the rows are indexed. */
+#define TRIGRAM_INDEX_MIN_ROWS    50000
+/** Number of rows the hit rate of the tokens is measured on. */
+#define FILTER_SAMPLE_ROWS        256
+
+/**
+ * Part of the rows filtered by a worker.
+ */
+typedef struct
+{
+    /** First row of the chunk. */
+    unsigned int start;
+    /** Number of matching rows, stored in the line_map from start on. */
+    unsigned int count;
+} FilterChunk;
+
 /**
  * Thread state for workers started for the view.
+ * Workers claim chunks of rows from the job until all rows are claimed.
+ * The only thing a worker writes, besides the rows of its chunks, is its own array of chunks.
  */
 typedef struct _thread_state_view
 {
     /** Generic thread state. */
     thread_state  st;
 
-    /** Condition. */
-    GCond         *cond;
-    /** Lock for condition. */
-    GMutex        *mutex;
-    /** Count that is protected by lock. */
-    unsigned int  *acount;
-
-    /** Current state. */
-    RofiViewState *state;
-    /** Start row for this worker. */
-    unsigned int  start;
-    /** Stop row for this worker. */
-    unsigned int  stop;
-    /** Rows processed. */
-    unsigned int  count;
+    /** The filter pass this worker is part of. */
+    RofiFilterJob *job;
+    /** The chunks (FilterChunk) processed by this worker. */
+    GArray        *chunks;
+} thread_state_view;
+
+/**
+ * A filter pass over the rows. Small lists are filtered right away, large lists in the background,
+ * so typing does not have to wait for it. The result is only shown once the pass completes.
+ */
+struct _RofiFilterJob
+{
+    /** The view filtered, NULL once the job is detached from the view. */
+    RofiViewState          *state;
+    /** The filter generation of the view the job was started for. */
+    guint                  generation;
+    /** If the job runs in the background. */
+    gboolean               async;
 
+    /** User input to filter. */
+    char                   *input;
     /** Pattern input to filter. */
-    const char    *pattern;
+    char                   *pattern;
     /** Length of pattern. */
-    glong         plen;
-} thread_state_view;
+    glong                  plen;
+    /** Tokens to match. */
+    rofi_int_matcher       **tokens;
+    /** Prepared pattern to sort with, NULL when not sorting. */
+    RofiMatchString        *pattern_ms;
+    /** Prepared levenshtein pattern, NULL when not sorting on levenshtein distance. */
+    RofiLevenshteinPattern *lev_pattern;
+    /** Prepared fuzzy pattern, NULL when not sorting with the fzf scorer. */
+    RofiFuzzyPattern       *fzf_pattern;
+
+    /** Matching method the pass runs with. */
+    MatchingMethod         method;
+    /** Case sensitivity the pass runs with. */
+    unsigned int           case_sensitive;
+    /** Tokenize setting the pass runs with. */
+    unsigned int           tokenize;
+    /** If the matching rows are scored. */
+    unsigned int           sort;
+
+    /** The matching rows, compacted in place per chunk. When narrowing it starts out with the rows to process. */
+    unsigned int           *line_map;
+    /** Distance of the rows from row first on, NULL when not sorting. The view keeps its own till the pass completes. */
+    int                    *distance;
+    /** Allocated size of line_map and distance. */
+    unsigned int           size;
+    /** Store of the prepared sort keys, the view does not resize it while the pass runs. */
+    RofiMatchStore         *sort_store;
+    /** If only the rows in line_map are processed, instead of all rows. */
+    gboolean               narrow;
+    /** First row filtered, the rows before it are filtered already with the same input. */
+    unsigned int           first;
+    /** Number of rows of the view when the pass started. */
+    unsigned int           num_lines;
+    /** Number of rows to process. */
+    unsigned int           num_rows;
+
+    /** Number of workers. */
+    unsigned int           nt;
+    /** The workers. */
+    thread_state_view      *workers;
+    /** Next row to claim, updated atomically. */
+    gint                   next;
+    /** Set to cancel the job, workers stop after their current chunk. */
+    gint                   cancel;
+    /** Number of workers still running, updated atomically. */
+    gint                   running;
+    /** Number of rows rejected on the bloom of a token, updated atomically. */
+    gint                   bloom_rejects;
+    /** Lock for done. */
+    GMutex                 mutex;
+    /** Signalled when done is set. */
+    GCond                  cond;
+    /** Set, with the lock held, by the last worker to finish. */
+    gboolean               done;
+};
 /**
  * @param data A thread_state object.
  * @param user_data User data to pass to thread_state callback
@@ -632,38 +979,148 @@ static void rofi_view_call_thread ( gpointer data, gpointer user_data )
     t->callback ( t, user_data );
 }
 
+/**
+ * @param state The Menu Handle
+ * @param index The entry to get the sort key for
+ * @param length Set to the length of the key in bytes, -1 if not known
+ * @param copy Set to the copy to free, when the mode can not lend the key
+ *
+ * @returns the string to sort entry index on.
+ */
+static const char *filter_get_sort_key ( RofiViewState *state, unsigned int index, gssize *length, char **copy )
+{
+    const char *key = mode_get_sort_key ( state->sw, index, length );
+    if ( key == NULL ) {
+        key = *copy = mode_get_completion ( state->sw, index );
+    }
+    return key;
+}
+
+/**
+ * @param job The filter pass.
+ * @param i The (unfiltered) index of the matching row.
+ *
+ * Score a matching row, on the prepared sort key so it is only decoded once.
+ */
+static void filter_score_element ( RofiFilterJob *job, unsigned int i )
+{
+    RofiViewState         *state    = job->state;
+    int                   *distance = &( job->distance[i - job->first] );
+    char                  *str      = NULL;
+    const char            *key      = NULL;
+    gssize                klen      = -1;
+    const RofiMatchString *ms       = rofi_match_store_peek ( job->sort_store, i );
+    if ( ms == NULL ) {
+        key = filter_get_sort_key ( state, i, &klen, &str );
+        ms  = rofi_match_store_get ( job->sort_store, i, key, klen );
+    }
+    if ( ms != NULL && job->pattern_ms != NULL ) {
+        switch ( config.sorting_method_enum )
+        {
+        case SORT_FZF:
+            *distance = rofi_scorer_fuzzy_pattern_evaluate ( job->fzf_pattern, ms->ucs, ms->ucs_len );
+            break;
+        case SORT_NORMAL:
+        default:
+            *distance = levenshtein_pattern_distance ( job->lev_pattern, ms->ucs, ms->ucs_len );
+            break;
+        }
+    }
+    else {
+        // Store is full, fall back to the sort key.
+        if ( key == NULL ) {
+            key = filter_get_sort_key ( state, i, &klen, &str );
+        }
+        glong slen = g_utf8_strlen ( key, klen );
+        switch ( config.sorting_method_enum )
+        {
+        case SORT_FZF:
+            *distance = rofi_scorer_fuzzy_evaluate ( job->pattern, job->plen, key, slen );
+            break;
+        case SORT_NORMAL:
+        default:
+            *distance = levenshtein ( job->pattern, job->plen, key, slen );
+            break;
+        }
+    }
+    g_free ( str );
+}
+
+/**
+ * @param job The filter pass.
+ * @param start Set to the first row of the claimed chunk.
+ * @param stop Set to the end of the claimed chunk.
+ *
+ * Claim the next chunk of rows. A chunk is half the remaining rows divided over the workers,
+ * clamped between FILTER_MIN_CHUNK and FILTER_MAX_CHUNK, so chunks shrink as less rows remain.
+ *
+ * @returns TRUE if a chunk is claimed, FALSE when all rows are claimed or the job is cancelled.
+ */
+static gboolean filter_claim_chunk ( RofiFilterJob *job, unsigned int *start, unsigned int *stop )
+{
+    gint next = g_atomic_int_get ( &( job->next ) );
+    while ( (unsigned int) next < job->num_rows && !g_atomic_int_get ( &( job->cancel ) ) ) {
+        unsigned int remaining = job->num_rows - next;
+        unsigned int size      = MIN ( remaining, CLAMP ( remaining / ( 2 * job->nt ), FILTER_MIN_CHUNK, FILTER_MAX_CHUNK ) );
+        if ( g_atomic_int_compare_and_exchange ( &( job->next ), next, (gint) ( next + size ) ) ) {
+            *start = next;
+            *stop  = next + size;
+            return TRUE;
+        }
+        next = g_atomic_int_get ( &( job->next ) );
+    }
+    return FALSE;
+}
+
+/**
+ * Sort FilterChunk on their first row.
+ */
+static gint filter_chunk_sort ( gconstpointer a, gconstpointer b )
+{
+    const FilterChunk *ca = a;
+    const FilterChunk *cb = b;
+    return ( ca->start > cb->start ) - ( ca->start < cb->start );
+}
+
+static gboolean rofi_view_filter_job_idle ( gpointer data );
+
 static void filter_elements ( thread_state *ts, G_GNUC_UNUSED gpointer user_data )
 {
-    thread_state_view *t = (thread_state_view *) ts;
-    for ( unsigned int i = t->start; i < t->stop; i++ ) {
-        int match = mode_token_match ( t->state->sw, t->state->tokens, i );
-        // If each token was matched, add it to list.
-        if ( match ) {
-            t->state->line_map[t->start + t->count] = i;
-            if ( config.sort ) {
-                // This is inefficient, need to fix it.
-                char  * str = mode_get_completion ( t->state->sw, i );
-                glong slen  = g_utf8_strlen ( str, -1 );
-                switch ( config.sorting_method_enum )
-                {
-                case SORT_FZF:
-                    t->state->distance[i] = rofi_scorer_fuzzy_evaluate ( t->pattern, t->plen, str, slen );
-                    break;
-                case SORT_NORMAL:
-                default:
-                    t->state->distance[i] = levenshtein ( t->pattern, t->plen, str, slen );
-                    break;
+    thread_state_view *t   = (thread_state_view *) ts;
+    RofiFilterJob     *job = t->job;
+    unsigned int      start, stop;
+    // Only count the rows of this job.
+    helper_token_match_take_bloom_rejects ();
+    while ( filter_claim_chunk ( job, &start, &stop ) ) {
+        FilterChunk chunk = { start, 0 };
+        for ( unsigned int k = start; k < stop; k++ ) {
+            // Candidates are compacted in place, we never write past the entry we read.
+            unsigned int i     = job->narrow ? job->line_map[k] : k;
+            int          match = mode_token_match ( job->state->sw, job->tokens, i );
+            // If each token was matched, add it to list.
+            if ( match ) {
+                job->line_map[start + chunk.count] = i;
+                if ( job->sort ) {
+                    filter_score_element ( job, i );
                 }
-                g_free ( str );
+                chunk.count++;
             }
-            t->count++;
         }
+        g_array_append_val ( t->chunks, chunk );
     }
-    if ( t->acount != NULL  ) {
-        g_mutex_lock ( t->mutex );
-        ( *( t->acount ) )--;
-        g_cond_signal ( t->cond );
-        g_mutex_unlock ( t->mutex );
+    g_atomic_int_add ( &( job->bloom_rejects ), helper_token_match_take_bloom_rejects () );
+    // Only the last worker to finish takes the lock.
+    if ( g_atomic_int_dec_and_test ( &( job->running ) ) ) {
+        // A job that is not in the background can be freed as soon as done is set.
+        gboolean async = job->async;
+        g_mutex_lock ( &( job->mutex ) );
+        job->done = TRUE;
+        g_cond_signal ( &( job->cond ) );
+        g_mutex_unlock ( &( job->mutex ) );
+        if ( async ) {
+            // Hand the result to the main loop.
+            g_idle_add ( rofi_view_filter_job_idle, job );
+        }
     }
 }
 static void rofi_view_setup_fake_transparency ( const char* const fake_background )
@@ -902,9 +1359,10 @@ static void rofi_view_calculate_window_width ( RofiViewState *state )
  */
 static void rofi_view_nav_row_tab ( RofiViewState *state )
 {
+    rofi_view_filter_flush ( state );
     if ( state->filtered_lines == 1 ) {
         state->retv              = MENU_OK;
-        ( state->selected_line ) = state->line_map[listview_get_selected ( state->list_view )];
+        ( state->selected_line ) = rofi_view_line_map ( state, listview_get_selected ( state->list_view ) );
         state->quit              = 1;
         return;
     }
@@ -930,10 +1388,11 @@ inline static void rofi_view_nav_row_select ( RofiViewState *state )
     if ( state->list_view == NULL ) {
         return;
     }
+    rofi_view_filter_flush ( state );
     unsigned int selected = listview_get_selected ( state->list_view );
     // If a valid item is selected, return that..
     if ( selected < state->filtered_lines ) {
-        char *str = mode_get_completion ( state->sw, state->line_map[selected] );
+        char *str = mode_get_completion ( state->sw, rofi_view_line_map ( state, selected ) );
         textbox_text ( state->text, str );
         g_free ( str );
         textbox_keybinding ( state->text, MOVE_END );
@@ -973,7 +1432,7 @@ static void update_callback ( textbox *t, icon *ico, unsigned int index, void *u
     if ( full ) {
         GList *add_list = NULL;
         int   fstate    = 0;
-        char  *text     = mode_get_display_value ( state->sw, state->line_map[index], &fstate, &add_list, TRUE );
+        char  *text     = mode_get_display_value ( state->sw, rofi_view_line_map ( state, index ), &fstate, &add_list, TRUE );
         ( *type ) |= fstate;
         // TODO needed for markup.
         textbox_font ( t, *type );
@@ -988,14 +1447,15 @@ static void update_callback ( textbox *t, icon *ico, unsigned int index, void *u
         }
         if ( ico ) {
             int             icon_height = widget_get_desired_height ( WIDGET ( ico ) );
-            cairo_surface_t *icon       = mode_get_icon ( state->sw, state->line_map[index], icon_height );
+            cairo_surface_t *icon       = mode_get_icon ( state->sw, rofi_view_line_map ( state, index ), icon_height );
             icon_set_surface ( ico, icon );
         }
 
         if ( state->tokens && config.show_match ) {
             RofiHighlightColorStyle th = { ROFI_HL_BOLD | ROFI_HL_UNDERLINE, { 0.0, 0.0, 0.0, 0.0 } };
             th = rofi_theme_get_highlight ( WIDGET ( t ), "highlight", th );
-            helper_token_match_get_pango_attr ( th, state->tokens, textbox_get_visible_text ( t ), list );
+            const RofiViewHighlight *hl = rofi_view_highlight_get ( state, rofi_view_line_map ( state, index ), textbox_get_visible_text ( t ) );
+            helper_token_match_spans_pango_attr ( th, hl->spans, hl->num_spans, list );
         }
         for ( GList *iter = g_list_first ( add_list ); iter != NULL; iter = g_list_next ( iter ) ) {
             pango_attr_list_insert ( list, (PangoAttribute *) ( iter->data ) );
@@ -1007,7 +1467,7 @@ static void update_callback ( textbox *t, icon *ico, unsigned int index, void *u
     }
     else {
         int fstate = 0;
-        mode_get_display_value ( state->sw, state->line_map[index], &fstate, NULL, FALSE );
+        mode_get_display_value ( state->sw, rofi_view_line_map ( state, index ), &fstate, NULL, FALSE );
         ( *type ) |= fstate;
         // TODO needed for markup.
         textbox_font ( t, *type );
@@ -1053,96 +1513,545 @@ void rofi_view_update ( RofiViewState *state, gboolean qr )
     }
 }
 
+/**
+ * @param state The Menu Handle
+ *
+ * Forget the previous filter pass, the next pass has to go over all rows.
+ */
+static void rofi_view_last_filter_clear ( RofiViewState *state )
+{
+    g_free ( state->last_filter.input );
+    g_free ( state->last_filter.pattern );
+    state->last_filter.input   = NULL;
+    state->last_filter.pattern = NULL;
+}
+
+/**
+ * @param state The Menu Handle
+ * @param input The user input.
+ * @param pattern The preprocessed user input.
+ * @param tokens The tokens for pattern.
+ *
+ * Check if the result of the previous filter pass is a superset of the result for pattern.
+ * This is the case when the input only grew and no token can widen the result when it grows.
+ *
+ * @returns TRUE if only the rows in the current line_map need to be filtered.
+ */
+static gboolean rofi_view_refilter_can_narrow ( const RofiViewState *state, const char *input, const char *pattern, rofi_int_matcher **tokens )
+{
+    if ( state->last_filter.input == NULL || state->last_filter.pattern == NULL || pattern == NULL ) {
+        return FALSE;
+    }
+    if ( state->last_filter.num_lines != state->num_lines ) {
+        return FALSE;
+    }
+    if ( state->last_filter.method != config.matching_method ||
+         state->last_filter.case_sensitive != config.case_sensitive ||
+         state->last_filter.tokenize != config.tokenize ) {
+        return FALSE;
+    }
+    // A growing regex can match more ('a' -> 'a|b').
+    if ( config.matching_method == MM_REGEX ) {
+        return FALSE;
+    }
+    // Check both, some modes keep state based on the input. (e.g. combi)
+    if ( !g_str_has_prefix ( input, state->last_filter.input ) || !g_str_has_prefix ( pattern, state->last_filter.pattern ) ) {
+        return FALSE;
+    }
+    // A growing inverted token matches more.
+    for ( unsigned int j = 0; tokens && tokens[j]; j++ ) {
+        if ( tokens[j]->invert ) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/**
+ * @param state The Menu Handle
+ *
+ * Start indexing the rows in the background, if the list is long enough.
+ * Should only be called when the rows are not changing.
+ */
+static void rofi_view_trigram_index_start ( RofiViewState *state )
+{
+    if ( !config.trigram_index || state->trigram_index != NULL || state->num_lines < TRIGRAM_INDEX_MIN_ROWS ||
+         !mode_has_match_text ( state->sw ) ) {
+        return;
+    }
+    state->trigram_index = rofi_trigram_index_new ( state->sw, state->num_lines, MAX ( 1, config.threads ) );
+    TICK_N ( "Trigram index started" );
+}
+
+/**
+ * @param state The Menu Handle
+ *
+ * Drop the index of the rows, e.g. because the rows change.
+ */
+static void rofi_view_trigram_index_clear ( RofiViewState *state )
+{
+    rofi_trigram_index_free ( state->trigram_index );
+    state->trigram_index = NULL;
+}
+
+/**
+ * @param job The filter pass.
+ *
+ * Measure the hit rate of each token on a sample of the rows to filter, and evaluate the tokens that
+ * reject the most rows first. Only done when there are many more rows than samples.
+ */
+static void rofi_view_filter_sample_tokens ( RofiFilterJob *job )
+{
+    rofi_int_matcher **tokens = job->tokens;
+    if ( tokens == NULL || tokens[0] == NULL || tokens[1] == NULL || job->num_rows < ( 64 * FILTER_SAMPLE_ROWS ) ) {
+        return;
+    }
+    unsigned int num_tokens = 0;
+    while ( tokens[num_tokens] != NULL ) {
+        num_tokens++;
+    }
+    // The tokens are shared with other passes, the rates measured for this pass are kept here.
+    double *hit_rates = g_new ( double, num_tokens );
+    for ( unsigned int j = 0; j < num_tokens; j++ ) {
+        rofi_int_matcher *ftokens[2] = { tokens[j], NULL };
+        unsigned int     hits        = 0;
+        for ( unsigned int s = 0; s < FILTER_SAMPLE_ROWS; s++ ) {
+            unsigned int k = ( (guint64) s * job->num_rows ) / FILTER_SAMPLE_ROWS;
+            unsigned int i = job->narrow ? job->line_map[k] : k;
+            hits += mode_token_match ( job->state->sw, ftokens, i ) ? 1 : 0;
+        }
+        hit_rates[j] = ( hits + 1.0 ) / ( FILTER_SAMPLE_ROWS + 2.0 );
+    }
+    // Only the token array of this pass is reordered.
+    helper_tokenize_sort ( tokens, hit_rates );
+    g_free ( hit_rates );
+    TICK_N ( "Filter sample tokens" );
+}
+
 static void _rofi_view_reload_row ( RofiViewState *state )
 {
+    rofi_view_trigram_index_clear ( state );
+    rofi_view_last_filter_clear ( state );
+    rofi_view_filter_cache_clear ( state );
     g_free ( state->line_map );
     g_free ( state->distance );
-    state->num_lines = mode_get_num_entries ( state->sw );
-    state->line_map  = g_malloc0_n ( state->num_lines, sizeof ( unsigned int ) );
-    state->distance  = g_malloc0_n ( state->num_lines, sizeof ( int ) );
+    rofi_match_store_free ( state->sort_store );
+    state->num_lines      = mode_get_num_entries ( state->sw );
+    state->lines_size     = state->num_lines;
+    state->line_map       = g_malloc0_n ( state->num_lines, sizeof ( unsigned int ) );
+    state->distance       = g_malloc0_n ( state->num_lines, sizeof ( int ) );
+    state->sort_store     = rofi_match_store_new ( state->num_lines, TRUE );
+    rofi_rank_clear ( &( state->rank ), 0 );
     listview_set_max_lines ( state->list_view, state->num_lines );
     rofi_view_reload_message_bar ( state );
 }
 
-static void rofi_view_refilter ( RofiViewState *state )
+/**
+ * @param state The Menu Handle
+ * @param rows Set to the rows currently shown, in index order.
+ *
+ * @returns the number of rows stored in rows.
+ */
+static unsigned int rofi_view_filter_get_rows ( const RofiViewState *state, unsigned int *rows )
 {
-    TICK_N ( "Filter start" );
-    if ( state->reload ) {
-        _rofi_view_reload_row ( state );
-        state->reload = FALSE;
+    if ( !state->last_filter.sorted ) {
+        memcpy ( rows, state->line_map, state->filtered_lines * sizeof ( unsigned int ) );
+        return state->filtered_lines;
     }
-    TICK_N ( "Filter reload rows" );
-    if ( state->tokens ) {
-        helper_tokenize_free ( state->tokens );
-        state->tokens = NULL;
+    // The rows are (partially) ranked, restore the index order by marking them in a bitmap.
+    const unsigned int bits_per_word = sizeof ( gulong ) * 8;
+    unsigned int       num_words     = state->num_lines / bits_per_word + 1;
+    gulong             *bits         = g_new0 ( gulong, num_words );
+    for ( unsigned int i = 0; i < state->rank.sorted; i++ ) {
+        bits[state->line_map[i] / bits_per_word] |= 1UL << ( state->line_map[i] % bits_per_word );
     }
-    TICK_N ( "Filter tokenize" );
-    if ( state->text && strlen ( state->text->text ) > 0 ) {
-        unsigned int j        = 0;
-        gchar        *pattern = mode_preprocess_input ( state->sw, state->text->text );
-        glong        plen     = pattern ? g_utf8_strlen ( pattern, -1 ) : 0;
-        state->tokens = helper_tokenize ( pattern, config.case_sensitive );
-        /**
-         * On long lists it can be beneficial to parallelize.
-         * If number of threads is 1, no thread is spawn.
-         * If number of threads > 1 and there are enough (> 1000) items, spawn jobs for the thread pool.
-         * For large lists with 8 threads I see a factor three speedup of the whole function.
-         */
-        unsigned int      nt = MAX ( 1, state->num_lines / 500 );
-        thread_state_view states[nt];
-        GCond             cond;
-        GMutex            mutex;
-        g_mutex_init ( &mutex );
-        g_cond_init ( &cond );
-        unsigned int count = nt;
-        unsigned int steps = ( state->num_lines + nt ) / nt;
-        for ( unsigned int i = 0; i < nt; i++ ) {
-            states[i].state       = state;
-            states[i].start       = i * steps;
-            states[i].stop        = MIN ( state->num_lines, ( i + 1 ) * steps );
-            states[i].count       = 0;
-            states[i].cond        = &cond;
-            states[i].mutex       = &mutex;
-            states[i].acount      = &count;
-            states[i].plen        = plen;
-            states[i].pattern     = pattern;
-            states[i].st.callback = filter_elements;
-            if ( i > 0 ) {
-                g_thread_pool_push ( tpool, &states[i], NULL );
-            }
+    for ( unsigned int i = 0; i < state->rank.heap_size; i++ ) {
+        unsigned int index = (unsigned int) ( state->rank.keys[i] & G_MAXUINT32 );
+        bits[index / bits_per_word] |= 1UL << ( index % bits_per_word );
+    }
+    unsigned int j = 0;
+    for ( unsigned int w = 0; w < num_words; w++ ) {
+        gulong word = bits[w];
+        while ( word != 0 ) {
+            rows[j++] = w * bits_per_word + g_bit_nth_lsf ( word, -1 );
+            word     &= word - 1;
         }
-        // Run one in this thread.
-        rofi_view_call_thread ( &states[0], NULL );
-        // No need to do this with only one thread.
-        if ( nt > 1 ) {
-            g_mutex_lock ( &mutex );
-            while ( count > 0 ) {
-                g_cond_wait ( &cond, &mutex );
-            }
-            g_mutex_unlock ( &mutex );
+    }
+    g_free ( bits );
+    return j;
+}
+
+/**
+ * @param state The Menu Handle
+ * @param input The user input.
+ * @param pattern The preprocessed user input, the job takes ownership.
+ * @param tokens The tokens for pattern, the job takes ownership.
+ * @param first The first row to filter, the rows before it are already filtered with the same input.
+ *
+ * Create a filter pass, start it with rofi_view_filter_job_start. A pass from the first row
+ * is finished with rofi_view_filter_job_finish, a pass over appended rows with rofi_view_filter_job_append.
+ *
+ * @returns a new filter pass.
+ */
+static RofiFilterJob *rofi_view_filter_job_new ( RofiViewState *state, const char *input, char *pattern, rofi_int_matcher **tokens, unsigned int first )
+{
+    RofiFilterJob *job = g_malloc0 ( sizeof ( RofiFilterJob ) );
+    job->state          = state;
+    job->generation     = state->filter_generation;
+    job->input          = g_strdup ( input );
+    job->pattern        = pattern;
+    job->plen           = pattern ? g_utf8_strlen ( pattern, -1 ) : 0;
+    job->tokens         = tokens;
+    job->method         = config.matching_method;
+    job->case_sensitive = config.case_sensitive;
+    job->tokenize       = config.tokenize;
+    job->sort           = config.sort;
+    job->sort_store     = state->sort_store;
+    job->first          = first;
+    job->num_lines      = state->num_lines;
+    job->num_rows       = state->num_lines - first;
+    // The result replaces the line_map (and distance) of the view, so it gets the same size.
+    job->size     = MAX ( 1, ( first > 0 ) ? job->num_rows : state->lines_size );
+    job->line_map = g_malloc_n ( job->size, sizeof ( unsigned int ) );
+    if ( job->sort ) {
+        job->distance = g_malloc_n ( job->size, sizeof ( int ) );
+    }
+    if ( first > 0 ) {
+        // Only the appended rows.
+        job->narrow = TRUE;
+        for ( unsigned int k = 0; k < job->num_rows; k++ ) {
+            job->line_map[k] = first + k;
         }
-        g_cond_clear ( &cond );
-        g_mutex_clear ( &mutex );
-        for ( unsigned int i = 0; i < nt; i++ ) {
-            if ( j != states[i].start ) {
-                memmove ( &( state->line_map[j] ), &( state->line_map[states[i].start] ), sizeof ( unsigned int ) * ( states[i].count ) );
-            }
-            j += states[i].count;
+    }
+    /**
+     * If the query only narrowed down, only the rows that matched the previous query
+     * can match this one. Filter those, instead of all the rows.
+     */
+    else if ( rofi_view_refilter_can_narrow ( state, input, pattern, tokens ) ) {
+        job->narrow   = TRUE;
+        job->num_rows = rofi_view_filter_get_rows ( state, job->line_map );
+        TICK_N ( "Filter narrow previous result" );
+    }
+    /**
+     * Otherwise only the rows that contain all trigrams of the plain tokens can match.
+     */
+    else if ( state->trigram_index != NULL && rofi_trigram_index_ready ( state->trigram_index ) ) {
+        int n = rofi_trigram_index_query ( state->trigram_index, tokens, state->num_lines, job->line_map );
+        if ( n >= 0 ) {
+            job->narrow   = TRUE;
+            job->num_rows = n;
+            g_debug ( "Trigram index: %u of %u rows are candidates.", job->num_rows, state->num_lines );
+            TICK_N ( "Filter trigram index" );
+        }
+    }
+    rofi_view_filter_sample_tokens ( job );
+    // The pattern is prepared once, not for every row.
+    if ( job->sort ) {
+        job->pattern_ms = rofi_match_string_new ( pattern, TRUE );
+        if ( config.sorting_method_enum == SORT_FZF ) {
+            job->fzf_pattern = rofi_scorer_fuzzy_pattern_new ( job->pattern_ms->ucs, job->pattern_ms->ucs_len );
         }
-        if ( config.sort ) {
-            g_qsort_with_data ( state->line_map, j, sizeof ( int ), lev_sort, state->distance );
+        else {
+            job->lev_pattern = levenshtein_pattern_new ( job->pattern_ms->ucs, job->pattern_ms->ucs_len );
+        }
+    }
+    /**
+     * On long lists it can be beneficial to parallelize.
+     * If number of threads is 1, no thread is spawn.
+     * Otherwise one worker per thread is started (if there are enough rows), the workers divide the rows between
+     * them in chunks, so a worker that hits expensive rows does not hold up the others.
+     */
+    job->nt      = CLAMP ( job->num_rows / FILTER_WORKER_MIN_ROWS, 1, MAX ( 1, config.threads ) );
+    job->running = job->nt;
+    job->workers = g_new0 ( thread_state_view, job->nt );
+    for ( unsigned int i = 0; i < job->nt; i++ ) {
+        job->workers[i].st.callback = filter_elements;
+        job->workers[i].job         = job;
+        job->workers[i].chunks      = g_array_new ( FALSE, FALSE, sizeof ( FilterChunk ) );
+    }
+    g_mutex_init ( &( job->mutex ) );
+    g_cond_init ( &( job->cond ) );
+    return job;
+}
+
+/**
+ * @param job The filter pass to free.
+ *
+ * Free a filter pass that is done, or was never started.
+ */
+static void rofi_view_filter_job_free ( RofiFilterJob *job )
+{
+    for ( unsigned int i = 0; i < job->nt; i++ ) {
+        if ( job->workers[i].chunks != NULL ) {
+            g_array_free ( job->workers[i].chunks, TRUE );
         }
+    }
+    g_free ( job->workers );
+    g_mutex_clear ( &( job->mutex ) );
+    g_cond_clear ( &( job->cond ) );
+    rofi_match_string_free ( job->pattern_ms );
+    levenshtein_pattern_free ( job->lev_pattern );
+    rofi_scorer_fuzzy_pattern_free ( job->fzf_pattern );
+    if ( job->tokens ) {
+        helper_tokenize_free ( job->tokens );
+    }
+    g_free ( job->line_map );
+    g_free ( job->distance );
+    g_free ( job->pattern );
+    g_free ( job->input );
+    g_free ( job );
+}
 
-        // Cleanup + bookkeeping.
-        state->filtered_lines = j;
-        g_free ( pattern );
+/**
+ * @param job The filter pass.
+ *
+ * Wait till all workers of the filter pass stopped.
+ */
+static void rofi_view_filter_job_wait ( RofiFilterJob *job )
+{
+    g_mutex_lock ( &( job->mutex ) );
+    while ( !job->done ) {
+        g_cond_wait ( &( job->cond ), &( job->mutex ) );
     }
-    else{
-        for ( unsigned int i = 0; i < state->num_lines; i++ ) {
-            state->line_map[i] = i;
+    g_mutex_unlock ( &( job->mutex ) );
+}
+
+/**
+ * @param job The filter pass.
+ *
+ * Start the filter pass. In the background the result is handed to the main loop when it completes,
+ * otherwise this returns when the filter pass is done.
+ */
+static void rofi_view_filter_job_start ( RofiFilterJob *job )
+{
+    GThreadPool *pool = job->async ? filter_pool : tpool;
+    for ( unsigned int i = job->async ? 0 : 1; i < job->nt; i++ ) {
+        g_thread_pool_push ( pool, &( job->workers[i] ), NULL );
+    }
+    if ( !job->async ) {
+        // Run one in this thread.
+        rofi_view_call_thread ( &( job->workers[0] ), NULL );
+        rofi_view_filter_job_wait ( job );
+    }
+}
+
+/**
+ * @param state The Menu Handle
+ * @param input The user input.
+ * @param pattern The preprocessed user input, the view takes ownership.
+ * @param tokens The tokens for pattern, the view takes ownership.
+ * @param num_lines The number of rows that were filtered.
+ *
+ * Rank the filter result in the line_map and remember what it was filtered with.
+ */
+static void rofi_view_filter_done ( RofiViewState *state, const char *input, char *pattern, rofi_int_matcher **tokens, unsigned int num_lines )
+{
+    rofi_view_set_tokens ( state, tokens );
+    char buffer[64];
+    g_snprintf ( buffer, sizeof ( buffer ), "Filter cache (hits: %u misses: %u)", state->filter_cache_hits, state->filter_cache_misses );
+    TICK_N ( buffer );
+    if ( config.sort ) {
+        rofi_rank_init ( &( state->rank ), state->line_map, state->distance, state->filtered_lines );
+        TICK_N ( "Filter rank" );
+    }
+    else {
+        rofi_rank_clear ( &( state->rank ), state->filtered_lines );
+    }
+
+    // Cleanup + bookkeeping.
+    rofi_view_last_filter_clear ( state );
+    state->last_filter.input          = g_strdup ( input );
+    state->last_filter.pattern        = pattern;
+    state->last_filter.method         = config.matching_method;
+    state->last_filter.case_sensitive = config.case_sensitive;
+    state->last_filter.tokenize       = config.tokenize;
+    state->last_filter.sorted         = config.sort;
+    state->last_filter.num_lines      = num_lines;
+}
+
+/**
+ * @param job The completed filter pass.
+ *
+ * Compact the matches of all chunks of the workers, in row order, at the start of the line_map of the job.
+ *
+ * @returns the number of matches.
+ */
+static unsigned int rofi_view_filter_job_compact ( RofiFilterJob *job )
+{
+    GArray *chunks = job->workers[0].chunks;
+    for ( unsigned int i = 1; i < job->nt; i++ ) {
+        g_array_append_vals ( chunks, job->workers[i].chunks->data, job->workers[i].chunks->len );
+    }
+    g_array_sort ( chunks, filter_chunk_sort );
+    unsigned int j = 0;
+    for ( unsigned int i = 0; i < chunks->len; i++ ) {
+        FilterChunk *chunk = &g_array_index ( chunks, FilterChunk, i );
+        if ( j != chunk->start ) {
+            memmove ( &( job->line_map[j] ), &( job->line_map[chunk->start] ), sizeof ( unsigned int ) * ( chunk->count ) );
         }
-        state->filtered_lines = state->num_lines;
+        j += chunk->count;
     }
+    char buffer[64];
+    g_snprintf ( buffer, sizeof ( buffer ), "Filter bloom (rejected: %d of %u rows)", g_atomic_int_get ( &( job->bloom_rejects ) ), job->num_rows );
+    TICK_N ( buffer );
+    return j;
+}
+
+/**
+ * @param job The completed filter pass.
+ *
+ * Compact the matches of the workers into the line_map of the view, and detach the job from the view.
+ */
+static void rofi_view_filter_job_finish ( RofiFilterJob *job )
+{
+    RofiViewState *state = job->state;
+    unsigned int  j      = rofi_view_filter_job_compact ( job );
+    if ( job->size < state->lines_size ) {
+        // Rows were appended while the pass ran.
+        job->size     = state->lines_size;
+        job->line_map = g_renew ( unsigned int, job->line_map, job->size );
+        if ( job->distance != NULL ) {
+            job->distance = g_renew ( int, job->distance, job->size );
+        }
+    }
+    // Swap in the result, the old line_map and distance are freed with the job.
+    unsigned int *line_map = state->line_map;
+    state->line_map       = job->line_map;
+    state->filtered_lines = j;
+    job->line_map         = line_map;
+    if ( job->distance != NULL ) {
+        int *distance = state->distance;
+        state->distance = job->distance;
+        job->distance   = distance;
+    }
+    rofi_match_store_resize ( state->sort_store, state->num_lines );
+
+    if ( job->num_lines == state->num_lines ) {
+        rofi_view_filter_cache_insert ( state, job->input, job->pattern );
+    }
+    else {
+        // Filter the rows appended while the pass ran.
+        state->append   = TRUE;
+        state->refilter = TRUE;
+    }
+    rofi_view_filter_done ( state, job->input, job->pattern, job->tokens, job->num_lines );
+    job->pattern = NULL;
+    job->tokens  = NULL;
+
+    state->filter_job = NULL;
+    job->state        = NULL;
+}
+
+/**
+ * @param job The completed filter pass over the appended rows.
+ *
+ * Merge the matches of the appended rows into the result of the previous pass, in the order it is in.
+ */
+static void rofi_view_filter_job_append ( RofiFilterJob *job )
+{
+    RofiViewState *state = job->state;
+    unsigned int  j      = rofi_view_filter_job_compact ( job );
+    for ( unsigned int k = 0; job->distance != NULL && k < j; k++ ) {
+        state->distance[job->line_map[k]] = job->distance[job->line_map[k] - job->first];
+    }
+    if ( state->last_filter.sorted ) {
+        state->filtered_lines += j;
+        rofi_rank_append ( &( state->rank ), state->line_map, state->distance, state->filtered_lines, job->line_map, j );
+    }
+    else {
+        // The appended rows come after all rows in the line_map.
+        memcpy ( &( state->line_map[state->filtered_lines] ), job->line_map, j * sizeof ( unsigned int ) );
+        state->filtered_lines += j;
+        rofi_rank_clear ( &( state->rank ), state->filtered_lines );
+    }
+    state->last_filter.num_lines = job->num_lines;
+    job->state                   = NULL;
+}
+
+/**
+ * @param state The Menu Handle
+ *
+ * Cancel the filter pass running in the background, and wait till its workers stopped.
+ * The view keeps showing the previous result.
+ */
+static void rofi_view_filter_cancel ( RofiViewState *state )
+{
+    RofiFilterJob *job = state->filter_job;
+    if ( job == NULL ) {
+        return;
+    }
+    g_atomic_int_set ( &( job->cancel ), TRUE );
+    rofi_view_filter_job_wait ( job );
+    rofi_match_store_resize ( state->sort_store, state->num_lines );
+    // The job is freed when its result reaches the main loop.
+    state->filter_job = NULL;
+    job->state        = NULL;
+    TICK_N ( "Filter cancel" );
+}
+
+static void rofi_view_refilter_update ( RofiViewState *state );
+
+/**
+ * @param state The Menu Handle
+ *
+ * Complete the filter pass running in the background and show its result, e.g. before the selected row is accepted.
+ */
+static void rofi_view_filter_flush ( RofiViewState *state )
+{
+    RofiFilterJob *job = state->filter_job;
+    if ( job == NULL ) {
+        return;
+    }
+    rofi_view_filter_job_wait ( job );
+    rofi_view_filter_job_finish ( job );
+    rofi_view_refilter_update ( state );
+    TICK_N ( "Filter flush" );
+}
+
+/**
+ * @param data The completed RofiFilterJob
+ *
+ * Show the result of a filter pass that ran in the background, if it is still the current one.
+ *
+ * @returns G_SOURCE_REMOVE
+ */
+static gboolean rofi_view_filter_job_idle ( gpointer data )
+{
+    RofiFilterJob *job   = (RofiFilterJob *) data;
+    RofiViewState *state = job->state;
+    if ( state != NULL && job->generation == state->filter_generation ) {
+        rofi_view_filter_job_finish ( job );
+        rofi_view_refilter_update ( state );
+        rofi_view_queue_redraw ();
+        TICK_N ( "Filter background done" );
+    }
+    rofi_view_filter_job_free ( job );
+    return G_SOURCE_REMOVE;
+}
+
+void rofi_view_filter_sync ( RofiViewState *state )
+{
+    if ( state == NULL ) {
+        return;
+    }
+    // The index is built from the rows.
+    rofi_view_trigram_index_clear ( state );
+    if ( state->filter_job == NULL ) {
+        return;
+    }
+    rofi_view_filter_cancel ( state );
+    // Filter again, the rows are about to change.
+    state->refilter = TRUE;
+    rofi_view_queue_redraw ();
+}
+
+/**
+ * @param state The Menu Handle
+ *
+ * Update the view after the line_map changed.
+ */
+static void rofi_view_refilter_update ( RofiViewState *state )
+{
     TICK_N ( "Filter matching done" );
     listview_set_num_elements ( state->list_view, state->filtered_lines );
 
@@ -1159,7 +2068,7 @@ static void rofi_view_refilter ( RofiViewState *state )
     TICK_N ( "Update filter lines" );
 
     if ( config.auto_select == TRUE && state->filtered_lines == 1 && state->num_lines > 1 ) {
-        ( state->selected_line ) = state->line_map[listview_get_selected ( state->list_view  )];
+        ( state->selected_line ) = rofi_view_line_map ( state, listview_get_selected ( state->list_view  ) );
         state->retv              = MENU_OK;
         state->quit              = TRUE;
     }
@@ -1173,6 +2082,173 @@ static void rofi_view_refilter ( RofiViewState *state )
         g_debug ( "Resize based on re-filter" );
     }
     TICK_N ( "Filter resize window based on window " );
+}
+
+/**
+ * @param state The Menu Handle
+ *
+ * Make room for the rows appended to the mode since the last reload, without filtering them.
+ */
+static void rofi_view_grow_rows ( RofiViewState *state )
+{
+    unsigned int num = mode_get_num_entries ( state->sw );
+    // The index and the cached results do not cover the new rows.
+    rofi_view_trigram_index_clear ( state );
+    rofi_view_filter_cache_clear ( state );
+    if ( num > state->lines_size ) {
+        state->lines_size = MAX ( num, state->lines_size * 2 );
+        state->line_map   = g_renew ( unsigned int, state->line_map, state->lines_size );
+        state->distance   = g_renew ( int, state->distance, state->lines_size );
+    }
+    if ( state->filter_job == NULL ) {
+        // Otherwise it is resized when the pass stops.
+        rofi_match_store_resize ( state->sort_store, num );
+    }
+    state->num_lines = num;
+    listview_set_max_lines ( state->list_view, state->num_lines );
+    rofi_view_reload_message_bar ( state );
+}
+
+/**
+ * @param state The Menu Handle
+ *
+ * Add the rows appended to the mode since the last reload, and the rows appended while the previous pass ran.
+ * Only the new rows are filtered, with the input of the previous filter pass, and merged into its result.
+ *
+ * @returns TRUE if the new rows are merged into the result, FALSE if a complete filter pass is needed.
+ */
+static gboolean rofi_view_append_rows ( RofiViewState *state )
+{
+    unsigned int shown = state->num_lines;
+    rofi_view_grow_rows ( state );
+    unsigned int num = state->num_lines;
+
+    const char   *input = ( state->text != NULL ) ? state->text->text : "";
+    if ( input[0] == '\0' ) {
+        // Nothing was filtered, all rows are shown.
+        if ( state->tokens != NULL || state->filtered_lines != shown ) {
+            return FALSE;
+        }
+        for ( unsigned int i = shown; i < num; i++ ) {
+            state->line_map[i] = i;
+        }
+        state->filtered_lines = num;
+        rofi_rank_clear ( &( state->rank ), state->filtered_lines );
+        return TRUE;
+    }
+    if ( state->last_filter.input == NULL || state->last_filter.pattern == NULL || state->last_filter.num_lines > num ||
+         strcmp ( state->last_filter.input, input ) != 0 || state->last_filter.method != config.matching_method ||
+         state->last_filter.case_sensitive != config.case_sensitive || state->last_filter.tokenize != config.tokenize ||
+         state->last_filter.sorted != config.sort ) {
+        return FALSE;
+    }
+    unsigned int first = state->last_filter.num_lines;
+    if ( num > first ) {
+        char             *pattern = g_strdup ( state->last_filter.pattern );
+        rofi_int_matcher **tokens = helper_tokenize ( pattern, config.case_sensitive );
+        RofiFilterJob    *job     = rofi_view_filter_job_new ( state, input, pattern, tokens, first );
+        rofi_view_filter_job_start ( job );
+        rofi_view_filter_job_append ( job );
+        rofi_view_filter_job_free ( job );
+    }
+    return TRUE;
+}
+
+/**
+ * @param state The Menu Handle
+ *
+ * Check if the filter pass running in the background still is what the view would start now,
+ * and only rows were appended since. The rows it has not seen are filtered when it completes.
+ *
+ * @returns TRUE if the pass in the background can be kept.
+ */
+static gboolean rofi_view_filter_job_current ( const RofiViewState *state )
+{
+    const RofiFilterJob *job = state->filter_job;
+    if ( job == NULL || state->reload || !state->append ) {
+        return FALSE;
+    }
+    return g_strcmp0 ( job->input, ( state->text != NULL ) ? state->text->text : "" ) == 0 &&
+           job->method == config.matching_method && job->case_sensitive == config.case_sensitive &&
+           job->tokenize == config.tokenize && job->sort == config.sort;
+}
+
+static void rofi_view_refilter ( RofiViewState *state )
+{
+    TICK_N ( "Filter start" );
+    if ( state->append && !state->reload && mode_get_num_entries ( state->sw ) < state->num_lines ) {
+        // Rows were removed after all.
+        state->reload = TRUE;
+    }
+    if ( rofi_view_filter_job_current ( state ) ) {
+        // Do not restart the pass for every batch of rows streamed in.
+        state->append = FALSE;
+        rofi_view_grow_rows ( state );
+        rofi_view_refilter_update ( state );
+        state->refilter = FALSE;
+        TICK_N ( "Filter appended rows to background pass" );
+        return;
+    }
+    // A new pass replaces the one running in the background.
+    rofi_view_filter_cancel ( state );
+    state->filter_generation++;
+    gboolean reloaded = state->reload;
+    if ( state->reload ) {
+        _rofi_view_reload_row ( state );
+        state->reload = FALSE;
+        state->append = FALSE;
+    }
+    else if ( state->append ) {
+        state->append = FALSE;
+        if ( rofi_view_append_rows ( state ) ) {
+            TICK_N ( "Filter appended rows" );
+            rofi_view_refilter_update ( state );
+            state->refilter = FALSE;
+            return;
+        }
+        // The shown rows are still valid, so a complete pass can run in the background.
+    }
+    else {
+        // The rows did not change since the last pass, so they likely are all loaded.
+        rofi_view_trigram_index_start ( state );
+    }
+    TICK_N ( "Filter reload rows" );
+    if ( state->text && strlen ( state->text->text ) > 0 ) {
+        gchar            *pattern = mode_preprocess_input ( state->sw, state->text->text );
+        rofi_int_matcher **tokens = helper_tokenize ( pattern, config.case_sensitive );
+        TICK_N ( "Filter tokenize" );
+        if ( rofi_view_filter_cache_lookup ( state, state->text->text, pattern ) ) {
+            TICK_N ( "Filter cache hit" );
+            rofi_view_filter_done ( state, state->text->text, pattern, tokens, state->num_lines );
+        }
+        else {
+            RofiFilterJob *job = rofi_view_filter_job_new ( state, state->text->text, pattern, tokens, 0 );
+            /**
+             * Long lists are filtered in the background, the previous result stays shown till it completes.
+             * After a reload the rows in the line_map are no longer valid, so then it is not done in the background.
+             */
+            job->async = !reloaded && filter_pool != NULL && job->num_rows >= FILTER_ASYNC_MIN_ROWS;
+            rofi_view_filter_job_start ( job );
+            if ( job->async ) {
+                state->filter_job = job;
+                state->refilter   = FALSE;
+                TICK_N ( "Filter started in background" );
+                return;
+            }
+            rofi_view_filter_job_finish ( job );
+            rofi_view_filter_job_free ( job );
+        }
+    }
+    else{
+        rofi_view_set_tokens ( state, NULL );
+        for ( unsigned int i = 0; i < state->num_lines; i++ ) {
+            state->line_map[i] = i;
+        }
+        state->filtered_lines = state->num_lines;
+        rofi_rank_clear ( &( state->rank ), state->filtered_lines );
+        rofi_view_last_filter_clear ( state );
+    }
+    rofi_view_refilter_update ( state );
     state->refilter = FALSE;
     TICK_N ( "Filter done" );
 }
@@ -1184,6 +2260,11 @@ static void rofi_view_refilter ( RofiViewState *state )
 void process_result ( RofiViewState *state );
 void rofi_view_finalize ( RofiViewState *state )
 {
+    if ( state ) {
+        // The mode can change its rows when handling the result.
+        rofi_view_filter_cancel ( state );
+        rofi_view_trigram_index_clear ( state );
+    }
     if ( state && state->finalize != NULL ) {
         state->finalize ( state );
     }
@@ -1243,9 +2324,10 @@ static void rofi_view_trigger_global_action ( KeyBindingAction action )
     // Special delete entry command.
     case DELETE_ENTRY:
     {
+        rofi_view_filter_flush ( state );
         unsigned int selected = listview_get_selected ( state->list_view );
         if ( selected < state->filtered_lines ) {
-            ( state->selected_line ) = state->line_map[selected];
+            ( state->selected_line ) = rofi_view_line_map ( state, selected );
             state->retv              = MENU_ENTRY_DELETE;
             state->quit              = TRUE;
         }
@@ -1262,9 +2344,10 @@ static void rofi_view_trigger_global_action ( KeyBindingAction action )
     case SELECT_ELEMENT_9:
     case SELECT_ELEMENT_10:
     {
+        rofi_view_filter_flush ( state );
         unsigned int index = action - SELECT_ELEMENT_1;
         if ( index < state->filtered_lines ) {
-            state->selected_line = state->line_map[index];
+            state->selected_line = rofi_view_line_map ( state, index );
             state->retv          = MENU_OK;
             state->quit          = TRUE;
         }
@@ -1290,10 +2373,11 @@ static void rofi_view_trigger_global_action ( KeyBindingAction action )
     case CUSTOM_18:
     case CUSTOM_19:
     {
+        rofi_view_filter_flush ( state );
         state->selected_line = UINT32_MAX;
         unsigned int selected = listview_get_selected ( state->list_view );
         if ( selected < state->filtered_lines ) {
-            ( state->selected_line ) = state->line_map[selected];
+            ( state->selected_line ) = rofi_view_line_map ( state, selected );
         }
         state->retv = MENU_QUICK_SWITCH | ( ( action - CUSTOM_1 ) & MENU_LOWER_MASK );
         state->quit = TRUE;
@@ -1373,10 +2457,11 @@ static void rofi_view_trigger_global_action ( KeyBindingAction action )
     }
     case ACCEPT_ALT:
     {
+        rofi_view_filter_flush ( state );
         unsigned int selected = listview_get_selected ( state->list_view );
         state->selected_line = UINT32_MAX;
         if ( selected < state->filtered_lines ) {
-            ( state->selected_line ) = state->line_map[selected];
+            ( state->selected_line ) = rofi_view_line_map ( state, selected );
             state->retv              = MENU_OK;
         }
         else {
@@ -1396,11 +2481,12 @@ static void rofi_view_trigger_global_action ( KeyBindingAction action )
     }
     case ACCEPT_ENTRY:
     {
+        rofi_view_filter_flush ( state );
         // If a valid item is selected, return that..
         unsigned int selected = listview_get_selected ( state->list_view );
         state->selected_line = UINT32_MAX;
         if ( selected < state->filtered_lines ) {
-            ( state->selected_line ) = state->line_map[selected];
+            ( state->selected_line ) = rofi_view_line_map ( state, selected );
             state->retv              = MENU_OK;
         }
         else {
@@ -1569,7 +2655,7 @@ static WidgetTriggerActionResult textbox_button_trigger_action ( widget *wid, Mo
     case MOUSE_CLICK_DOWN:
     {
         const char * type = rofi_theme_get_string ( wid, "action", "ok" );
-        ( state->selected_line ) = state->line_map[listview_get_selected ( state->list_view )];
+        ( state->selected_line ) = rofi_view_line_map ( state, listview_get_selected ( state->list_view ) );
         if ( strcmp ( type, "ok" ) == 0 ) {
             state->retv = MENU_OK;
         }
@@ -1633,7 +2719,7 @@ static void rofi_view_listview_mouse_activated_cb ( listview *lv, gboolean custo
     if ( custom ) {
         state->retv |= MENU_CUSTOM_ACTION;
     }
-    ( state->selected_line ) = state->line_map[listview_get_selected ( lv )];
+    ( state->selected_line ) = rofi_view_line_map ( state, listview_get_selected ( lv ) );
     // Quit
     state->quit        = TRUE;
     state->skip_absorb = TRUE;
@@ -1850,8 +2936,10 @@ RofiViewState *rofi_view_create ( Mode *sw,
     }
 
     // filtered list
-    state->line_map = g_malloc0_n ( state->num_lines, sizeof ( unsigned int ) );
-    state->distance = (int *) g_malloc0_n ( state->num_lines, sizeof ( int ) );
+    state->lines_size = state->num_lines;
+    state->line_map   = g_malloc0_n ( state->num_lines, sizeof ( unsigned int ) );
+    state->distance   = (int *) g_malloc0_n ( state->num_lines, sizeof ( int ) );
+    state->sort_store = rofi_match_store_new ( state->num_lines, TRUE );
 
     rofi_view_calculate_window_width ( state );
     // Need to resize otherwise calculated desired height is wrong.
@@ -1986,6 +3074,9 @@ void rofi_view_workers_initialize ( void )
         // We are allowed to have
         g_thread_pool_set_max_threads ( tpool, config.threads, &error );
     }
+    if ( error == NULL ) {
+        filter_pool = g_thread_pool_new ( rofi_view_call_thread, NULL, config.threads, FALSE, &error );
+    }
     // If error occurred during setup of pool, tell user and exit.
     if ( error != NULL ) {
         g_warning ( "Failed to setup thread pool: '%s'", error->message );
@@ -1996,6 +3087,10 @@ void rofi_view_workers_initialize ( void )
 }
 void rofi_view_workers_finalize ( void )
 {
+    if ( filter_pool ) {
+        g_thread_pool_free ( filter_pool, TRUE, TRUE );
+        filter_pool = NULL;
+    }
     if ( tpool ) {
         g_thread_pool_free ( tpool, TRUE, TRUE );
         tpool = NULL;
@@ -2036,6 +3131,8 @@ void rofi_view_ellipsize_start ( RofiViewState *state )
 
 void rofi_view_switch_mode ( RofiViewState *state, Mode *mode )
 {
+    rofi_view_filter_cancel ( state );
+    rofi_view_trigram_index_clear ( state );
     state->sw = mode;
     // Update prompt;
     if ( state->prompt ) {
@@ -229,6 +229,10 @@ static XrmOption xrmOptions[] = {
       "DRUN: build and use a cache with desktop file content.", CONFIG_DEFAULT },
     { xrm_Boolean, "drun-reload-desktop-cache", { .snum  = &config.drun_reload_desktop_cache            }, NULL,
       "DRUN: If enabled, reload the cache with desktop file content.", CONFIG_DEFAULT },
+    { xrm_Boolean, "trigram-index",             { .snum  = &config.trigram_index                        }, NULL,
+      "Index long lists in the background to speed up matching.", CONFIG_DEFAULT },
+    { xrm_Boolean, "normalize-match",           { .snum  = &config.normalize_match                      }, NULL,
+      "Match without diacritics and case insensitive, e.g. 'e' matches 'é'.", CONFIG_DEFAULT },
 };
 
 /** Dynamic array of extra options */
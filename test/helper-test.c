@@ -31,6 +31,7 @@
 #include <stdio.h>
 #include <helper.h>
 #include <string.h>
+#include "rofi-match-store.h"
 #include <xcb/xcb_ewmh.h>
 #include "display.h"
 #include "xcb.h"
@@ -60,6 +61,112 @@ static int       test = 0;
             abort ( );                                                                   \
         }                                                                                \
 }
+/**
+ * The plain dynamic programming levenshtein distance, as reference for the bit-parallel one.
+ * Like the levenshtein() it replaced, it works on the codepoints as is and folds them with g_unichar_tolower().
+ */
+static unsigned int levenshtein_reference ( const char *needle, const glong needlelen, const char *haystack, const glong haystacklen )
+{
+    unsigned int column[needlelen + 1];
+    for ( glong y = 0; y <= needlelen; y++ ) {
+        column[y] = y;
+    }
+    for ( glong x = 1; x <= haystacklen; x++ ) {
+        const char *needles = needle;
+        column[0] = x;
+        gunichar   haystackc = g_utf8_get_char ( haystack );
+        if ( !config.case_sensitive ) {
+            haystackc = g_unichar_tolower ( haystackc );
+        }
+        for ( glong y = 1, lastdiag = x - 1; y <= needlelen; y++ ) {
+            gunichar needlec = g_utf8_get_char ( needles );
+            if ( !config.case_sensitive ) {
+                needlec = g_unichar_tolower ( needlec );
+            }
+            unsigned int olddiag = column[y];
+            column[y] = MIN ( MIN ( column[y] + 1, column[y - 1] + 1 ), lastdiag + ( needlec == haystackc ? 0 : 1 ) );
+            lastdiag  = olddiag;
+            needles   = g_utf8_next_char ( needles );
+        }
+        haystack = g_utf8_next_char ( haystack );
+    }
+    return column[needlelen];
+}
+
+/**
+ * Random string of len characters from a small alphabet, so there are plenty of matches.
+ * It has combining accents (so NFD text), and non-ASCII characters that fold differently with
+ * g_unichar_tolower() than with rofi_match_fold_char(): final sigma, long s, dotted capital I and the Kelvin sign.
+ */
+static char *levenshtein_random_string ( GRand *rand, glong len )
+{
+    static const gunichar alphabet[] = { 'a', 'b', 'c', 'A', 'B', 'e', 'E', ' ', 0xe9, 0xc9, 0x301, 0x300, 0x3c3, 0x3a3, 0x3c2, 0x17f, 's', 'S', 0x130, 'i', 0x212a, 'k', 0x1f600 };
+    GString               *str       = g_string_new ( "" );
+    for ( glong i = 0; i < len; i++ ) {
+        g_string_append_unichar ( str, alphabet[g_rand_int_range ( rand, 0, G_N_ELEMENTS ( alphabet ) )] );
+    }
+    return g_string_free ( str, FALSE );
+}
+
+/**
+ * Character score of the fzf scorer, as reference for the banded one.
+ */
+static int fuzzy_reference_char_score ( gunichar p, gunichar c )
+{
+    int prev = g_unichar_islower ( p ) ? 0 : g_unichar_isupper ( p ) ? 1 : g_unichar_isdigit ( p ) ? 2 : 3;
+    int curr = g_unichar_islower ( c ) ? 0 : g_unichar_isupper ( c ) ? 1 : g_unichar_isdigit ( c ) ? 2 : 3;
+    if ( prev == 3 && curr != 3 ) {
+        return 50;
+    }
+    if ( ( prev == 0 && curr == 1 ) || ( prev != 2 && curr == 2 ) ) {
+        return 44;
+    }
+    return curr == 3 ? 40 : 0;
+}
+
+/**
+ * The plain dynamic programming fzf scorer, as reference for the banded one.
+ */
+static int fuzzy_reference ( const gunichar *pattern, glong plen, const gunichar *str, glong slen )
+{
+    const int min_score = INT_MIN / 2;
+    gboolean  pfirst    = TRUE, pstart = TRUE;
+    int       score[slen + 1], dp[slen + 1];
+    int       uleft, ulefts, left, lefts;
+    for ( glong si = 0; si < slen; si++ ) {
+        score[si] = fuzzy_reference_char_score ( si > 0 ? str[si - 1] : ' ', str[si] );
+        dp[si]    = min_score;
+    }
+    for ( glong pi = 0; pi < plen; pi++ ) {
+        gunichar pc = pattern[pi];
+        if ( g_unichar_isspace ( pc ) ) {
+            pstart = TRUE;
+            continue;
+        }
+        lefts = uleft = ulefts = min_score;
+        for ( glong si = 0; si < slen; si++ ) {
+            left  = dp[si];
+            lefts = MAX ( lefts - 5, left );
+            gunichar sc = str[si];
+            if ( config.case_sensitive ? pc == sc : g_unichar_tolower ( g_unichar_toupper ( pc ) ) == g_unichar_tolower ( g_unichar_toupper ( sc ) ) ) {
+                int t = score[si] * ( pstart ? 2 : 1 );
+                dp[si] = pfirst ? -4 * si + t : MAX ( uleft + 45, ulefts + t );
+            }
+            else {
+                dp[si] = min_score;
+            }
+            uleft  = left;
+            ulefts = lefts;
+        }
+        pfirst = pstart = FALSE;
+    }
+    lefts = min_score;
+    for ( glong si = 0; si < slen; si++ ) {
+        lefts = MAX ( lefts - 5, dp[si] );
+    }
+    return -lefts;
+}
+
 void rofi_add_error_message ( G_GNUC_UNUSED GString *msg )
 {
 
@@ -117,6 +224,50 @@ int main ( int argc, char ** argv )
     TASSERTE ( levenshtein ( "aap", g_utf8_strlen ( "aap", -1), "noot aap mies", g_utf8_strlen ( "noot aap mies", -1) ), 10u );
     TASSERTE ( levenshtein ( "noot aap mies", g_utf8_strlen ( "noot aap mies", -1), "aap", g_utf8_strlen ( "aap", -1) ), 10u );
     TASSERTE ( levenshtein ( "otp", g_utf8_strlen ( "otp", -1), "noot aap", g_utf8_strlen ( "noot aap", -1) ), 5u );
+    /**
+     * Bit-parallel levenshtein against the plain implementation.
+     * Needles up to 200 characters, so the multi-word path is covered.
+     */
+    {
+        GRand        *rand      = g_rand_new_with_seed ( 42 );
+        unsigned int mismatches = 0;
+        for ( int i = 0; i < 20000; i++ ) {
+            config.case_sensitive = ( i % 2 ) == 0;
+            glong nlen = g_rand_int_range ( rand, 0, ( i % 4 ) < 2 ? 70 : 200 );
+            glong hlen = g_rand_int_range ( rand, 0, 200 );
+            char  *n   = levenshtein_random_string ( rand, nlen );
+            char  *h   = levenshtein_random_string ( rand, hlen );
+            if ( levenshtein ( n, nlen, h, hlen ) != levenshtein_reference ( n, nlen, h, hlen ) ) {
+                mismatches++;
+            }
+            // The view scores the codepoints of the prepared match strings.
+            config.normalize_match = ( i % 3 ) == 0;
+            RofiMatchString        *nms = rofi_match_string_new ( n, TRUE );
+            RofiMatchString        *hms = rofi_match_string_new ( h, TRUE );
+            RofiLevenshteinPattern *pat = levenshtein_pattern_new ( nms->ucs, nms->ucs_len );
+            if ( levenshtein_pattern_distance ( pat, hms->ucs, hms->ucs_len ) != levenshtein_reference ( n, nlen, h, hlen ) ) {
+                mismatches++;
+            }
+            levenshtein_pattern_free ( pat );
+            rofi_match_string_free ( nms );
+            rofi_match_string_free ( hms );
+            config.normalize_match = FALSE;
+            g_free ( n );
+            g_free ( h );
+        }
+        config.case_sensitive = FALSE;
+        g_rand_free ( rand );
+        TASSERTE ( mismatches, 0u );
+        // NFD input is not normalized before scoring.
+        TASSERTE ( levenshtein ( "e\xcc\x81", 2, "\xc3\xa9", 1 ), 2u );
+        RofiMatchString        *nms = rofi_match_string_new ( "e\xcc\x81", TRUE );
+        RofiMatchString        *hms = rofi_match_string_new ( "\xc3\x89", TRUE );
+        RofiLevenshteinPattern *pat = levenshtein_pattern_new ( nms->ucs, nms->ucs_len );
+        TASSERTE ( levenshtein_pattern_distance ( pat, hms->ucs, hms->ucs_len ), 2u );
+        levenshtein_pattern_free ( pat );
+        rofi_match_string_free ( nms );
+        rofi_match_string_free ( hms );
+    }
     /**
      * Quick converision check.
      */
@@ -154,6 +305,73 @@ int main ( int argc, char ** argv )
         config.case_sensitive = FALSE;
         TASSERTL ( rofi_scorer_fuzzy_evaluate ("Anm", 3, "aap noot mies", 12), -155);
         TASSERTL ( rofi_scorer_fuzzy_evaluate ("aap noot mies", 12,"Anm", 3 ), 1073741824);
+        // No longer limited in length.
+        char *str = g_strnfill ( 1000, 'x' );
+        memcpy ( str, "aap", 3 );
+        TASSERTL ( rofi_scorer_fuzzy_evaluate ("aap", 3, str, 1000 ), rofi_scorer_fuzzy_evaluate ("aap", 3, "aap", 3 ) + 5 * 997 );
+        g_free ( str );
+        // Too wide to search, the leftmost alignment is scored.
+        str = g_strnfill ( 70001, 'a' );
+        str[70000] = 'b';
+        TASSERTL ( rofi_scorer_fuzzy_evaluate ("ab", 2, str, 70001 ), -( 100 - 5 * 69999 ) );
+        g_free ( str );
+    }
+    /**
+     * Subsequence prefilter of the fzf scorer.
+     */
+    {
+        gunichar         s[] = { 'a', 'a', 'p', ' ', 'N', 'o', 'o', 't', 0xc9 };
+        gunichar         p[] = { 'a', 'n', 't', 0xe9 };
+        RofiFuzzyPattern *pat = rofi_scorer_fuzzy_pattern_new ( p, 4 );
+        TASSERT ( rofi_scorer_fuzzy_pattern_is_subsequence ( pat, s, 9 ) );
+        TASSERT ( !rofi_scorer_fuzzy_pattern_is_subsequence ( pat, s, 8 ) );
+        TASSERT ( !rofi_scorer_fuzzy_pattern_is_subsequence ( pat, s + 3, 6 ) );
+        TASSERT ( !rofi_scorer_fuzzy_pattern_is_subsequence ( pat, s, 0 ) );
+        rofi_scorer_fuzzy_pattern_free ( pat );
+        // Out of order.
+        gunichar r[] = { 't', 'a' };
+        pat = rofi_scorer_fuzzy_pattern_new ( r, 2 );
+        TASSERT ( !rofi_scorer_fuzzy_pattern_is_subsequence ( pat, s, 9 ) );
+        rofi_scorer_fuzzy_pattern_free ( pat );
+        config.case_sensitive = TRUE;
+        pat                   = rofi_scorer_fuzzy_pattern_new ( p, 4 );
+        TASSERT ( !rofi_scorer_fuzzy_pattern_is_subsequence ( pat, s, 9 ) );
+        rofi_scorer_fuzzy_pattern_free ( pat );
+        config.case_sensitive = FALSE;
+
+        // A long row that fails the prefilter is rejected without scoring.
+        char *str = g_strnfill ( 1000, 'x' );
+        memcpy ( str + 500, "ta", 2 );
+        TASSERTL ( rofi_scorer_fuzzy_evaluate ("at", 2, str, 1000 ), 1073741824);
+        str[0] = 'a';
+        TASSERT ( rofi_scorer_fuzzy_evaluate ("at", 2, str, 1000 ) < 1073741824 );
+        g_free ( str );
+    }
+    /**
+     * Banded fzf scorer against the plain implementation.
+     */
+    {
+        static const gunichar alphabet[] = { 'a', 'b', 'A', 'B', '1', ' ', '-', 0xe9, 0xc9 };
+        GRand                 *rand      = g_rand_new_with_seed ( 42 );
+        unsigned int          mismatches = 0;
+        gunichar              p[16], s[256];
+        for ( int i = 0; i < 20000; i++ ) {
+            config.case_sensitive = ( i % 2 ) == 0;
+            glong plen = g_rand_int_range ( rand, 0, 16 );
+            glong slen = g_rand_int_range ( rand, 0, 256 );
+            for ( glong j = 0; j < plen; j++ ) {
+                p[j] = alphabet[g_rand_int_range ( rand, 0, G_N_ELEMENTS ( alphabet ) )];
+            }
+            for ( glong j = 0; j < slen; j++ ) {
+                s[j] = alphabet[g_rand_int_range ( rand, 0, G_N_ELEMENTS ( alphabet ) )];
+            }
+            if ( rofi_scorer_fuzzy_evaluate_ucs ( p, plen, s, slen ) != fuzzy_reference ( p, plen, s, slen ) ) {
+                mismatches++;
+            }
+        }
+        config.case_sensitive = FALSE;
+        g_rand_free ( rand );
+        TASSERTE ( mismatches, 0u );
 
     }
 
@@ -30,6 +30,7 @@
 #include <glib.h>
 #include <stdio.h>
 #include <helper.h>
+#include <helper-theme.h>
 #include <string.h>
 #include <xcb/xcb_ewmh.h>
 #include "display.h"
@@ -137,6 +138,352 @@ START_TEST ( test_tokenizer_match_normal_multiple_ci_negate )
 }
 END_TEST
 
+START_TEST ( test_tokenizer_match_normal_single_ci_unicode )
+{
+    config.matching_method = MM_NORMAL;
+    rofi_int_matcher **tokens = helper_tokenize ( "één", FALSE );
+    ck_assert_int_eq ( helper_token_match ( tokens, "aap één mies") , TRUE );
+    ck_assert_int_eq ( helper_token_match ( tokens, "aap ÉÉN mies") , TRUE );
+    ck_assert_int_eq ( helper_token_match ( tokens, "aap een mies") , FALSE );
+    helper_tokenize_free ( tokens );
+
+    tokens = helper_tokenize ( "kaas", FALSE );
+    ck_assert_int_eq ( helper_token_match ( tokens, "aap KAAS mies") , TRUE );
+    // KELVIN SIGN
+    ck_assert_int_eq ( helper_token_match ( tokens, "aap \u212Aaas mies") , TRUE );
+    ck_assert_int_eq ( helper_token_match ( tokens, "aap kaaz mies") , FALSE );
+    helper_tokenize_free ( tokens );
+}
+END_TEST
+
+START_TEST ( test_tokenizer_order )
+{
+    config.matching_method = MM_NORMAL;
+    rofi_int_matcher **tokens = helper_tokenize ( "a -b firefox", FALSE );
+    // Most selective first, inverted last.
+    ck_assert_str_eq ( tokens[0]->literal, "firefox" );
+    ck_assert_str_eq ( tokens[1]->literal, "a" );
+    ck_assert_int_eq ( tokens[2]->invert, TRUE );
+    ck_assert_ptr_eq ( tokens[3], NULL );
+    ck_assert_int_eq ( helper_token_match ( tokens, "firefox a") , TRUE );
+    ck_assert_int_eq ( helper_token_match ( tokens, "firefox b a") , FALSE );
+    ck_assert_int_eq ( helper_token_match ( tokens, "firefox") , FALSE );
+
+    // Observed hit rates take precedence over the estimate, and are not stored in the shared tokens.
+    double hit_rates[3] = { 0.9, 0.1, 0.5 };
+    double estimate     = tokens[0]->hit_rate;
+    helper_tokenize_sort ( tokens, hit_rates );
+    ck_assert_str_eq ( tokens[0]->literal, "a" );
+    ck_assert_str_eq ( tokens[1]->literal, "firefox" );
+    ck_assert_int_eq ( tokens[2]->invert, TRUE );
+    ck_assert ( hit_rates[0] == 0.1 && hit_rates[1] == 0.9 && hit_rates[2] == 0.5 );
+    ck_assert ( tokens[1]->hit_rate == estimate );
+    // A new query with the same token gets the estimate.
+    rofi_int_matcher **tokens2 = helper_tokenize ( "a -b firefox", FALSE );
+    ck_assert_str_eq ( tokens2[0]->literal, "firefox" );
+    ck_assert_str_eq ( tokens2[1]->literal, "a" );
+    helper_tokenize_free ( tokens2 );
+    helper_tokenize_free ( tokens );
+}
+END_TEST
+
+START_TEST ( test_tokenizer_match_fields )
+{
+    config.matching_method = MM_NORMAL;
+    const char      *f[]    = { "Firefox", NULL, "web browser" };
+    RofiMatchFields *fields = helper_match_fields_new ( f, 3 );
+    ck_assert_int_eq ( fields->num_fields, 2 );
+    RofiMatchStore  *store = rofi_match_store_new ( 1, FALSE );
+
+    rofi_int_matcher **tokens = helper_tokenize ( "fox web", FALSE );
+    ck_assert_int_eq ( helper_token_match_fields ( tokens, fields, store, 0 ), TRUE );
+    ck_assert_int_eq ( helper_token_match_fields ( tokens, fields, NULL, 0 ), TRUE );
+    helper_tokenize_free ( tokens );
+    // No match across fields.
+    tokens = helper_tokenize ( "foxweb", FALSE );
+    ck_assert_int_eq ( helper_token_match_fields ( tokens, fields, store, 0 ), FALSE );
+    helper_tokenize_free ( tokens );
+    tokens = helper_tokenize ( "-browser", FALSE );
+    ck_assert_int_eq ( helper_token_match_fields ( tokens, fields, store, 0 ), FALSE );
+    ck_assert_int_eq ( helper_token_match_fields ( tokens, NULL, store, 0 ), TRUE );
+    helper_tokenize_free ( tokens );
+
+    config.matching_method = MM_REGEX;
+    tokens                 = helper_tokenize ( "fox.*web", FALSE );
+    ck_assert_int_eq ( helper_token_match_fields ( tokens, fields, store, 0 ), FALSE );
+    helper_tokenize_free ( tokens );
+    tokens = helper_tokenize ( "^web", FALSE );
+    ck_assert_int_eq ( helper_token_match_fields ( tokens, fields, store, 0 ), TRUE );
+    helper_tokenize_free ( tokens );
+
+    rofi_match_store_free ( store );
+    g_free ( fields );
+}
+END_TEST
+
+START_TEST ( test_tokenizer_match_spans )
+{
+    config.matching_method = MM_NORMAL;
+    rofi_int_matcher **tokens  = helper_tokenize ( "noot -mies", FALSE );
+    unsigned int     num_spans = 0;
+    int              *spans    = helper_token_match_get_spans ( tokens, "aap NOOT mies noot", &num_spans );
+    ck_assert_int_eq ( num_spans, 2 );
+    ck_assert_int_eq ( spans[0], 4 );
+    ck_assert_int_eq ( spans[1], 8 );
+    ck_assert_int_eq ( spans[2], 14 );
+    ck_assert_int_eq ( spans[3], 18 );
+    g_free ( spans );
+    helper_tokenize_free ( tokens );
+
+    // Consecutive characters of a fuzzy token are one span.
+    config.matching_method = MM_FUZZY;
+    tokens                 = helper_tokenize ( "nomi", FALSE );
+    spans                  = helper_token_match_get_spans ( tokens, "aap noot mies", &num_spans );
+    ck_assert_int_eq ( num_spans, 2 );
+    ck_assert_int_eq ( spans[0], 4 );
+    ck_assert_int_eq ( spans[1], 6 );
+    ck_assert_int_eq ( spans[2], 9 );
+    ck_assert_int_eq ( spans[3], 11 );
+    g_free ( spans );
+    helper_tokenize_free ( tokens );
+
+    config.matching_method = MM_GLOB;
+    tokens                 = helper_tokenize ( "a?p", FALSE );
+    spans                  = helper_token_match_get_spans ( tokens, "aap noot aap", &num_spans );
+    ck_assert_int_eq ( num_spans, 2 );
+    ck_assert_int_eq ( spans[0], 0 );
+    ck_assert_int_eq ( spans[1], 3 );
+    ck_assert_int_eq ( spans[2], 9 );
+    ck_assert_int_eq ( spans[3], 12 );
+    g_free ( spans );
+    helper_tokenize_free ( tokens );
+}
+END_TEST
+
+START_TEST ( test_tokenizer_match_glob_spans )
+{
+    config.matching_method = MM_GLOB;
+    unsigned int     num_spans = 0;
+    // Like the greedy regex, a wildcard takes up to the last match on the line.
+    rofi_int_matcher **tokens  = helper_tokenize ( "a*p", FALSE );
+    int              *spans    = helper_token_match_get_spans ( tokens, "aap noot aap", &num_spans );
+    ck_assert_int_eq ( num_spans, 1 );
+    ck_assert_int_eq ( spans[0], 0 );
+    ck_assert_int_eq ( spans[1], 12 );
+    g_free ( spans );
+    helper_tokenize_free ( tokens );
+
+    // A trailing wildcard takes the rest of the line.
+    tokens = helper_tokenize ( "a*", FALSE );
+    spans  = helper_token_match_get_spans ( tokens, "noot aap mies\naap", &num_spans );
+    ck_assert_int_eq ( num_spans, 2 );
+    ck_assert_int_eq ( spans[0], 5 );
+    ck_assert_int_eq ( spans[1], 13 );
+    ck_assert_int_eq ( spans[2], 14 );
+    ck_assert_int_eq ( spans[3], 17 );
+    g_free ( spans );
+    helper_tokenize_free ( tokens );
+
+    // A leading wildcard starts at the start of the line.
+    tokens = helper_tokenize ( "*p", FALSE );
+    spans  = helper_token_match_get_spans ( tokens, "aap noot", &num_spans );
+    ck_assert_int_eq ( num_spans, 1 );
+    ck_assert_int_eq ( spans[0], 0 );
+    ck_assert_int_eq ( spans[1], 3 );
+    g_free ( spans );
+    helper_tokenize_free ( tokens );
+
+    tokens = helper_tokenize ( "*", FALSE );
+    spans  = helper_token_match_get_spans ( tokens, "aap\nnoot", &num_spans );
+    ck_assert_int_eq ( num_spans, 2 );
+    ck_assert_int_eq ( spans[0], 0 );
+    ck_assert_int_eq ( spans[1], 3 );
+    ck_assert_int_eq ( spans[2], 4 );
+    ck_assert_int_eq ( spans[3], 8 );
+    g_free ( spans );
+    helper_tokenize_free ( tokens );
+}
+END_TEST
+
+/**
+ * @param tokens The tokens to search.
+ * @param literal The text of the token.
+ *
+ * @returns the token matching literal as plain text, NULL if not found.
+ */
+static rofi_int_matcher *tokenizer_find ( rofi_int_matcher **tokens, const char *literal )
+{
+    for ( size_t i = 0; tokens != NULL && tokens[i] != NULL; i++ ) {
+        if ( g_strcmp0 ( tokens[i]->literal, literal ) == 0 ) {
+            return tokens[i];
+        }
+    }
+    return NULL;
+}
+
+START_TEST ( test_tokenizer_reuse )
+{
+    config.matching_method = MM_NORMAL;
+    rofi_int_matcher **a = helper_tokenize ( "aap noot", FALSE );
+    rofi_int_matcher **b = helper_tokenize ( "aap noot mies", FALSE );
+    // Unchanged tokens are compiled once, the tokens are sorted so look them up by text.
+    ck_assert_ptr_ne ( tokenizer_find ( a, "aap" ), NULL );
+    ck_assert_ptr_ne ( tokenizer_find ( a, "noot" ), NULL );
+    ck_assert_ptr_eq ( tokenizer_find ( a, "aap" ), tokenizer_find ( b, "aap" ) );
+    ck_assert_ptr_eq ( tokenizer_find ( a, "noot" ), tokenizer_find ( b, "noot" ) );
+    ck_assert_ptr_ne ( tokenizer_find ( b, "mies" ), NULL );
+    helper_tokenize_free ( a );
+    ck_assert_int_eq ( helper_token_match ( b, "aap noot mies" ), TRUE );
+    ck_assert_int_eq ( helper_token_match ( b, "aap noot" ), FALSE );
+
+    // Not shared between methods or case sensitivity.
+    a = helper_tokenize ( "aap", TRUE );
+    ck_assert_ptr_ne ( a[0]->literal, NULL );
+    ck_assert_int_eq ( helper_token_match ( a, "AAP" ), FALSE );
+    helper_tokenize_free ( a );
+    config.matching_method = MM_FUZZY;
+    a                      = helper_tokenize ( "aap", FALSE );
+    ck_assert_ptr_eq ( a[0]->literal, NULL );
+    helper_tokenize_free ( a );
+    helper_tokenize_free ( b );
+    helper_tokenize_cache_clear ();
+}
+END_TEST
+
+START_TEST ( test_tokenizer_match_normalize )
+{
+    config.matching_method = MM_NORMAL;
+    config.normalize_match = TRUE;
+    RofiMatchStore   *store   = rofi_match_store_new ( 1, FALSE );
+    rofi_int_matcher **tokens = helper_tokenize ( "cafe", TRUE );
+    ck_assert_int_eq ( helper_token_match ( tokens, "Café.desktop" ), TRUE );
+    ck_assert_int_eq ( helper_token_match ( tokens, "Cafe\xcc\x81.desktop" ), TRUE );
+    ck_assert_int_eq ( helper_token_match ( tokens, "CAFE" ), TRUE );
+    ck_assert_int_eq ( helper_token_match ( tokens, "caf" ), FALSE );
+    ck_assert_int_eq ( helper_token_match_store ( tokens, "Café.desktop", store, 0 ), TRUE );
+    unsigned int num_spans = 0;
+    int          *spans    = helper_token_match_get_spans ( tokens, "Café", &num_spans );
+    ck_assert_int_eq ( num_spans, 1 );
+    ck_assert_int_eq ( spans[0], 0 );
+    ck_assert_int_eq ( spans[1], 5 );
+    g_free ( spans );
+    helper_tokenize_free ( tokens );
+    tokens = helper_tokenize ( "Café", FALSE );
+    ck_assert_int_eq ( helper_token_match ( tokens, "cafe" ), TRUE );
+    helper_tokenize_free ( tokens );
+
+    config.matching_method = MM_FUZZY;
+    tokens                 = helper_tokenize ( "cfe", FALSE );
+    ck_assert_int_eq ( helper_token_match ( tokens, "Café" ), TRUE );
+    ck_assert_int_eq ( helper_token_match_store ( tokens, "Café", store, 0 ), TRUE );
+    helper_tokenize_free ( tokens );
+
+    rofi_match_store_free ( store );
+    config.normalize_match = FALSE;
+}
+END_TEST
+
+START_TEST ( test_tokenizer_match_store_fallback )
+{
+    // NFC and NFD 'é', DOTTED CAPITAL I, DOTLESS SMALL I and KELVIN SIGN.
+    const char         *rows[]    = { "caf\xc3\xa9", "cafe\xcc\x81", "\xc4\xb0stanbul", "\xc4\xb1stanbul", "istanbul", "\xe2\x84\xaa" "elvin", "Kelvin", NULL };
+    const char         *inputs[]  = { "\xc3\xa9", "e\xcc\x81", "caf\xc3\xa9", "e", "i", "I", "\xc4\xb0", "\xc4\xb1", "k", "K", "\xe2\x84\xaa", "kel", "i*bul", "c?f", NULL };
+    const MatchingMethod methods[] = { MM_NORMAL, MM_FUZZY, MM_GLOB };
+    for ( unsigned int m = 0; m < G_N_ELEMENTS ( methods ); m++ ) {
+        config.matching_method = methods[m];
+        for ( unsigned int t = 0; inputs[t] != NULL; t++ ) {
+            rofi_int_matcher **tokens = helper_tokenize ( inputs[t], FALSE );
+            // The same result with the rows prepared in a store, and without, e.g. when the store is full.
+            RofiMatchStore   *store = rofi_match_store_new ( 16, FALSE );
+            for ( unsigned int r = 0; rows[r] != NULL; r++ ) {
+                ck_assert_int_eq ( helper_token_match_store ( tokens, rows[r], store, r ), helper_token_match ( tokens, rows[r] ) );
+            }
+            rofi_match_store_free ( store );
+            helper_tokenize_free ( tokens );
+        }
+    }
+    config.matching_method = MM_NORMAL;
+    rofi_int_matcher **tokens = helper_tokenize ( "\xc3\xa9", FALSE );
+    ck_assert_int_eq ( helper_token_match ( tokens, "cafe\xcc\x81" ), TRUE );
+    helper_tokenize_free ( tokens );
+    tokens = helper_tokenize ( "i", FALSE );
+    ck_assert_int_eq ( helper_token_match ( tokens, "\xc4\xb0stanbul" ), TRUE );
+    helper_tokenize_free ( tokens );
+    tokens = helper_tokenize ( "kelvin", FALSE );
+    ck_assert_int_eq ( helper_token_match ( tokens, "\xe2\x84\xaa" "elvin" ), TRUE );
+    helper_tokenize_free ( tokens );
+}
+END_TEST
+
+START_TEST ( test_tokenizer_match_bloom )
+{
+    config.matching_method = MM_NORMAL;
+    RofiMatchStore   *store   = rofi_match_store_new ( 3, FALSE );
+    rofi_int_matcher **tokens = helper_tokenize ( "Fox", FALSE );
+    // Rows that lack a character of the token are rejected on their bloom.
+    helper_token_match_take_bloom_rejects ();
+    ck_assert_int_eq ( helper_token_match_store ( tokens, "Firefox", store, 0 ), TRUE );
+    ck_assert_int_eq ( helper_token_match_store ( tokens, "Chromium", store, 1 ), FALSE );
+    ck_assert_int_eq ( helper_token_match_take_bloom_rejects (), 1 );
+    // Having all characters is not a match.
+    ck_assert_int_eq ( helper_token_match_store ( tokens, "oxf", store, 2 ), FALSE );
+    ck_assert_int_eq ( helper_token_match_take_bloom_rejects (), 0 );
+    helper_tokenize_free ( tokens );
+
+    config.matching_method = MM_FUZZY;
+    tokens                 = helper_tokenize ( "ffx", FALSE );
+    ck_assert_int_eq ( helper_token_match_store ( tokens, "Firefox", store, 0 ), TRUE );
+    ck_assert_int_eq ( helper_token_match_store ( tokens, "Chromium", store, 1 ), FALSE );
+    ck_assert_int_eq ( helper_token_match_take_bloom_rejects (), 1 );
+    helper_tokenize_free ( tokens );
+    rofi_match_store_free ( store );
+}
+END_TEST
+
+START_TEST ( test_tokenizer_match_len )
+{
+    config.matching_method = MM_NORMAL;
+    RofiMatchStore   *store   = rofi_match_store_new ( 2, FALSE );
+    rofi_int_matcher **tokens = helper_tokenize ( "fox", FALSE );
+    // Rows that are not nul terminated, e.g. in a mapped file.
+    const char       *rows    = "Firefox\nChromium\nfox";
+    ck_assert_int_eq ( helper_token_match_len ( tokens, rows, 7, store, 0 ), TRUE );
+    ck_assert_int_eq ( helper_token_match_len ( tokens, rows + 8, 8, store, 1 ), FALSE );
+    ck_assert_int_eq ( helper_token_match_len ( tokens, rows, 6, NULL, 0 ), FALSE );
+    helper_tokenize_free ( tokens );
+
+    config.matching_method = MM_REGEX;
+    tokens                 = helper_tokenize ( "fox$", FALSE );
+    ck_assert_int_eq ( helper_token_match_len ( tokens, rows, 7, NULL, 0 ), TRUE );
+    ck_assert_int_eq ( helper_token_match_len ( tokens, rows, 6, NULL, 0 ), FALSE );
+    helper_tokenize_free ( tokens );
+    rofi_match_store_free ( store );
+}
+END_TEST
+
+START_TEST ( test_tokenizer_regex_lazy )
+{
+    config.matching_method = MM_NORMAL;
+    rofi_int_matcher **tokens = helper_tokenize ( "a.b(", FALSE );
+    // Plain tokens do not compile a regex to match.
+    ck_assert_ptr_eq ( tokens[0]->lazy_regex, NULL );
+    ck_assert_int_eq ( helper_token_match ( tokens, "xA.B(x" ), TRUE );
+    ck_assert_ptr_eq ( tokens[0]->lazy_regex, NULL );
+    // Compiled once, when asked for.
+    GRegex *regex = helper_token_get_regex ( tokens[0] );
+    ck_assert_ptr_ne ( regex, NULL );
+    ck_assert_ptr_eq ( helper_token_get_regex ( tokens[0] ), regex );
+    ck_assert_int_eq ( g_regex_match ( regex, "xA.B(x", 0, NULL ), TRUE );
+    ck_assert_int_eq ( g_regex_match ( regex, "xAxB(x", 0, NULL ), FALSE );
+    helper_tokenize_free ( tokens );
+
+    config.matching_method = MM_FUZZY;
+    tokens                 = helper_tokenize ( "ab", FALSE );
+    ck_assert_ptr_eq ( helper_token_get_regex ( tokens[0] ), NULL );
+    helper_tokenize_free ( tokens );
+}
+END_TEST
+
 START_TEST ( test_tokenizer_match_glob_single_ci )
 {
     config.matching_method = MM_GLOB;
@@ -206,6 +553,9 @@ START_TEST ( test_tokenizer_match_glob_single_ci_star )
     ck_assert_int_eq ( helper_token_match ( tokens, "nooaap mies") , FALSE );
     ck_assert_int_eq ( helper_token_match ( tokens, "nootap mies") , TRUE );
     ck_assert_int_eq ( helper_token_match ( tokens, "noap miesot") , TRUE);
+    // Like the regex it replaces, a wildcard does not match a newline.
+    ck_assert_int_eq ( helper_token_match ( tokens, "noap\nmiesot") , FALSE);
+    ck_assert_int_eq ( helper_token_match ( tokens, "aap\nnoot") , TRUE);
     helper_tokenize_free ( tokens );
 }
 END_TEST
@@ -411,6 +761,16 @@ static Suite * helper_tokenizer_suite (void)
         tcase_add_test(tc_normal, test_tokenizer_match_normal_multiple_ci );
         tcase_add_test(tc_normal, test_tokenizer_match_normal_single_ci_negate );
         tcase_add_test(tc_normal, test_tokenizer_match_normal_multiple_ci_negate);
+        tcase_add_test(tc_normal, test_tokenizer_match_normal_single_ci_unicode);
+        tcase_add_test(tc_normal, test_tokenizer_order);
+        tcase_add_test(tc_normal, test_tokenizer_match_fields);
+        tcase_add_test(tc_normal, test_tokenizer_match_spans);
+        tcase_add_test(tc_normal, test_tokenizer_reuse);
+        tcase_add_test(tc_normal, test_tokenizer_match_normalize);
+        tcase_add_test(tc_normal, test_tokenizer_match_store_fallback);
+        tcase_add_test(tc_normal, test_tokenizer_match_bloom);
+        tcase_add_test(tc_normal, test_tokenizer_match_len);
+        tcase_add_test(tc_normal, test_tokenizer_regex_lazy);
         suite_add_tcase(s, tc_normal);
     }
     {
@@ -421,6 +781,7 @@ static Suite * helper_tokenizer_suite (void)
         tcase_add_test(tc_glob, test_tokenizer_match_glob_single_ci_question);
         tcase_add_test(tc_glob, test_tokenizer_match_glob_single_ci_star);
         tcase_add_test(tc_glob, test_tokenizer_match_glob_multiple_ci_star);
+        tcase_add_test(tc_glob, test_tokenizer_match_glob_spans);
         suite_add_tcase(s, tc_glob);
     }
     {
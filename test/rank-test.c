@@ -0,0 +1,110 @@
+/*
+ * rofi
+ *
+ * MIT/X11 License
+ * Copyright © 2013-2017 Qball Cow <qball@gmpclient.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include <assert.h>
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "rofi-rank.h"
+
+static int  test = 0;
+
+#define TASSERT( a )        {                            \
+        assert ( a );                                    \
+        printf ( "Test %i passed (%s)\n", ++test, # a ); \
+}
+
+static gint compare_distance ( gconstpointer a, gconstpointer b, gpointer data )
+{
+    const int *distance = (const int *) data;
+    int       da        = distance[*( (const unsigned int *) a )];
+    int       db        = distance[*( (const unsigned int *) b )];
+    return ( da > db ) - ( da < db );
+}
+
+/**
+ * Rank num rows, read them in a random order of positions and compare with a stable sort.
+ * When append is set, half of the rows are appended after part of the list was ranked.
+ */
+static gboolean check_rank ( GRand *rand, unsigned int num, int spread, gboolean append )
+{
+    int          *distance = g_new ( int, num + 1 );
+    unsigned int *line_map = g_new ( unsigned int, num + 1 );
+    unsigned int *expect   = g_new ( unsigned int, num + 1 );
+    RofiRank     rank      = { NULL, 0, 0, 0 };
+    gboolean     ok        = TRUE;
+
+    for ( unsigned int i = 0; i < num; i++ ) {
+        // Many ties, and negative distances.
+        distance[i] = g_rand_int_range ( rand, -spread, spread );
+        line_map[i] = i;
+        expect[i]   = i;
+    }
+    g_qsort_with_data ( expect, num, sizeof ( unsigned int ), compare_distance, distance );
+
+    unsigned int first = append ? num / 2 : num;
+    rofi_rank_init ( &rank, line_map, distance, first );
+    if ( append ) {
+        // Rank part of the first rows, then add the rest.
+        for ( unsigned int i = 0; i < 3 && first > 0; i++ ) {
+            rofi_rank_line_map ( &rank, line_map, first, g_rand_int_range ( rand, 0, first ) );
+        }
+        unsigned int *rows = g_new ( unsigned int, num - first + 1 );
+        for ( unsigned int i = first; i < num; i++ ) {
+            rows[i - first] = i;
+        }
+        rofi_rank_append ( &rank, line_map, distance, num, rows, num - first );
+        g_free ( rows );
+    }
+    // Jump around, like scrolling and jumping to the end does.
+    for ( unsigned int i = 0; i < 8 && num > 0; i++ ) {
+        unsigned int position = g_rand_int_range ( rand, 0, num );
+        ok = ok && rofi_rank_line_map ( &rank, line_map, num, position ) == expect[position];
+    }
+    for ( unsigned int i = 0; i < num; i++ ) {
+        ok = ok && rofi_rank_line_map ( &rank, line_map, num, i ) == expect[i];
+    }
+    rofi_rank_free ( &rank );
+    g_free ( expect );
+    g_free ( line_map );
+    g_free ( distance );
+    return ok;
+}
+
+int main ( G_GNUC_UNUSED int argc, G_GNUC_UNUSED char ** argv )
+{
+    GRand              *rand   = g_rand_new_with_seed ( 42 );
+    const unsigned int sizes[] = { 0, 1, 2, 63, 64, 65, 1000, 20000, 300000 };
+    for ( unsigned int i = 0; i < G_N_ELEMENTS ( sizes ); i++ ) {
+        TASSERT ( check_rank ( rand, sizes[i], 4, FALSE ) );
+        TASSERT ( check_rank ( rand, sizes[i], 4, TRUE ) );
+        TASSERT ( check_rank ( rand, sizes[i], 1000000, FALSE ) );
+        TASSERT ( check_rank ( rand, sizes[i], 1000000, TRUE ) );
+    }
+    g_rand_free ( rand );
+    return EXIT_SUCCESS;
+}
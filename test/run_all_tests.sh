@@ -12,6 +12,7 @@ tests=(
     run_issue_275
     run_dmenu_empty
     run_dmenu_issue_292
+    run_dmenu_dump_test
     run_screenshot_test
     xr_dump_test
     run_combi_test
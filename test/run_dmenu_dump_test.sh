@@ -0,0 +1,56 @@
+#!/usr/bin/env bash
+
+# -dump reads the input in blocks of 1 MiB that are matched on several threads,
+# the output should still be as if the rows were matched one after the other.
+
+function check ( )
+{
+    if ! cmp -s "$1" "$2"
+    then
+        echo "$3: output differs."
+        diff "$1" "$2" | head -n 10
+        exit 1
+    fi
+}
+
+seq 1 500000 > dump_input.txt
+
+# Input order is kept across blocks.
+rofi -dmenu -threads 4 -dump < dump_input.txt > output.txt
+check output.txt dump_input.txt "No filter"
+
+rofi -dmenu -threads 4 -filter 99 -dump < dump_input.txt > output.txt
+grep 99 dump_input.txt > expected.txt
+check output.txt expected.txt "Filter"
+
+# -dump-limit without sorting prints the first matches.
+rofi -dmenu -threads 4 -filter 99 -dump -dump-limit 5 < dump_input.txt > output.txt
+grep 99 dump_input.txt | head -n 5 > expected.txt
+check output.txt expected.txt "Limit"
+
+# -dump-limit with sorting prints the best matches.
+rofi -dmenu -threads 4 -filter 99 -sort -dump < dump_input.txt > sorted.txt
+sort sorted.txt > output.txt
+grep 99 dump_input.txt | sort > expected.txt
+check output.txt expected.txt "Sort"
+rofi -dmenu -threads 4 -filter 99 -sort -dump -dump-limit 5 < dump_input.txt > output.txt
+head -n 5 sorted.txt > expected.txt
+check output.txt expected.txt "Sort limit"
+
+# A row longer than a block.
+{ echo aap; head -c 3000000 /dev/zero | tr '\0' 'x'; echo noot; echo mies; } > dump_input.txt
+rofi -dmenu -threads 4 -dump < dump_input.txt > output.txt
+check output.txt dump_input.txt "Long row"
+rofi -dmenu -threads 4 -filter noot -dump < dump_input.txt > output.txt
+grep noot dump_input.txt > expected.txt
+check output.txt expected.txt "Long row filter"
+
+# The last row does not need a separator.
+echo -en "aap\nnoot\nmies" | rofi -dmenu -dump > output.txt
+echo -en "aap\nnoot\nmies\n" > expected.txt
+check output.txt expected.txt "No trailing separator"
+echo -en "aap\nnoot\nmies" | rofi -dmenu -filter mies -dump > output.txt
+echo "mies" > expected.txt
+check output.txt expected.txt "No trailing separator filter"
+
+exit 0
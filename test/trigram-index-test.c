@@ -0,0 +1,281 @@
+/*
+ * rofi
+ *
+ * MIT/X11 License
+ * Copyright © 2013-2017 Qball Cow <qball@gmpclient.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include <locale.h>
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <helper.h>
+#include <mode.h>
+#include <mode-private.h>
+#include <xcb/xcb_ewmh.h>
+#include "display.h"
+#include "xcb.h"
+#include "xcb-internal.h"
+#include "rofi.h"
+#include "settings.h"
+#include "rofi-types.h"
+#include "rofi-match-store.h"
+#include "rofi-trigram-index.h"
+
+#include <check.h>
+
+void rofi_add_error_message ( G_GNUC_UNUSED GString *msg )
+{
+}
+int rofi_view_error_dialog ( const char *msg, G_GNUC_UNUSED int markup )
+{
+    fputs ( msg, stderr );
+    return TRUE;
+}
+int monitor_active ( G_GNUC_UNUSED workarea *mon )
+{
+    return 0;
+}
+
+void display_startup_notification ( G_GNUC_UNUSED RofiHelperExecuteContext *context, G_GNUC_UNUSED GSpawnChildSetupFunc *child_setup, G_GNUC_UNUSED gpointer *user_data )
+{
+}
+
+/** The rows of the test mode, the last ones are appended after the index is built. */
+static const char *rows[] = {
+    "Firefox Web Browser",
+    "FIREFOX NIGHTLY",
+    "firefox-esr",
+    "Mixed CaSe Row",
+    "café au lait",
+    "cafe\xcc\x81 noir",
+    "CAFÉ CRÈME",
+    "Cafe Latte",
+    "Straße",
+    "İstanbul",
+    "istanbul",
+    "\xe2\x84\xaaELVIN",
+    "kelvin",
+    "naïve résumé",
+    "naive resume",
+    "ab",
+    "",
+    "Ångström",
+    "angstrom",
+    "Thunderbird Mail",
+    "thunderbird",
+    "appended café",
+    "Appended FIREFOX",
+    "appended nothing"
+};
+/** The number of rows in the index. */
+#define NUM_INDEXED    21
+
+static char *test_get_match_text ( G_GNUC_UNUSED const Mode *sw, unsigned int index )
+{
+    return g_strdup ( rows[index] );
+}
+
+static Mode test_mode = {
+    .name            = "test",
+    ._get_match_text = test_get_match_text,
+};
+
+/** The queries, each is tokenized as it would be in the view. */
+static const char *queries[] = {
+    "fire",
+    "FIREFOX",
+    "FireFox web",
+    "mixed case",
+    "MIXED CASE",
+    "café",
+    "cafe\xcc\x81",
+    "CAFÉ",
+    "cafe",
+    "CAFE",
+    "crème",
+    "straße",
+    "STRASSE",
+    "istanbul",
+    "İstanbul",
+    "ISTANBUL",
+    "kelvin",
+    "\xe2\x84\xaaelvin",
+    "KELVIN",
+    "naïve",
+    "naive",
+    "résumé",
+    "resume",
+    "ångström",
+    "angstrom",
+    "ANGSTRÖM",
+    "app",
+    "appended",
+    "bird mail",
+    "-fox bird",
+    "ab",
+    "nothing at all",
+};
+
+/**
+ * @param index The index, built from the first NUM_INDEXED rows.
+ * @param case_sensitive If the tokens are case sensitive.
+ *
+ * Check that the candidates the index gives for each query include every row that matches it, with and
+ * without a match store. The rows appended after the index was built are always candidates.
+ *
+ * @returns the number of queries the index narrowed down.
+ */
+static unsigned int check_queries ( RofiTrigramIndex *index, gboolean case_sensitive )
+{
+    unsigned int   num_rows   = G_N_ELEMENTS ( rows );
+    unsigned int   candidates[G_N_ELEMENTS ( rows )];
+    unsigned int   narrowed   = 0;
+    RofiMatchStore *store     = rofi_match_store_new ( num_rows, FALSE );
+    for ( unsigned int q = 0; q < G_N_ELEMENTS ( queries ); q++ ) {
+        rofi_int_matcher **tokens = helper_tokenize ( queries[q], case_sensitive );
+        int              n        = rofi_trigram_index_query ( index, tokens, num_rows, candidates );
+        gboolean         is_candidate[G_N_ELEMENTS ( rows )];
+        for ( unsigned int i = 0; i < num_rows; i++ ) {
+            is_candidate[i] = ( n < 0 );
+        }
+        for ( int k = 0; k < n; k++ ) {
+            ck_assert_int_lt ( candidates[k], num_rows );
+            if ( k > 0 ) {
+                ck_assert_int_lt ( candidates[k - 1], candidates[k] );
+            }
+            is_candidate[candidates[k]] = TRUE;
+        }
+        narrowed += ( n >= 0 && (unsigned int) n < num_rows ) ? 1 : 0;
+        for ( unsigned int i = 0; i < num_rows; i++ ) {
+            if ( i >= NUM_INDEXED ) {
+                ck_assert_msg ( is_candidate[i], "appended row '%s' is not a candidate for '%s'", rows[i], queries[q] );
+            }
+            if ( helper_token_match ( tokens, rows[i] ) || helper_token_match_store ( tokens, rows[i], store, i ) ) {
+                ck_assert_msg ( is_candidate[i], "row '%s' matches '%s' (case sensitive: %d, normalize: %d) but is not a candidate",
+                                rows[i], queries[q], case_sensitive, config.normalize_match );
+            }
+        }
+        helper_tokenize_free ( tokens );
+    }
+    rofi_match_store_free ( store );
+    return narrowed;
+}
+
+/**
+ * @param num_shards The number of shards to build the index in.
+ *
+ * Build an index over the first NUM_INDEXED rows and wait till it is ready.
+ *
+ * @returns the index.
+ */
+static RofiTrigramIndex *build_index ( unsigned int num_shards )
+{
+    RofiTrigramIndex *index = rofi_trigram_index_new ( &test_mode, NUM_INDEXED, num_shards );
+    for ( unsigned int i = 0; i < 10000 && !rofi_trigram_index_ready ( index ); i++ ) {
+        g_usleep ( 1000 );
+    }
+    ck_assert ( rofi_trigram_index_ready ( index ) );
+    return index;
+}
+
+START_TEST ( test_trigram_index_superset )
+{
+    config.matching_method = MM_NORMAL;
+    for ( unsigned int normalize = 0; normalize < 2; normalize++ ) {
+        config.normalize_match = normalize;
+        for ( unsigned int shards = 1; shards <= 4; shards += 3 ) {
+            // The rows are folded (and normalized) while indexing, so it is built with the setting it is queried with.
+            RofiTrigramIndex *index = build_index ( shards );
+            ck_assert_int_gt ( check_queries ( index, FALSE ), 0 );
+            ck_assert_int_gt ( check_queries ( index, TRUE ), 0 );
+            rofi_trigram_index_free ( index );
+        }
+    }
+    config.normalize_match = FALSE;
+}
+END_TEST
+
+START_TEST ( test_trigram_index_narrow )
+{
+    config.matching_method = MM_NORMAL;
+    RofiTrigramIndex *index = build_index ( 2 );
+    unsigned int     candidates[G_N_ELEMENTS ( rows )];
+
+    rofi_int_matcher **tokens = helper_tokenize ( "firefox", FALSE );
+    int              n        = rofi_trigram_index_query ( index, tokens, NUM_INDEXED, candidates );
+    helper_tokenize_free ( tokens );
+    ck_assert_int_eq ( n, 3 );
+    ck_assert_int_eq ( candidates[0], 0 );
+    ck_assert_int_eq ( candidates[1], 1 );
+    ck_assert_int_eq ( candidates[2], 2 );
+
+    // Appended rows are always candidates.
+    tokens = helper_tokenize ( "firefox", FALSE );
+    n      = rofi_trigram_index_query ( index, tokens, G_N_ELEMENTS ( rows ), candidates );
+    helper_tokenize_free ( tokens );
+    ck_assert_int_eq ( n, 3 + G_N_ELEMENTS ( rows ) - NUM_INDEXED );
+    ck_assert_int_eq ( candidates[3], NUM_INDEXED );
+
+    // Too short, inverted or not plain tokens can not use the index.
+    tokens = helper_tokenize ( "ab", FALSE );
+    ck_assert_int_eq ( rofi_trigram_index_query ( index, tokens, NUM_INDEXED, candidates ), -1 );
+    helper_tokenize_free ( tokens );
+    tokens = helper_tokenize ( "-firefox", FALSE );
+    ck_assert_int_eq ( rofi_trigram_index_query ( index, tokens, NUM_INDEXED, candidates ), -1 );
+    helper_tokenize_free ( tokens );
+    config.matching_method = MM_FUZZY;
+    tokens                 = helper_tokenize ( "firefox", FALSE );
+    ck_assert_int_eq ( rofi_trigram_index_query ( index, tokens, NUM_INDEXED, candidates ), -1 );
+    helper_tokenize_free ( tokens );
+    config.matching_method = MM_NORMAL;
+
+    rofi_trigram_index_free ( index );
+}
+END_TEST
+
+static Suite * trigram_index_suite ( void )
+{
+    Suite *s = suite_create ( "TrigramIndex" );
+    TCase *tc_core = tcase_create ( "Core" );
+    tcase_add_test ( tc_core, test_trigram_index_superset );
+    tcase_add_test ( tc_core, test_trigram_index_narrow );
+    suite_add_tcase ( s, tc_core );
+    return s;
+}
+
+int main ( G_GNUC_UNUSED int argc, G_GNUC_UNUSED char ** argv )
+{
+    if ( setlocale ( LC_ALL, "" ) == NULL ) {
+        fprintf ( stderr, "Failed to set locale.\n" );
+        return EXIT_FAILURE;
+    }
+
+    Suite   *s  = trigram_index_suite ();
+    SRunner *sr = srunner_create ( s );
+    srunner_run_all ( sr, CK_NORMAL );
+    int     number_failed = srunner_ntests_failed ( sr );
+    srunner_free ( sr );
+    return ( number_failed == 0 ) ? EXIT_SUCCESS : EXIT_FAILURE;
+}